@@ -6,6 +6,7 @@
 #include "ModelImporter.hpp"
 #include "onnx2trt_utils.hpp"
 #include "toposort.hpp"
+#include <string_view>
 
 namespace onnx2trt
 {
@@ -24,10 +25,10 @@ using InputsMap = std::unordered_map<LayerName, nvinfer1::IIfConditionalInputLay
 // Search for a network Layer name in a SubgraphPortsMap using partial (prefix) name matching.
 // ONNX nodes are matched to network layers using prefix-matching because an ONNX node may have
 // several network layers associcated with it.
-SubgraphPortsMap::const_iterator findLayer(const SubgraphPortsMap& inputs, const std::string layerName)
+SubgraphPortsMap::const_iterator findLayer(const SubgraphPortsMap& inputs, std::string const& layerName)
 {
     return std::find_if(inputs.begin(), inputs.end(), [&](const auto& item) {
-        std::string const key = item.first->getName();
+        std::string_view const key = item.first->getName();
         return layerName.compare(0, key.size(), key) == 0;
     });
 }
@@ -73,7 +74,9 @@ Status addConditionalInputLayer(IImporterContext* ctx, nvinfer1::IIfConditional*
 };
 
 // Take a snapshot of the network before and after parsing the subgraph and return a list
-// of newly added network layers.
+// of newly added network layers. Only the layers added by the subgraph are visited, layers are appended to the
+// network in order. This also catches the layers importers add without registering them, e.g. constants and shape
+// computations, which need conditional inputs as much as the registered ones.
 Status importSubgraph(IImporterContext* ctx, ::ONNX_NAMESPACE::GraphProto const& subgraph,
     std::vector<nvinfer1::ILayer*>& newLayers, StringMap<TensorOrWeights>& subgraphTensors)
 {
@@ -91,7 +94,9 @@ Status importSubgraph(IImporterContext* ctx, ::ONNX_NAMESPACE::GraphProto const&
         subgraphTensors.emplace(std::make_pair(name, ctx->tensors().at(name)));
     }
 
-    for (int32_t i = beforeSubgraph; i < net->getNbLayers(); i++)
+    int32_t const afterSubgraph = net->getNbLayers();
+    newLayers.reserve(newLayers.size() + afterSubgraph - beforeSubgraph);
+    for (int32_t i = beforeSubgraph; i < afterSubgraph; i++)
     {
         newLayers.push_back(net->getLayer(i));
     }
@@ -101,24 +106,16 @@ Status importSubgraph(IImporterContext* ctx, ::ONNX_NAMESPACE::GraphProto const&
 
 // Add an IConditionalInputLayer to `layer`'s inputs, if they don't already exist.
 Status addConditionalInputIfNeeded(IImporterContext* ctx, nvinfer1::IIfConditional* conditional, InputsMap& inputsMap,
-    nvinfer1::ILayer& layer, SubgraphPortsMap subgraphInputsMap)
+    nvinfer1::ILayer& layer, SubgraphPortsMap const& subgraphInputsMap)
 {
-    // Return all of the layer's inputs that are external to the subgraph that
+    // Find all of the layer's inputs that are external to the subgraph that
     // that the layer belongs to.
-    auto getLayerExternalInputs = [&](std::string const& layerName) {
-        std::set<int32_t> inIndices;
-        auto iter = findLayer(subgraphInputsMap, layerName);
-        if (iter != subgraphInputsMap.end())
-        {
-            const auto& indicesSet = iter->second;
-            inIndices.insert(indicesSet.begin(), indicesSet.end());
-        }
-
-        return inIndices;
-    };
-
-    const auto inIndices = getLayerExternalInputs(layer.getName());
-    for (auto inIdx : inIndices)
+    auto const iter = findLayer(subgraphInputsMap, layer.getName());
+    if (iter == subgraphInputsMap.end())
+    {
+        return Status::success();
+    }
+    for (auto inIdx : iter->second)
     {
         LOG_VERBOSE("Adding Input layer for " << layer.getName());
         addConditionalInputLayer(ctx, conditional, inputsMap, layer, inIdx);
@@ -225,10 +222,7 @@ Status getSubgraphTensors(const std::vector<nvinfer1::ILayer*>& newLayers,
     std::unordered_map<nvinfer1::ITensor*, std::set<int32_t>>& externalOutputs, bool extractOutputs,
     const std::vector<std::string>* reportedOutputs = nullptr)
 {
-    using NodeName = std::string;
-    using TensorName = std::string;
     using PortIndex = int32_t;
-    using Port = std::pair<NodeName, PortIndex>;
     using TensorsSet = std::unordered_set<nvinfer1::ITensor*>;
     TensorsSet outputTensors;
     TensorsSet inputTensors;
@@ -263,15 +257,14 @@ Status getSubgraphTensors(const std::vector<nvinfer1::ILayer*>& newLayers,
         getTensors(l, true, [&](nvinfer1::ITensor* t) { res.emplace_back(t); });
     };
 
-    // Retrieve the list of tensors either exiting or entering the subgraph.
-    std::unordered_map<nvinfer1::ITensor*, std::vector<Port>> externalPortsMap;
+    // Retrieve the list of tensors either exiting or entering the subgraph, with the port indices they connect to.
     auto filterTensors = [&](TensorsSet const& tensors, auto getNodeAccessor) {
+        TensorsVec nodeAccessor;
         for (nvinfer1::ILayer const* l : newLayers)
         {
-            const auto& nodeName = l->getName();
             PortIndex i = 0;
 
-            TensorsVec nodeAccessor;
+            nodeAccessor.clear();
             getNodeAccessor(l, nodeAccessor);
             for (const auto& tensor : nodeAccessor)
             {
@@ -281,7 +274,7 @@ Status getSubgraphTensors(const std::vector<nvinfer1::ILayer*>& newLayers,
                 }
                 if (tensors.count(tensor) == 0)
                 {
-                    TensorName tensorName = tensor->getName();
+                    std::string_view const tensorName = tensor->getName();
                     auto prefixFound = false;
                     if (reportedOutputs)
                     {
@@ -300,7 +293,7 @@ Status getSubgraphTensors(const std::vector<nvinfer1::ILayer*>& newLayers,
                     }
                     if (!reportedOutputs || prefixFound)
                     {
-                        externalPortsMap[tensor].push_back(std::make_pair(nodeName, i));
+                        externalOutputs[tensor].insert(i);
                     }
                 }
                 i++;
@@ -316,18 +309,6 @@ Status getSubgraphTensors(const std::vector<nvinfer1::ILayer*>& newLayers,
     {
         filterTensors(outputTensors, getInputs);
     }
-
-    // Create the user's view of the external inputs, which uses the node-name as the key for
-    // looking up input/output port index.
-    for (auto const& input : externalPortsMap)
-    {
-        for (const Port& inPort : input.second)
-        {
-            auto* tensor = input.first;
-            auto const portIndex = inPort.second;
-            externalOutputs[tensor].insert(portIndex);
-        }
-    }
     return Status::success();
 }
 
@@ -0,0 +1,548 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ConstantFolding.hpp"
+#include "OnnxAttrs.hpp"
+#include "onnx2trt_utils.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <unordered_map>
+
+namespace onnx2trt
+{
+
+namespace
+{
+
+//! Values of an integer weights input widened for host evaluation.
+struct HostTensor
+{
+    nvinfer1::Dims shape{0, {}};
+    std::vector<int64_t> ints;
+
+    int64_t count() const
+    {
+        return ints.size();
+    }
+};
+
+constexpr int64_t kINT64_MAX = std::numeric_limits<int64_t>::max();
+constexpr int64_t kINT64_MIN = std::numeric_limits<int64_t>::min();
+
+using FoldFunction = std::function<bool(IImporterContext* ctx, ::ONNX_NAMESPACE::NodeProto const& node,
+    std::vector<HostTensor> const& inputs, HostTensor& output)>;
+
+//! Read the shape of weights and, if readValues is true, their values. Returns false for unsupported types.
+//! Floating-point weights are not folded: the results would be anonymous weights, which cannot be refitted under the
+//! names of the initializers they were computed from.
+bool readWeights(ShapedWeights const& weights, HostTensor& tensor, bool readValues)
+{
+    tensor.shape = weights.shape;
+    if (!readValues)
+    {
+        return true;
+    }
+    size_t const count = weights.count();
+    switch (weights.type)
+    {
+    case ::ONNX_NAMESPACE::TensorProto::INT32:
+    {
+        auto const* values = static_cast<int32_t const*>(weights.values);
+        tensor.ints.assign(values, values + count);
+        return true;
+    }
+    case ::ONNX_NAMESPACE::TensorProto::INT64:
+    {
+        auto const* values = static_cast<int64_t const*>(weights.values);
+        tensor.ints.assign(values, values + count);
+        return true;
+    }
+    default: return false;
+    }
+}
+
+ShapedWeights writeWeights(IImporterContext* ctx, HostTensor const& tensor)
+{
+    ShapedWeights weights = ctx->createTempWeights(::ONNX_NAMESPACE::TensorProto::INT32, tensor.shape);
+    auto* values = static_cast<int32_t*>(weights.values);
+    // Clamp like convertINT64() does for INT64 initializers.
+    std::transform(tensor.ints.begin(), tensor.ints.end(), values, [](int64_t v) {
+        return static_cast<int32_t>(std::min<int64_t>(
+            std::max<int64_t>(v, std::numeric_limits<int32_t>::min()), std::numeric_limits<int32_t>::max()));
+    });
+    return weights;
+}
+
+//! Convert axis to the range [0, nbDims). Returns false if it is out of range.
+bool normalizeAxis(int64_t& axis, int32_t nbDims)
+{
+    if (axis < 0)
+    {
+        axis += nbDims;
+    }
+    return 0 <= axis && axis < nbDims;
+}
+
+//! Axes of Squeeze and Unsqueeze, from their second input since opset 13 and from an attribute before.
+bool getAxes(IImporterContext* ctx, ::ONNX_NAMESPACE::NodeProto const& node, std::vector<HostTensor> const& inputs,
+    std::vector<int64_t>& axes, bool& specified)
+{
+    if (ctx->getOpsetVersion() >= 13)
+    {
+        specified = inputs.size() == 2;
+        if (specified)
+        {
+            axes = inputs[1].ints;
+        }
+        return true;
+    }
+    OnnxAttrs attrs(node, ctx);
+    specified = attrs.count("axes");
+    if (specified)
+    {
+        axes = attrs.get<std::vector<int64_t>>("axes");
+    }
+    return true;
+}
+
+bool foldShape(IImporterContext* ctx, ::ONNX_NAMESPACE::NodeProto const& node, std::vector<HostTensor> const& inputs,
+    HostTensor& output)
+{
+    // Shape-15 selects dimensions [start, end), both clamped to [0, rank] after adding rank to negative values.
+    OnnxAttrs attrs(node, ctx);
+    int64_t const rank = inputs[0].shape.nbDims;
+    auto clampToRank = [rank](int64_t i) { return std::min(std::max(i < 0 ? i + rank : i, int64_t{0}), rank); };
+    int64_t const start = clampToRank(attrs.get<int32_t>("start", 0));
+    int64_t const end = clampToRank(attrs.get<int32_t>("end", static_cast<int32_t>(rank)));
+    for (int64_t i = start; i < end; ++i)
+    {
+        output.ints.push_back(inputs[0].shape.d[i]);
+    }
+    output.shape = nvinfer1::Dims{1, {static_cast<int32_t>(output.ints.size())}};
+    return true;
+}
+
+bool foldSize(IImporterContext*, ::ONNX_NAMESPACE::NodeProto const&, std::vector<HostTensor> const& inputs,
+    HostTensor& output)
+{
+    output.shape = nvinfer1::Dims{0, {}};
+    output.ints = {volume(inputs[0].shape)};
+    return true;
+}
+
+bool foldCast(IImporterContext* ctx, ::ONNX_NAMESPACE::NodeProto const& node, std::vector<HostTensor> const& inputs,
+    HostTensor& output)
+{
+    OnnxAttrs attrs(node, ctx);
+    int32_t const to = attrs.get<int32_t>("to");
+    if (to != ::ONNX_NAMESPACE::TensorProto::INT32 && to != ::ONNX_NAMESPACE::TensorProto::INT64)
+    {
+        return false;
+    }
+    output = inputs[0];
+    return true;
+}
+
+bool foldReshape(IImporterContext* ctx, ::ONNX_NAMESPACE::NodeProto const& node, std::vector<HostTensor> const& inputs,
+    HostTensor& output)
+{
+    HostTensor const& data = inputs[0];
+    HostTensor const& newShape = inputs[1];
+    if (newShape.count() > nvinfer1::Dims::MAX_DIMS)
+    {
+        return false;
+    }
+    OnnxAttrs attrs(node, ctx);
+    bool const allowZero = attrs.get<int32_t>("allowzero", 0);
+    output = data;
+    output.shape.nbDims = newShape.count();
+    int32_t inferredDim = -1;
+    int64_t known = 1;
+    for (int32_t i = 0; i < output.shape.nbDims; ++i)
+    {
+        int64_t dim = newShape.ints[i];
+        if (dim == 0 && !allowZero)
+        {
+            if (i >= data.shape.nbDims)
+            {
+                return false;
+            }
+            dim = data.shape.d[i];
+        }
+        if (dim == -1)
+        {
+            if (inferredDim >= 0)
+            {
+                return false;
+            }
+            inferredDim = i;
+            continue;
+        }
+        if (dim < 0)
+        {
+            return false;
+        }
+        output.shape.d[i] = dim;
+        known *= dim;
+    }
+    if (inferredDim >= 0)
+    {
+        if (known == 0 || data.count() % known != 0)
+        {
+            return false;
+        }
+        output.shape.d[inferredDim] = data.count() / known;
+        known *= output.shape.d[inferredDim];
+    }
+    return known == data.count();
+}
+
+bool foldSqueeze(IImporterContext* ctx, ::ONNX_NAMESPACE::NodeProto const& node, std::vector<HostTensor> const& inputs,
+    HostTensor& output)
+{
+    std::vector<int64_t> axes;
+    bool specified{false};
+    if (!getAxes(ctx, node, inputs, axes, specified))
+    {
+        return false;
+    }
+    HostTensor const& data = inputs[0];
+    std::vector<bool> squeezed(data.shape.nbDims, !specified);
+    for (int64_t axis : axes)
+    {
+        if (!normalizeAxis(axis, data.shape.nbDims) || data.shape.d[axis] != 1)
+        {
+            return false;
+        }
+        squeezed[axis] = true;
+    }
+    output = data;
+    output.shape.nbDims = 0;
+    for (int32_t i = 0; i < data.shape.nbDims; ++i)
+    {
+        if (!squeezed[i] || data.shape.d[i] != 1)
+        {
+            output.shape.d[output.shape.nbDims++] = data.shape.d[i];
+        }
+    }
+    return true;
+}
+
+bool foldUnsqueeze(IImporterContext* ctx, ::ONNX_NAMESPACE::NodeProto const& node,
+    std::vector<HostTensor> const& inputs, HostTensor& output)
+{
+    std::vector<int64_t> axes;
+    bool specified{false};
+    if (!getAxes(ctx, node, inputs, axes, specified) || !specified)
+    {
+        return false;
+    }
+    HostTensor const& data = inputs[0];
+    int32_t const nbDims = data.shape.nbDims + axes.size();
+    if (nbDims > nvinfer1::Dims::MAX_DIMS)
+    {
+        return false;
+    }
+    std::vector<bool> inserted(nbDims, false);
+    for (int64_t axis : axes)
+    {
+        if (!normalizeAxis(axis, nbDims) || inserted[axis])
+        {
+            return false;
+        }
+        inserted[axis] = true;
+    }
+    output = data;
+    output.shape.nbDims = nbDims;
+    for (int32_t i = 0, j = 0; i < nbDims; ++i)
+    {
+        output.shape.d[i] = inserted[i] ? 1 : data.shape.d[j++];
+    }
+    return true;
+}
+
+bool foldConcat(IImporterContext* ctx, ::ONNX_NAMESPACE::NodeProto const& node, std::vector<HostTensor> const& inputs,
+    HostTensor& output)
+{
+    OnnxAttrs attrs(node, ctx);
+    HostTensor const& first = inputs[0];
+    int64_t axis = attrs.get<int32_t>("axis");
+    if (!normalizeAxis(axis, first.shape.nbDims))
+    {
+        return false;
+    }
+    // Inputs are copied as blocks of [axis, rank) for each index in [0, axis).
+    int64_t outer = 1;
+    for (int32_t i = 0; i < axis; ++i)
+    {
+        outer *= first.shape.d[i];
+    }
+    output.shape = first.shape;
+    output.shape.d[axis] = 0;
+    for (auto const& input : inputs)
+    {
+        if (input.shape.nbDims != first.shape.nbDims)
+        {
+            return false;
+        }
+        for (int32_t i = 0; i < first.shape.nbDims; ++i)
+        {
+            if (i != axis && input.shape.d[i] != first.shape.d[i])
+            {
+                return false;
+            }
+        }
+        output.shape.d[axis] += input.shape.d[axis];
+    }
+    for (int64_t o = 0; o < outer; ++o)
+    {
+        for (auto const& input : inputs)
+        {
+            int64_t const block = input.count() / outer;
+            auto const begin = input.ints.begin() + o * block;
+            output.ints.insert(output.ints.end(), begin, begin + block);
+        }
+    }
+    return true;
+}
+
+bool foldGather(IImporterContext* ctx, ::ONNX_NAMESPACE::NodeProto const& node, std::vector<HostTensor> const& inputs,
+    HostTensor& output)
+{
+    OnnxAttrs attrs(node, ctx);
+    HostTensor const& data = inputs[0];
+    HostTensor const& indices = inputs[1];
+    int64_t axis = attrs.get<int32_t>("axis", 0);
+    if (!normalizeAxis(axis, data.shape.nbDims)
+        || data.shape.nbDims - 1 + indices.shape.nbDims > nvinfer1::Dims::MAX_DIMS)
+    {
+        return false;
+    }
+    // The result is data[outer, indices, inner] with the dimensions of indices replacing dimension axis of data.
+    int64_t outer = 1;
+    int64_t inner = 1;
+    output.shape.nbDims = 0;
+    for (int32_t i = 0; i < axis; ++i)
+    {
+        outer *= data.shape.d[i];
+        output.shape.d[output.shape.nbDims++] = data.shape.d[i];
+    }
+    for (int32_t i = 0; i < indices.shape.nbDims; ++i)
+    {
+        output.shape.d[output.shape.nbDims++] = indices.shape.d[i];
+    }
+    for (int32_t i = axis + 1; i < data.shape.nbDims; ++i)
+    {
+        inner *= data.shape.d[i];
+        output.shape.d[output.shape.nbDims++] = data.shape.d[i];
+    }
+    int64_t const axisDim = data.shape.d[axis];
+    for (int64_t o = 0; o < outer; ++o)
+    {
+        for (int64_t index : indices.ints)
+        {
+            if (index < 0)
+            {
+                index += axisDim;
+            }
+            if (index < 0 || index >= axisDim)
+            {
+                return false;
+            }
+            int64_t const begin = (o * axisDim + index) * inner;
+            output.ints.insert(output.ints.end(), data.ints.begin() + begin, data.ints.begin() + begin + inner);
+        }
+    }
+    return true;
+}
+
+//! Evaluate a binary elementwise operation with multidirectional broadcasting. op returns false if it cannot
+//! compute a result, e.g. on overflow, in which case the node is not folded.
+template <typename IntOp>
+bool foldElementWise(std::vector<HostTensor> const& inputs, HostTensor& output, IntOp intOp)
+{
+    HostTensor const& a = inputs[0];
+    HostTensor const& b = inputs[1];
+    // Align both shapes to the output rank and compute the strides over their elements, 0 along broadcast dims.
+    int32_t const nbDims = std::max(a.shape.nbDims, b.shape.nbDims);
+    output.shape.nbDims = nbDims;
+    std::vector<int64_t> aStrides(nbDims, 0);
+    std::vector<int64_t> bStrides(nbDims, 0);
+    int64_t aStride = 1;
+    int64_t bStride = 1;
+    for (int32_t i = nbDims - 1; i >= 0; --i)
+    {
+        int32_t const ai = i - (nbDims - a.shape.nbDims);
+        int32_t const bi = i - (nbDims - b.shape.nbDims);
+        int64_t const aDim = ai >= 0 ? a.shape.d[ai] : 1;
+        int64_t const bDim = bi >= 0 ? b.shape.d[bi] : 1;
+        if (aDim != bDim && aDim != 1 && bDim != 1)
+        {
+            return false;
+        }
+        output.shape.d[i] = aDim == 1 ? bDim : aDim;
+        aStrides[i] = aDim == 1 ? 0 : aStride;
+        bStrides[i] = bDim == 1 ? 0 : bStride;
+        aStride *= aDim;
+        bStride *= bDim;
+    }
+    int64_t const count = volume(output.shape);
+    if (count > kMAX_FOLDED_ELEMENTS)
+    {
+        return false;
+    }
+    std::vector<int64_t> index(nbDims, 0);
+    int64_t aOffset = 0;
+    int64_t bOffset = 0;
+    for (int64_t n = 0; n < count; ++n)
+    {
+        int64_t result{};
+        if (!intOp(a.ints[aOffset], b.ints[bOffset], result))
+        {
+            return false;
+        }
+        output.ints.push_back(result);
+        // Advance the output index like an odometer and move the input offsets along.
+        for (int32_t i = nbDims - 1; i >= 0; --i)
+        {
+            aOffset += aStrides[i];
+            bOffset += bStrides[i];
+            if (++index[i] < output.shape.d[i])
+            {
+                break;
+            }
+            aOffset -= aStrides[i] * index[i];
+            bOffset -= bStrides[i] * index[i];
+            index[i] = 0;
+        }
+    }
+    return true;
+}
+
+string_map<FoldFunction> const& getFoldFunctionMap()
+{
+    static string_map<FoldFunction> const foldFunctions{
+        {"Shape", foldShape},
+        {"Size", foldSize},
+        {"Identity",
+            [](IImporterContext*, ::ONNX_NAMESPACE::NodeProto const&, std::vector<HostTensor> const& inputs,
+                HostTensor& output) {
+                output = inputs[0];
+                return true;
+            }},
+        {"Cast", foldCast},
+        {"Reshape", foldReshape},
+        {"Squeeze", foldSqueeze},
+        {"Unsqueeze", foldUnsqueeze},
+        {"Concat", foldConcat},
+        {"Gather", foldGather},
+        {"Add",
+            [](IImporterContext*, ::ONNX_NAMESPACE::NodeProto const&, std::vector<HostTensor> const& inputs,
+                HostTensor& output) {
+                return foldElementWise(
+                    inputs, output,
+                    [](int64_t a, int64_t b, int64_t& r) {
+                        if ((b > 0 && a > kINT64_MAX - b) || (b < 0 && a < kINT64_MIN - b))
+                        {
+                            return false;
+                        }
+                        r = a + b;
+                        return true;
+                    });
+            }},
+        {"Sub",
+            [](IImporterContext*, ::ONNX_NAMESPACE::NodeProto const&, std::vector<HostTensor> const& inputs,
+                HostTensor& output) {
+                return foldElementWise(
+                    inputs, output,
+                    [](int64_t a, int64_t b, int64_t& r) {
+                        if ((b < 0 && a > kINT64_MAX + b) || (b > 0 && a < kINT64_MIN + b))
+                        {
+                            return false;
+                        }
+                        r = a - b;
+                        return true;
+                    });
+            }},
+        {"Mul",
+            [](IImporterContext*, ::ONNX_NAMESPACE::NodeProto const&, std::vector<HostTensor> const& inputs,
+                HostTensor& output) {
+                return foldElementWise(
+                    inputs, output,
+                    [](int64_t a, int64_t b, int64_t& r) {
+                        bool const overflows = a > 0
+                            ? (b > 0 ? a > kINT64_MAX / b : b < kINT64_MIN / a)
+                            : (b > 0 ? a < kINT64_MIN / b : a != 0 && b < kINT64_MAX / a);
+                        if (overflows)
+                        {
+                            return false;
+                        }
+                        r = a * b;
+                        return true;
+                    });
+            }},
+        {"Div",
+            [](IImporterContext*, ::ONNX_NAMESPACE::NodeProto const&, std::vector<HostTensor> const& inputs,
+                HostTensor& output) {
+                // Integer division truncates, as in ONNX Runtime. Division by zero and the overflowing
+                // INT64_MIN / -1 are left to the builder.
+                return foldElementWise(inputs, output, [](int64_t a, int64_t b, int64_t& r) {
+                    if (b == 0 || (a == kINT64_MIN && b == -1))
+                    {
+                        return false;
+                    }
+                    r = a / b;
+                    return true;
+                });
+            }},
+    };
+    return foldFunctions;
+}
+
+} // namespace
+
+bool foldConstantNode(IImporterContext* ctx, ::ONNX_NAMESPACE::NodeProto const& node,
+    std::vector<TensorOrWeights> const& inputs, std::vector<TensorOrWeights>& outputs)
+{
+    if (!node.domain().empty() && node.domain() != "ai.onnx")
+    {
+        return false;
+    }
+    auto const& foldFunctions = getFoldFunctionMap();
+    auto const fold = foldFunctions.find(node.op_type());
+    if (fold == foldFunctions.end() || inputs.empty())
+    {
+        return false;
+    }
+
+    // Shape and Size only look at the shape of their input, which can be of any size and type.
+    bool const readValues = node.op_type() != "Shape" && node.op_type() != "Size";
+    std::vector<HostTensor> hostInputs(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        if (!inputs[i].is_weights())
+        {
+            return false;
+        }
+        ShapedWeights const& weights = inputs[i].weights();
+        if ((readValues && static_cast<int64_t>(weights.count()) > kMAX_FOLDED_ELEMENTS)
+            || !readWeights(weights, hostInputs[i], readValues))
+        {
+            return false;
+        }
+    }
+    HostTensor output;
+    if (!fold->second(ctx, node, hostInputs, output) || output.count() != volume(output.shape)
+        || output.count() > kMAX_FOLDED_ELEMENTS)
+    {
+        return false;
+    }
+    outputs = {writeWeights(ctx, output)};
+    return true;
+}
+
+} // namespace onnx2trt
@@ -0,0 +1,35 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Host evaluation of nodes whose inputs are all weights.
+ *
+ */
+
+#pragma once
+
+#include "ImporterContext.hpp"
+#include "TensorOrWeights.hpp"
+#include <onnx/onnx_pb.h>
+#include <vector>
+
+namespace onnx2trt
+{
+
+//! Largest number of elements of a result computed on the host. Folding targets the small constant chains that
+//! compute shapes and indices. Larger weights are left to the builder, which keeps them refittable.
+constexpr int64_t kMAX_FOLDED_ELEMENTS = 1 << 12;
+
+//! Evaluate node on the host if all of its inputs are weights of type INT32 or INT64 and it is one of Shape, Size,
+//! Identity, Cast, Reshape, Squeeze, Unsqueeze, Concat, Gather, Add, Sub, Mul or Div. Shape and Size take inputs of
+//! any type, as they only read their shape. Called for every node when kFOLD_CONSTANT_NODES is set.
+//!
+//! Floating-point weights are never folded, as the results would not be refittable under the names of the
+//! initializers they are computed from. Arithmetic that overflows INT64 is left to the builder. Results are stored
+//! as INT32, like the INT64 initializers they replace.
+//!
+//! \return true if the node was folded, in which case outputs holds its results as weights. false if the node must be
+//!         imported as usual, which is also the case for malformed nodes so that their importer reports the error.
+bool foldConstantNode(IImporterContext* ctx, ::ONNX_NAMESPACE::NodeProto const& node,
+    std::vector<TensorOrWeights> const& inputs, std::vector<TensorOrWeights>& outputs);
+
+} // namespace onnx2trt
@@ -0,0 +1,404 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "DataConversion.hpp"
+#include "half.h"
+
+#include <algorithm>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define ONNX2TRT_X86_DISPATCH 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define ONNX2TRT_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace onnx2trt
+{
+
+namespace
+{
+
+constexpr int64_t kINT32_MAX{std::numeric_limits<int32_t>::max()};
+constexpr int64_t kINT32_MIN{std::numeric_limits<int32_t>::min()};
+constexpr double kFLOAT_MAX{static_cast<double>(std::numeric_limits<float>::max())};
+constexpr double kFLOAT_LOWEST{static_cast<double>(std::numeric_limits<float>::lowest())};
+
+size_t convertInt64ToInt32Scalar(int64_t const* src, int32_t* dst, size_t count)
+{
+    size_t nbClamped{0};
+    for (size_t i = 0; i < count; ++i)
+    {
+        int64_t const v = src[i];
+        nbClamped += (v > kINT32_MAX) | (v < kINT32_MIN);
+        dst[i] = static_cast<int32_t>(std::max(std::min(v, kINT32_MAX), kINT32_MIN));
+    }
+    return nbClamped;
+}
+
+size_t convertDoubleToFloatScalar(double const* src, float* dst, size_t count)
+{
+    size_t nbClamped{0};
+    for (size_t i = 0; i < count; ++i)
+    {
+        double const v = src[i];
+        bool const outOfRange = v > kFLOAT_MAX || v < kFLOAT_LOWEST;
+        nbClamped += outOfRange;
+        dst[i] = outOfRange ? static_cast<float>(v > 0. ? kFLOAT_MAX : kFLOAT_LOWEST) : static_cast<float>(v);
+    }
+    return nbClamped;
+}
+
+void convertHalfToFloatScalar(uint16_t const* src, float* dst, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        dst[i] = half_float::detail::half2float<float>(src[i]);
+    }
+}
+
+void convertUint8ToInt32Scalar(uint8_t const* src, int32_t* dst, size_t count)
+{
+    std::copy(src, src + count, dst);
+}
+
+#if ONNX2TRT_X86_DISPATCH
+
+enum class Isa
+{
+    kSCALAR,
+    kAVX2,
+    kAVX512
+};
+
+Isa detectIsa()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("f16c"))
+    {
+        return Isa::kAVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c"))
+    {
+        return Isa::kAVX2;
+    }
+    return Isa::kSCALAR;
+}
+
+Isa getIsa()
+{
+    static Isa const isa = detectIsa();
+    return isa;
+}
+
+__attribute__((target("avx2"))) size_t convertInt64ToInt32Avx2(int64_t const* src, int32_t* dst, size_t count)
+{
+    __m256i const hi = _mm256_set1_epi64x(kINT32_MAX);
+    __m256i const lo = _mm256_set1_epi64x(kINT32_MIN);
+    // Selects the low 32 bits of each 64-bit lane into the lower half of the register.
+    __m256i const pack = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    size_t nbClamped{0};
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i));
+        __m256i const tooBig = _mm256_cmpgt_epi64(v, hi);
+        __m256i const tooSmall = _mm256_cmpgt_epi64(lo, v);
+        v = _mm256_blendv_epi8(v, hi, tooBig);
+        v = _mm256_blendv_epi8(v, lo, tooSmall);
+        nbClamped += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_or_si256(tooBig, tooSmall))));
+        __m256i const packed = _mm256_permutevar8x32_epi32(v, pack);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_castsi256_si128(packed));
+    }
+    return nbClamped + convertInt64ToInt32Scalar(src + i, dst + i, count - i);
+}
+
+// The AVX-512 kernels convert the tail of a buffer through a zero-padded copy, so that every lane of the last vector
+// is initialized, and use the zero-masking forms of the conversions, whose unmasked forms take an undefined
+// pass-through operand. Both would otherwise trip -Wmaybe-uninitialized with GCC.
+
+__attribute__((target("avx512f"))) size_t convertInt64ToInt32Vector512(
+    int64_t const* src, int32_t* dst, __m512i hi, __m512i lo)
+{
+    __m512i const v = _mm512_loadu_si512(src);
+    __mmask8 const outOfRange = _mm512_cmpgt_epi64_mask(v, hi) | _mm512_cmpgt_epi64_mask(lo, v);
+    // Saturating narrow.
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm512_maskz_cvtsepi64_epi32(0xFF, v));
+    return __builtin_popcount(outOfRange);
+}
+
+__attribute__((target("avx512f"))) size_t convertInt64ToInt32Avx512(int64_t const* src, int32_t* dst, size_t count)
+{
+    __m512i const hi = _mm512_set1_epi64(kINT32_MAX);
+    __m512i const lo = _mm512_set1_epi64(kINT32_MIN);
+    size_t nbClamped{0};
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        nbClamped += convertInt64ToInt32Vector512(src + i, dst + i, hi, lo);
+    }
+    if (i < count)
+    {
+        int64_t tailSrc[8]{};
+        int32_t tailDst[8];
+        std::copy(src + i, src + count, tailSrc);
+        nbClamped += convertInt64ToInt32Vector512(tailSrc, tailDst, hi, lo);
+        std::copy(tailDst, tailDst + (count - i), dst + i);
+    }
+    return nbClamped;
+}
+
+__attribute__((target("avx2"))) size_t convertDoubleToFloatAvx2(double const* src, float* dst, size_t count)
+{
+    __m256d const hi = _mm256_set1_pd(kFLOAT_MAX);
+    __m256d const lo = _mm256_set1_pd(kFLOAT_LOWEST);
+    size_t nbClamped{0};
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m256d v = _mm256_loadu_pd(src + i);
+        __m256d const outOfRange
+            = _mm256_or_pd(_mm256_cmp_pd(v, hi, _CMP_GT_OQ), _mm256_cmp_pd(v, lo, _CMP_LT_OQ));
+        nbClamped += __builtin_popcount(_mm256_movemask_pd(outOfRange));
+        // min/max return the second operand when either is NaN, which keeps NaNs intact.
+        v = _mm256_max_pd(lo, _mm256_min_pd(hi, v));
+        _mm_storeu_ps(dst + i, _mm256_cvtpd_ps(v));
+    }
+    return nbClamped + convertDoubleToFloatScalar(src + i, dst + i, count - i);
+}
+
+__attribute__((target("avx512f"))) size_t convertDoubleToFloatVector512(
+    double const* src, float* dst, __m512d hi, __m512d lo)
+{
+    __m512d v = _mm512_loadu_pd(src);
+    __mmask8 const outOfRange = _mm512_cmp_pd_mask(v, hi, _CMP_GT_OQ) | _mm512_cmp_pd_mask(v, lo, _CMP_LT_OQ);
+    v = _mm512_maskz_max_pd(0xFF, lo, _mm512_maskz_min_pd(0xFF, hi, v));
+    _mm256_storeu_ps(dst, _mm512_maskz_cvtpd_ps(0xFF, v));
+    return __builtin_popcount(outOfRange);
+}
+
+__attribute__((target("avx512f"))) size_t convertDoubleToFloatAvx512(double const* src, float* dst, size_t count)
+{
+    __m512d const hi = _mm512_set1_pd(kFLOAT_MAX);
+    __m512d const lo = _mm512_set1_pd(kFLOAT_LOWEST);
+    size_t nbClamped{0};
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        nbClamped += convertDoubleToFloatVector512(src + i, dst + i, hi, lo);
+    }
+    if (i < count)
+    {
+        double tailSrc[8]{};
+        float tailDst[8];
+        std::copy(src + i, src + count, tailSrc);
+        nbClamped += convertDoubleToFloatVector512(tailSrc, tailDst, hi, lo);
+        std::copy(tailDst, tailDst + (count - i), dst + i);
+    }
+    return nbClamped;
+}
+
+__attribute__((target("avx2,f16c"))) void convertHalfToFloatAvx2(uint16_t const* src, float* dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(v));
+    }
+    convertHalfToFloatScalar(src + i, dst + i, count - i);
+}
+
+__attribute__((target("avx512f"))) void convertHalfToFloatAvx512(uint16_t const* src, float* dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i const v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i));
+        _mm512_storeu_ps(dst + i, _mm512_maskz_cvtph_ps(0xFFFF, v));
+    }
+    if (i < count)
+    {
+        uint16_t tailSrc[16]{};
+        float tailDst[16];
+        std::copy(src + i, src + count, tailSrc);
+        __m256i const v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(tailSrc));
+        _mm512_storeu_ps(tailDst, _mm512_maskz_cvtph_ps(0xFFFF, v));
+        std::copy(tailDst, tailDst + (count - i), dst + i);
+    }
+}
+
+__attribute__((target("avx2"))) void convertUint8ToInt32Avx2(uint8_t const* src, int32_t* dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i const v = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_cvtepu8_epi32(v));
+    }
+    convertUint8ToInt32Scalar(src + i, dst + i, count - i);
+}
+
+__attribute__((target("avx512f"))) void convertUint8ToInt32Avx512(uint8_t const* src, int32_t* dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+        _mm512_storeu_si512(dst + i, _mm512_maskz_cvtepu8_epi32(0xFFFF, v));
+    }
+    if (i < count)
+    {
+        uint8_t tailSrc[16]{};
+        int32_t tailDst[16];
+        std::copy(src + i, src + count, tailSrc);
+        __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(tailSrc));
+        _mm512_storeu_si512(tailDst, _mm512_maskz_cvtepu8_epi32(0xFFFF, v));
+        std::copy(tailDst, tailDst + (count - i), dst + i);
+    }
+}
+
+#endif // ONNX2TRT_X86_DISPATCH
+
+#if ONNX2TRT_NEON
+
+size_t convertInt64ToInt32Neon(int64_t const* src, int32_t* dst, size_t count)
+{
+    size_t nbClamped{0};
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        int64x2_t const v = vld1q_s64(src + i);
+        // Saturating narrow. A value was clamped iff widening it back does not reproduce the input.
+        int32x2_t const narrowed = vqmovn_s64(v);
+        uint64x2_t const same = vceqq_s64(vmovl_s32(narrowed), v);
+        nbClamped += 2 - (vgetq_lane_u64(same, 0) & 1) - (vgetq_lane_u64(same, 1) & 1);
+        vst1_s32(dst + i, narrowed);
+    }
+    return nbClamped + convertInt64ToInt32Scalar(src + i, dst + i, count - i);
+}
+
+size_t convertDoubleToFloatNeon(double const* src, float* dst, size_t count)
+{
+    float64x2_t const hi = vdupq_n_f64(kFLOAT_MAX);
+    float64x2_t const lo = vdupq_n_f64(kFLOAT_LOWEST);
+    size_t nbClamped{0};
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        float64x2_t v = vld1q_f64(src + i);
+        uint64x2_t const outOfRange = vorrq_u64(vcgtq_f64(v, hi), vcltq_f64(v, lo));
+        nbClamped += (vgetq_lane_u64(outOfRange, 0) & 1) + (vgetq_lane_u64(outOfRange, 1) & 1);
+        // vmin/vmax propagate NaNs.
+        v = vmaxq_f64(vminq_f64(v, hi), lo);
+        vst1_f32(dst + i, vcvt_f32_f64(v));
+    }
+    return nbClamped + convertDoubleToFloatScalar(src + i, dst + i, count - i);
+}
+
+void convertHalfToFloatNeon(uint16_t const* src, float* dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        float16x4_t const v = vreinterpret_f16_u16(vld1_u16(src + i));
+        vst1q_f32(dst + i, vcvt_f32_f16(v));
+    }
+    convertHalfToFloatScalar(src + i, dst + i, count - i);
+}
+
+void convertUint8ToInt32Neon(uint8_t const* src, int32_t* dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        uint16x8_t const v = vmovl_u8(vld1_u8(src + i));
+        vst1q_s32(dst + i, vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(v))));
+        vst1q_s32(dst + i + 4, vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(v))));
+    }
+    convertUint8ToInt32Scalar(src + i, dst + i, count - i);
+}
+
+#endif // ONNX2TRT_NEON
+
+} // namespace
+
+size_t convertInt64ToInt32(int64_t const* src, int32_t* dst, size_t count)
+{
+#if ONNX2TRT_X86_DISPATCH
+    switch (getIsa())
+    {
+    case Isa::kAVX512: return convertInt64ToInt32Avx512(src, dst, count);
+    case Isa::kAVX2: return convertInt64ToInt32Avx2(src, dst, count);
+    case Isa::kSCALAR: break;
+    }
+#elif ONNX2TRT_NEON
+    return convertInt64ToInt32Neon(src, dst, count);
+#endif
+    return convertInt64ToInt32Scalar(src, dst, count);
+}
+
+size_t convertDoubleToFloat(double const* src, float* dst, size_t count)
+{
+#if ONNX2TRT_X86_DISPATCH
+    switch (getIsa())
+    {
+    case Isa::kAVX512: return convertDoubleToFloatAvx512(src, dst, count);
+    case Isa::kAVX2: return convertDoubleToFloatAvx2(src, dst, count);
+    case Isa::kSCALAR: break;
+    }
+#elif ONNX2TRT_NEON
+    return convertDoubleToFloatNeon(src, dst, count);
+#endif
+    return convertDoubleToFloatScalar(src, dst, count);
+}
+
+void convertHalfToFloat(uint16_t const* src, float* dst, size_t count)
+{
+#if ONNX2TRT_X86_DISPATCH
+    switch (getIsa())
+    {
+    case Isa::kAVX512: return convertHalfToFloatAvx512(src, dst, count);
+    case Isa::kAVX2: return convertHalfToFloatAvx2(src, dst, count);
+    case Isa::kSCALAR: break;
+    }
+#elif ONNX2TRT_NEON
+    return convertHalfToFloatNeon(src, dst, count);
+#endif
+    convertHalfToFloatScalar(src, dst, count);
+}
+
+void convertUint8ToInt32(uint8_t const* src, int32_t* dst, size_t count)
+{
+#if ONNX2TRT_X86_DISPATCH
+    switch (getIsa())
+    {
+    case Isa::kAVX512: return convertUint8ToInt32Avx512(src, dst, count);
+    case Isa::kAVX2: return convertUint8ToInt32Avx2(src, dst, count);
+    case Isa::kSCALAR: break;
+    }
+#elif ONNX2TRT_NEON
+    return convertUint8ToInt32Neon(src, dst, count);
+#endif
+    convertUint8ToInt32Scalar(src, dst, count);
+}
+
+char const* getDataConversionIsa()
+{
+#if ONNX2TRT_X86_DISPATCH
+    switch (getIsa())
+    {
+    case Isa::kAVX512: return "AVX-512";
+    case Isa::kAVX2: return "AVX2";
+    case Isa::kSCALAR: break;
+    }
+#elif ONNX2TRT_NEON
+    return "NEON";
+#endif
+    return "scalar";
+}
+
+} // namespace onnx2trt
@@ -0,0 +1,35 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace onnx2trt
+{
+
+// Bulk conversion kernels used when importing weights of types that TensorRT does not support natively.
+// On x86 the AVX2/F16C or AVX-512 implementation is selected at runtime, on AArch64 NEON is always used,
+// and any other platform falls back to scalar loops. Source pointers do not need to be aligned.
+
+//! Narrow INT64 values to INT32, clamping values outside of the INT32 range.
+//! \return The number of values that were clamped.
+size_t convertInt64ToInt32(int64_t const* src, int32_t* dst, size_t count);
+
+//! Narrow DOUBLE values to FLOAT, clamping values (including infinities) outside of the finite FLOAT range.
+//! NaNs are preserved.
+//! \return The number of values that were clamped.
+size_t convertDoubleToFloat(double const* src, float* dst, size_t count);
+
+//! Widen IEEE half-precision values, given by their bit patterns, to FLOAT.
+void convertHalfToFloat(uint16_t const* src, float* dst, size_t count);
+
+//! Widen UINT8 values to INT32.
+void convertUint8ToInt32(uint8_t const* src, int32_t* dst, size_t count);
+
+//! Name of the instruction set used by the conversion kernels on this machine, e.g. "AVX2". For logging.
+char const* getDataConversionIsa();
+
+} // namespace onnx2trt
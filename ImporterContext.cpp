@@ -4,10 +4,16 @@
 
 #include "ImporterContext.hpp"
 #include "NvInferVersion.h"
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 
 #if !defined(_WIN32)
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #if defined(__linux__)
 #include <link.h>
 #endif
@@ -27,6 +33,225 @@
 namespace onnx2trt
 {
 
+void* WeightsArena::allocate(size_t size, uint8_t value)
+{
+    if (size == 0)
+    {
+        return nullptr;
+    }
+    uint8_t* buffer{nullptr};
+    if (size > kMAX_SMALL_SIZE)
+    {
+        mBlocks.emplace_back(new uint8_t[size]);
+        mReservedBytes += size;
+        buffer = mBlocks.back().get();
+    }
+    else
+    {
+        size_t const alignedSize = (size + kALIGNMENT - 1) / kALIGNMENT * kALIGNMENT;
+        if (alignedSize > mPageRemaining)
+        {
+            // Start a new page. The unused tail of the previous page is abandoned.
+            mBlocks.emplace_back(new uint8_t[kPAGE_SIZE]);
+            mReservedBytes += kPAGE_SIZE;
+            mPageCursor = mBlocks.back().get();
+            mPageRemaining = kPAGE_SIZE;
+        }
+        buffer = mPageCursor;
+        mPageCursor += alignedSize;
+        mPageRemaining -= alignedSize;
+    }
+    mAllocatedBytes += size;
+    std::memset(buffer, value, size);
+    return buffer;
+}
+
+void WeightsArena::release()
+{
+    mBlocks.clear();
+    mPageCursor = nullptr;
+    mPageRemaining = 0;
+    mReservedBytes = 0;
+    mAllocatedBytes = 0;
+}
+
+class MappedFile
+{
+public:
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    //! Map the whole file at path. Returns nullptr if the file cannot be opened or mapped.
+    static std::unique_ptr<MappedFile> create(std::string const& path)
+    {
+        std::unique_ptr<MappedFile> file{new MappedFile{}};
+#if defined(_WIN32)
+        file->mFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file->mFile == INVALID_HANDLE_VALUE)
+        {
+            return nullptr;
+        }
+        LARGE_INTEGER fileSize{};
+        if (!GetFileSizeEx(file->mFile, &fileSize))
+        {
+            return nullptr;
+        }
+        file->mSize = static_cast<size_t>(fileSize.QuadPart);
+        if (file->mSize == 0)
+        {
+            return file;
+        }
+        file->mMapping = CreateFileMappingA(file->mFile, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        if (file->mMapping == nullptr)
+        {
+            return nullptr;
+        }
+        file->mData = MapViewOfFile(file->mMapping, FILE_MAP_COPY, 0, 0, 0);
+        if (file->mData == nullptr)
+        {
+            return nullptr;
+        }
+#else
+        int32_t const fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+        struct stat sb;
+        if (fstat(fd, &sb) != 0)
+        {
+            close(fd);
+            return nullptr;
+        }
+        file->mSize = static_cast<size_t>(sb.st_size);
+        if (file->mSize == 0)
+        {
+            close(fd);
+            return file;
+        }
+        // MAP_PRIVATE gives copy-on-write semantics. The descriptor is not needed once the mapping exists.
+        void* data = mmap(nullptr, file->mSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        file->mData = data;
+#endif
+        return file;
+    }
+
+    ~MappedFile()
+    {
+#if defined(_WIN32)
+        if (mData)
+        {
+            UnmapViewOfFile(mData);
+        }
+        if (mMapping)
+        {
+            CloseHandle(mMapping);
+        }
+        if (mFile != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(mFile);
+        }
+#else
+        if (mData)
+        {
+            munmap(mData, mSize);
+        }
+#endif
+    }
+
+    void* data() const
+    {
+        return mData;
+    }
+
+    size_t size() const
+    {
+        return mSize;
+    }
+
+private:
+    MappedFile() = default;
+
+    void* mData{nullptr};
+    size_t mSize{0};
+#if defined(_WIN32)
+    HANDLE mFile{INVALID_HANDLE_VALUE};
+    HANDLE mMapping{nullptr};
+#endif
+};
+
+ImporterContext::~ImporterContext() = default;
+
+void ImporterContext::clearParseState()
+{
+    // Swapping with empty containers gives their memory back, clear() would keep the bucket arrays.
+    StringMap<TensorOrWeights>{}.swap(mTensors);
+    StringMap<nvinfer1::TensorLocation>{}.swap(mTensorLocations);
+    StringMap<float>{}.swap(mTensorRangeMins);
+    StringMap<float>{}.swap(mTensorRangeMaxes);
+    StringMap<nvinfer1::DataType>{}.swap(mLayerPrecisions);
+    StringMap<nvinfer1::ITensor*>{}.swap(mUserInputs);
+    StringMap<nvinfer1::ITensor**>{}.swap(mUserOutputs);
+    // mTensorNames stays, the names of weights point into it.
+    mLayerNames.clear();
+    std::unordered_set<std::string>{}.swap(mUnsupportedShapeTensors);
+    StringMap<std::string>{}.swap(mLoopTensors);
+    StringMap<nvinfer1::IConstantLayer*>{}.swap(mConstantLayers);
+    std::unordered_multimap<uint64_t, ShapedWeights>{}.swap(mWeightsByContent);
+    std::unordered_map<void const*, char const*>{}.swap(mSharedWeightsNames);
+    std::unordered_multimap<void const*, std::pair<ShapedWeights, nvinfer1::IConstantLayer*>>{}.swap(
+        mConstantLayersByValues);
+    StringMap<::ONNX_NAMESPACE::TensorProto const*>{}.swap(mLazyInitializers);
+    std::unordered_map<ShapeOpKey, nvinfer1::ITensor*, ShapeOpKeyHash>{}.swap(mShapeTensors);
+    std::vector<StringMap<std::pair<bool, TensorOrWeights>>>{}.swap(mBaseNameScopeStack);
+}
+
+bool ImporterContext::mapExternalFile(std::string const& path, void*& data, size_t& size)
+{
+    std::lock_guard<std::mutex> lock(mTempWeightsMutex);
+    auto iter = mMappedFiles.find(path);
+    if (iter == mMappedFiles.end())
+    {
+        auto* ctx = this; // For logging
+        auto file = MappedFile::create(path);
+        if (!file)
+        {
+            LOG_ERROR("Failed to open file: " << path);
+            return false;
+        }
+        LOG_VERBOSE("Mapped external weights file: " << path << " (" << file->size() << " bytes)");
+        iter = mMappedFiles.emplace(path, std::move(file)).first;
+    }
+    data = iter->second->data();
+    size = iter->second->size();
+    return true;
+}
+
+void ImporterContext::prefetchExternalData(void const* data, size_t size)
+{
+    if (!data || size == 0)
+    {
+        return;
+    }
+#if !defined(_WIN32)
+    // madvise() needs a page-aligned start. MADV_WILLNEED schedules readahead of the range and returns right away.
+    static size_t const pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto const start = reinterpret_cast<uintptr_t>(data) / pageSize * pageSize;
+    auto const end = reinterpret_cast<uintptr_t>(data) + size;
+    if (madvise(reinterpret_cast<void*>(start), end - start, MADV_WILLNEED) != 0)
+    {
+        auto* ctx = this; // For logging
+        LOG_VERBOSE("Failed to prefetch " << size << " bytes of external weights.");
+    }
+#endif // !defined(_WIN32)
+}
+
 void ImporterContext::pushBaseNameScope()
 {
     mBaseNameScopeStack.push_back({});
@@ -81,6 +306,7 @@ void ImporterContext::registerTensor(TensorOrWeights tensor, std::string const&
             {
                 tensor.weights().setName(basename.c_str());
             }
+            tensor = deduplicateWeights(tensor.weights());
         }
     }
 
@@ -109,6 +335,101 @@ void ImporterContext::registerTensor(TensorOrWeights tensor, std::string const&
     p.first->second = std::move(tensor);
 }
 
+namespace
+{
+
+//! Hash of the type, shape and contents of weights. Mixes eight bytes at a time to keep up with multi-GB initializers.
+uint64_t hashWeights(ShapedWeights const& weights)
+{
+    constexpr uint64_t kPRIME{0x100000001b3ULL};
+    uint64_t hash{0xcbf29ce484222325ULL};
+    auto const mix = [&hash](uint64_t value) {
+        hash = (hash ^ value) * kPRIME;
+        hash ^= hash >> 32;
+    };
+    mix(static_cast<uint64_t>(weights.type));
+    for (int32_t i = 0; i < weights.shape.nbDims; ++i)
+    {
+        mix(static_cast<uint64_t>(weights.shape.d[i]));
+    }
+    auto const* bytes = static_cast<uint8_t const*>(weights.values);
+    size_t const size = weights.size_bytes();
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(word));
+        mix(word);
+    }
+    for (; i < size; ++i)
+    {
+        mix(bytes[i]);
+    }
+    return hash;
+}
+
+bool haveSameLayout(ShapedWeights const& a, ShapedWeights const& b)
+{
+    return a.type == b.type && a.shape.nbDims == b.shape.nbDims
+        && std::equal(a.shape.d, a.shape.d + a.shape.nbDims, b.shape.d);
+}
+
+} // namespace
+
+ShapedWeights ImporterContext::deduplicateWeights(ShapedWeights const& weights)
+{
+    if (!getFlag(nvonnxparser::OnnxParserFlag::kDEDUPLICATE_WEIGHTS) || !weights)
+    {
+        return weights;
+    }
+    uint64_t const hash = hashWeights(weights);
+    auto const range = mWeightsByContent.equal_range(hash);
+    for (auto iter = range.first; iter != range.second; ++iter)
+    {
+        ShapedWeights const& candidate = iter->second;
+        if (candidate.values == weights.values
+            || (haveSameLayout(candidate, weights)
+                && std::memcmp(candidate.values, weights.values, weights.size_bytes()) == 0))
+        {
+            auto* ctx = this; // For logging
+            LOG_VERBOSE("Weights " << (weights.getName() ? weights.getName() : "<unnamed>") << " are identical to "
+                                   << (candidate.getName() ? candidate.getName() : "<unnamed>")
+                                   << ", sharing their buffer.");
+            ShapedWeights shared = weights;
+            shared.values = candidate.values;
+            mSharedWeightsNames.emplace(candidate.values, candidate.getName());
+            return shared;
+        }
+    }
+    mWeightsByContent.emplace(hash, weights);
+    return weights;
+}
+
+nvinfer1::IConstantLayer* ImporterContext::getSharedConstantLayer(ShapedWeights const& weights) const
+{
+    if (!getFlag(nvonnxparser::OnnxParserFlag::kDEDUPLICATE_WEIGHTS) || !weights)
+    {
+        return nullptr;
+    }
+    auto const range = mConstantLayersByValues.equal_range(weights.values);
+    for (auto iter = range.first; iter != range.second; ++iter)
+    {
+        if (haveSameLayout(iter->second.first, weights))
+        {
+            return iter->second.second;
+        }
+    }
+    return nullptr;
+}
+
+void ImporterContext::addSharedConstantLayer(ShapedWeights const& weights, nvinfer1::IConstantLayer* layer)
+{
+    if (getFlag(nvonnxparser::OnnxParserFlag::kDEDUPLICATE_WEIGHTS) && weights)
+    {
+        mConstantLayersByValues.emplace(weights.values, std::make_pair(weights, layer));
+    }
+}
+
 void ImporterContext::registerLayer(nvinfer1::ILayer* layer, std::string const& basename, ::ONNX_NAMESPACE::NodeProto const* node)
 {
     // No layer will be added for Constant nodes in ONNX.
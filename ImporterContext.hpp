@@ -4,13 +4,23 @@
 
 #pragma once
 
+#include "ParseProfiler.hpp"
 #include "onnx2trt.hpp"
 #include "onnx2trt_utils.hpp"
 #include "onnxErrorRecorder.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace onnx2trt
 {
@@ -67,11 +77,114 @@ private:
     nvinfer1::IErrorRecorder* mUserErrorRecorder{nullptr};
 };
 
+//! Owner of the buffers backing temporary weights. Requests of up to kMAX_SMALL_SIZE bytes are bump-allocated out of
+//! shared pages, larger requests get a dedicated block. Nothing is freed individually: all buffers live until
+//! release() is called or the arena is destroyed.
+class WeightsArena
+{
+public:
+    //! Return a buffer of size bytes filled with value, or nullptr if size is 0.
+    void* allocate(size_t size, uint8_t value);
+
+    //! Free every buffer handed out so far.
+    void release();
+
+    //! Total number of bytes currently reserved by the arena, including unused space at the end of pages.
+    size_t getReservedBytes() const
+    {
+        return mReservedBytes;
+    }
+
+    //! Number of bytes handed out by allocate().
+    size_t getAllocatedBytes() const
+    {
+        return mAllocatedBytes;
+    }
+
+private:
+    static constexpr size_t kPAGE_SIZE{size_t{1} << 20};
+    static constexpr size_t kMAX_SMALL_SIZE{kPAGE_SIZE / 8};
+    static constexpr size_t kALIGNMENT{alignof(std::max_align_t)};
+
+    std::vector<std::unique_ptr<uint8_t[]>> mBlocks;
+    uint8_t* mPageCursor{nullptr};
+    size_t mPageRemaining{0};
+    size_t mReservedBytes{0};
+    size_t mAllocatedBytes{0};
+};
+
+//! Interned set of names. Every distinct name is stored once and identified by a dense ID in insertion order.
+//! References to stored names stay valid until the table is cleared, so their c_str() can be handed to TensorRT.
+class SymbolTable
+{
+public:
+    //! Add name if it is not in the table yet. Returns its ID and whether it was added.
+    std::pair<uint32_t, bool> intern(std::string const& name)
+    {
+        auto const iter = mIds.find(name);
+        if (iter != mIds.end())
+        {
+            return {iter->second, false};
+        }
+        uint32_t const id = static_cast<uint32_t>(mNames.size());
+        mNames.push_back(name);
+        mIds.emplace(mNames.back(), id);
+        return {id, true};
+    }
+
+    bool contains(std::string const& name) const
+    {
+        return mIds.count(name) != 0;
+    }
+
+    std::string const& name(uint32_t id) const
+    {
+        return mNames[id];
+    }
+
+    size_t size() const
+    {
+        return mNames.size();
+    }
+
+    void clear()
+    {
+        std::unordered_map<std::string_view, uint32_t>{}.swap(mIds);
+        std::deque<std::string>{}.swap(mNames);
+    }
+
+private:
+    std::deque<std::string> mNames; // Stable storage, indexed by ID
+    std::unordered_map<std::string_view, uint32_t> mIds; // Views into mNames
+};
+
+//! Description of a shape computation done by the ShapeTensor helpers: the operation followed by its operands, see
+//! ShapeTensor.cpp.
+using ShapeOpKey = std::vector<int64_t>;
+
+struct ShapeOpKeyHash
+{
+    size_t operator()(ShapeOpKey const& key) const noexcept
+    {
+        size_t hash = key.size();
+        for (int64_t const v : key)
+        {
+            hash ^= std::hash<int64_t>{}(v) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+        }
+        return hash;
+    }
+};
+
+//! A file mapped into memory copy-on-write, so importers that modify weights in place never touch the file on disk.
+class MappedFile;
+
 class ImporterContext final : public IImporterContext
 {
     nvinfer1::INetworkDefinition* mNetwork;
     nvinfer1::ILogger* mLogger;
-    std::list<std::vector<uint8_t>> mTempBufs;
+    nvinfer1::ILogger::Severity mLoggerSeverity{nvinfer1::ILogger::Severity::kVERBOSE};
+    WeightsArena mTempWeights; // Storage of all weights created by createTempWeights().
+    std::mutex mTempWeightsMutex; // Guards mTempWeights and mMappedFiles, which initializer import may use from several threads.
     StringMap<nvinfer1::ITensor*> mUserInputs;
     StringMap<nvinfer1::ITensor**> mUserOutputs;
     StringMap<int64_t> mOpsets;
@@ -80,19 +193,29 @@ class ImporterContext final : public IImporterContext
     StringMap<float> mTensorRangeMins;
     StringMap<float> mTensorRangeMaxes;
     StringMap<nvinfer1::DataType> mLayerPrecisions;
-    std::set<std::string> mTensorNames; // Keep track of how many times a tensor name shows up, to avoid duplicate naming in TRT.
-    std::set<std::string> mLayerNames; // Keep track of how many times a tensor name shows up, to avoid duplicate naming in TRT.
+    SymbolTable mTensorNames; // Keep track of how many times a tensor name shows up, to avoid duplicate naming in TRT.
+    SymbolTable mLayerNames; // Keep track of how many times a tensor name shows up, to avoid duplicate naming in TRT.
     int64_t mSuffixCounter{0}; // increasing suffix counter used to uniquify layer names.
     std::unordered_set<std::string> mUnsupportedShapeTensors; // Container to hold output tensor names of layers that produce shape tensor outputs but do not natively support them.
     StringMap<std::string> mLoopTensors; // Container to map subgraph tensors to their original outer graph names.
     std::string mOnnxFileLocation;       // Keep track of the directory of the parsed ONNX file
     std::unique_ptr<ErrorRecorderWrapper> mErrorWrapper; // error recorder to control TRT errors
     StringMap<nvinfer1::IConstantLayer*> mConstantLayers;
-    bool mConvertINT64Logged{false};
-    bool mConvertINT64OutOfBoundsLogged{false};
-    bool mConvertDoubleLogged{false};
-    bool mConvertDoubleOutOfBoundsLogged{false};
+    StringMap<std::unique_ptr<MappedFile>> mMappedFiles; // External weight files, mapped once per path.
+    std::unordered_multimap<uint64_t, ShapedWeights> mWeightsByContent; // Content hash index for kDEDUPLICATE_WEIGHTS.
+    std::unordered_multimap<void const*, std::pair<ShapedWeights, nvinfer1::IConstantLayer*>>
+        mConstantLayersByValues; // Constant layers of deduplicated weights, keyed by their buffer.
+    std::unordered_map<void const*, char const*> mSharedWeightsNames; // Name of the first weights of shared buffers.
+    StringMap<::ONNX_NAMESPACE::TensorProto const*> mLazyInitializers; // Initializers not converted yet, see kLAZY_INITIALIZER_IMPORT.
+    std::unordered_map<ShapeOpKey, nvinfer1::ITensor*, ShapeOpKeyHash> mShapeTensors; // Results of shape computations.
+    static inline thread_local int64_t* tDeferredTempWeightsNames{nullptr}; // See DeferTempWeightsNames.
+    std::atomic<bool> mConvertINT64Logged{false};
+    std::atomic<bool> mConvertINT64OutOfBoundsLogged{false};
+    std::atomic<bool> mConvertDoubleLogged{false};
+    std::atomic<bool> mConvertDoubleOutOfBoundsLogged{false};
     nvonnxparser::OnnxParserFlags mOnnxParserFlags; // OnnxParserFlags specified by the parser
+    ParseProfiler mProfiler; // Timings of the current parse, reported by IParser::getParseProfile().
+    std::vector<Status>* mNodeErrors{nullptr}; // Collects the failures of main graph nodes, see nodeErrors().
 
     // Logical library names for VC plugin libraries.  This gets translated to library paths
     // when getUsedVCPluginLibraries() is called.
@@ -120,6 +243,7 @@ public:
         , mErrorWrapper(std::make_unique<ErrorRecorderWrapper>(mNetwork, logger))
     {
     }
+    ~ImporterContext();
     nvinfer1::INetworkDefinition* network() override
     {
         return mNetwork;
@@ -177,16 +301,150 @@ public:
         return *mLogger;
     }
 
+    nvinfer1::ILogger::Severity getLoggerSeverity() const override
+    {
+        return mLoggerSeverity;
+    }
+
+    //! Set the least severe message to format and pass to the logger. Defaults to kVERBOSE, which logs everything.
+    void setLoggerSeverity(nvinfer1::ILogger::Severity severity)
+    {
+        mLoggerSeverity = severity;
+    }
+
     ShapedWeights createTempWeights(ShapedWeights::DataType type, nvinfer1::Dims shape, uint8_t value = 0) override
     {
-        std::string const& name = generateUniqueName(mTensorNames, "tmp_weight");
+        std::lock_guard<std::mutex> lock(mTempWeightsMutex);
         ShapedWeights weights(type, nullptr, shape);
-        weights.setName(name.c_str());
-        mTempBufs.push_back(std::vector<uint8_t>(weights.size_bytes(), value));
-        weights.values = mTempBufs.back().data();
+        if (tDeferredTempWeightsNames)
+        {
+            ++*tDeferredTempWeightsNames;
+        }
+        else
+        {
+            weights.setName(generateUniqueName(mTensorNames, "tmp_weight").c_str());
+        }
+        weights.values = mTempWeights.allocate(weights.size_bytes(), value);
         return weights;
     }
 
+    //! While alive, temporary weights created by the calling thread are left unnamed and counted in count instead.
+    //! Parallel initializer import uses this so that worker scheduling does not decide the generated names; the
+    //! names are reserved afterwards in graph order with reserveTempWeightsNames().
+    class DeferTempWeightsNames
+    {
+    public:
+        explicit DeferTempWeightsNames(int64_t& count)
+            : mPrevious(tDeferredTempWeightsNames)
+        {
+            tDeferredTempWeightsNames = &count;
+        }
+        ~DeferTempWeightsNames()
+        {
+            tDeferredTempWeightsNames = mPrevious;
+        }
+        DeferTempWeightsNames(DeferTempWeightsNames const&) = delete;
+        DeferTempWeightsNames& operator=(DeferTempWeightsNames const&) = delete;
+
+    private:
+        int64_t* mPrevious;
+    };
+
+    //! Generate the names of count temporary weights whose naming was deferred, as createTempWeights() would have.
+    void reserveTempWeightsNames(int64_t count)
+    {
+        std::lock_guard<std::mutex> lock(mTempWeightsMutex);
+        for (int64_t i = 0; i < count; ++i)
+        {
+            generateUniqueName(mTensorNames, "tmp_weight");
+        }
+    }
+
+    //! Number of bytes reserved for temporary weights.
+    size_t getTempWeightsBytes() const
+    {
+        return mTempWeights.getReservedBytes();
+    }
+
+    //! Number of bytes handed out for temporary weights so far. Used to attribute allocations to parse phases.
+    size_t getTempWeightsAllocatedBytes() const
+    {
+        return mTempWeights.getAllocatedBytes();
+    }
+
+    ParseProfiler& profiler()
+    {
+        return mProfiler;
+    }
+    ParseProfiler const& profiler() const
+    {
+        return mProfiler;
+    }
+
+    //! Free the storage of all temporary weights. Only safe once nothing refers to them anymore, e.g. after the
+    //! engine has been built from the network.
+    void releaseTempWeights()
+    {
+        std::lock_guard<std::mutex> lock(mTempWeightsMutex);
+        mTempWeights.release();
+    }
+
+    //! Unmap all external weights files. Same constraints as releaseTempWeights().
+    void releaseMappedFiles()
+    {
+        std::lock_guard<std::mutex> lock(mTempWeightsMutex);
+        mMappedFiles.clear();
+    }
+
+    //! Drop the tables only needed while importing: tensors, layer names, constant layers and the weight indices.
+    //! Weights and the network are left untouched.
+    void clearParseState();
+
+    bool mapExternalFile(std::string const& path, void*& data, size_t& size) override;
+    void prefetchExternalData(void const* data, size_t size) override;
+
+    //! Initializers of the main graph registered by name under kLAZY_INITIALIZER_IMPORT and not yet converted. The
+    //! protos are owned by the parsed model.
+    StringMap<::ONNX_NAMESPACE::TensorProto const*>& lazyInitializers()
+    {
+        return mLazyInitializers;
+    }
+
+    //! Tensor computed earlier by the shape computation described by key, or null.
+    nvinfer1::ITensor* findShapeTensor(ShapeOpKey const& key) const
+    {
+        auto const iter = mShapeTensors.find(key);
+        return iter == mShapeTensors.end() ? nullptr : iter->second;
+    }
+
+    //! Remember the result of the shape computation described by key. Results computed in a subgraph are not kept,
+    //! their layers belong to the subgraph's loop or conditional and cannot be used from the enclosing graph.
+    void addShapeTensor(ShapeOpKey key, nvinfer1::ITensor* tensor)
+    {
+        if (!isInSubgraph())
+        {
+            mShapeTensors.emplace(std::move(key), tensor);
+        }
+    }
+
+    //! Set where parseGraph() records the errors of main graph nodes. While set, a failing node does not end the
+    //! parse, the nodes that depend on it are skipped and the others are still imported. Used by supportsModel() to
+    //! find every unsupported node in one pass.
+    void setNodeErrors(std::vector<Status>* nodeErrors)
+    {
+        mNodeErrors = nodeErrors;
+    }
+    std::vector<Status>* nodeErrors() const
+    {
+        return mNodeErrors;
+    }
+
+    //! Whether names are currently registered into the scope of a subgraph rather than the main graph.
+    bool isInSubgraph() const
+    {
+        return !mBaseNameScopeStack.empty();
+    }
+
     bool setUserInput(const char* name, nvinfer1::ITensor* input)
     {
         mUserInputs[name] = input;
@@ -283,59 +541,81 @@ public:
     {
         return mOnnxParserFlags;
     }
+    bool getFlag(nvonnxparser::OnnxParserFlag onnxParserFlag) const
+    {
+        return mOnnxParserFlags & (1U << static_cast<uint32_t>(onnxParserFlag));
+    }
+
+    //! With kDEDUPLICATE_WEIGHTS, return weights that alias an earlier registered buffer with identical type, shape
+    //! and contents, keeping the name of the given weights. Otherwise, or if there is no such buffer, return weights.
+    ShapedWeights deduplicateWeights(ShapedWeights const& weights);
+
+    //! Return the name the network knows the buffer of weights by: the name of the first weights that
+    //! deduplicateWeights() made other weights share it with, or else name.
+    char const* getSharedWeightsName(void const* values, char const* name) const
+    {
+        auto const iter = mSharedWeightsNames.find(values);
+        return iter == mSharedWeightsNames.end() ? name : iter->second;
+    }
+
+    //! Return the constant layer created for deduplicated weights with the same buffer, type and shape, if any.
+    nvinfer1::IConstantLayer* getSharedConstantLayer(ShapedWeights const& weights) const;
+
+    //! Remember the constant layer created for the given weights so that weights sharing its buffer can reuse it.
+    void addSharedConstantLayer(ShapedWeights const& weights, nvinfer1::IConstantLayer* layer);
 
     virtual void addUsedVCPluginLibrary(
         ::ONNX_NAMESPACE::NodeProto const& node, char const* pluginName, char const* pluginLib) final;
 
     virtual std::vector<std::string> getUsedVCPluginLibraries() final;
 
+    //! The setters of the log-once flags below return the previous value, so that of several threads converting
+    //! weights at once exactly one sees false and logs.
     bool isConvertINT64Logged()
     {
         return mConvertINT64Logged;
     }
-    void setConvertINT64Logged(bool logged)
+    bool setConvertINT64Logged(bool logged)
     {
-        mConvertINT64Logged = logged;
+        return mConvertINT64Logged.exchange(logged);
     }
     bool isConvertINT64OutOfBoundsLogged()
     {
         return mConvertINT64OutOfBoundsLogged;
     }
-    void setConvertINT64OutOfBoundsLogged(bool logged)
+    bool setConvertINT64OutOfBoundsLogged(bool logged)
     {
-        mConvertINT64OutOfBoundsLogged = logged;
+        return mConvertINT64OutOfBoundsLogged.exchange(logged);
     }
     bool isConvertDoubleLogged()
     {
         return mConvertDoubleLogged;
     }
-    void setConvertDoubleLogged(bool logged)
+    bool setConvertDoubleLogged(bool logged)
     {
-        mConvertDoubleLogged = logged;
+        return mConvertDoubleLogged.exchange(logged);
     }
     bool isConvertDoubleOutOfBoundsLogged()
     {
         return mConvertDoubleOutOfBoundsLogged;
     }
-    void setConvertDoubleOutOfBoundsLogged(bool logged)
+    bool setConvertDoubleOutOfBoundsLogged(bool logged)
     {
-        mConvertDoubleOutOfBoundsLogged = logged;
+        return mConvertDoubleOutOfBoundsLogged.exchange(logged);
     }
 
 private:
-    std::string const& generateUniqueName(std::set<std::string>& namesSet, const std::string& basename)
+    std::string const& generateUniqueName(SymbolTable& namesSet, const std::string& basename)
     {
-        std::string candidate = basename;
-
-        while (namesSet.find(candidate) != namesSet.end())
+        // The common case of a fresh name costs a single lookup.
+        auto interned = namesSet.intern(basename);
+        while (!interned.second)
         {
-            candidate = basename + "_" + std::to_string(mSuffixCounter);
+            interned = namesSet.intern(basename + "_" + std::to_string(mSuffixCounter));
             ++mSuffixCounter;
         }
-
-        namesSet.insert(candidate);
-        // Return reference to newly inserted string to avoid any c_str()'s going out of scope
-        return *namesSet.find(candidate);
+        // Return reference to the interned string to avoid any c_str()'s going out of scope
+        return namesSet.name(interned.first);
     }
 };
 
@@ -3,7 +3,10 @@
  */
 
 #include "ModelImporter.hpp"
+#include "ConstantFolding.hpp"
 #include "OnnxAttrs.hpp"
+#include "ParsedSnapshot.hpp"
+#include "PatternFusion.hpp"
 #include "onnx2trt_utils.hpp"
 #include "onnx_utils.hpp"
 #include "toposort.hpp"
@@ -12,8 +15,12 @@
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/text_format.h>
 
+#include <algorithm>
+#include <atomic>
 #include <limits>
 #include <functional>
+#include <mutex>
+#include <thread>
 #include <unordered_set>
 #include <sys/stat.h>
 
@@ -31,15 +38,35 @@ class ProtobufShutter {
 
 static ProtobufShutter protobufShutter;
 
-// Helper for deserializing INetwork
-Status setTensorLocations(
-    IImporterContext* ctx, std::vector<std::string> const& tensors, std::vector<std::string> const& locations)
+// Helper class to restrict the messages formatted by the importer to a given severity for the duration of a call.
+class LoggerSeverityScope
 {
-    ASSERT( (tensors.size() >= locations.size()) && "The size of tensors misaligns with the size of the attribute trt_outputs_loc.", nvonnxparser::ErrorCode::kINVALID_GRAPH);
-    for (size_t i = 0; i < locations.size(); ++i)
+public:
+    LoggerSeverityScope(ImporterContext& context, nvinfer1::ILogger::Severity severity)
+        : mContext(context)
+        , mSavedSeverity(context.getLoggerSeverity())
     {
-        std::string tensor = tensors.at(i);
-        std::string location = locations.at(i);
+        mContext.setLoggerSeverity(severity);
+    }
+    ~LoggerSeverityScope()
+    {
+        mContext.setLoggerSeverity(mSavedSeverity);
+    }
+
+private:
+    ImporterContext& mContext;
+    nvinfer1::ILogger::Severity mSavedSeverity;
+};
+
+// Helper for deserializing INetwork. Names and Locations are vectors or protobuf repeated fields of strings.
+template <typename Names, typename Locations>
+Status setTensorLocations(IImporterContext* ctx, Names const& tensors, Locations const& locations)
+{
+    ASSERT( (static_cast<int64_t>(tensors.size()) >= static_cast<int64_t>(locations.size())) && "The size of tensors misaligns with the size of the attribute trt_outputs_loc.", nvonnxparser::ErrorCode::kINVALID_GRAPH);
+    for (int32_t i = 0; i < static_cast<int32_t>(locations.size()); ++i)
+    {
+        std::string const& tensor = tensors[i];
+        std::string const& location = locations[i];
         nvinfer1::TensorLocation loc
             = location == "device" ? nvinfer1::TensorLocation::kDEVICE : nvinfer1::TensorLocation::kHOST;
 
@@ -56,18 +83,17 @@ Status setTensorLocations(
     return Status::success();
 }
 
-// Helper for deserializing INetwork
-template <typename T>
-Status setStringMap(
-    IImporterContext* ctx, std::vector<std::string> const& tensors, std::vector<T> const& data, string_map<T>& map)
+// Helper for deserializing INetwork. Names and Values are vectors or protobuf repeated fields.
+template <typename T, typename Names, typename Values>
+Status setStringMap(IImporterContext* ctx, Names const& tensors, Values const& data, string_map<T>& map)
 {
-    ASSERT((tensors.size() >= data.size())
+    ASSERT((static_cast<int64_t>(tensors.size()) >= static_cast<int64_t>(data.size()))
             && "The size of tensors misaligns with the size of the attribute trt_outputs_range_min/max.",
         nvonnxparser::ErrorCode::kINVALID_GRAPH);
-    for (size_t i = 0; i < data.size(); ++i)
+    for (int32_t i = 0; i < static_cast<int32_t>(data.size()); ++i)
     {
-        std::string name = tensors.at(i);
-        T dataName = data.at(i);
+        std::string const& name = tensors[i];
+        T dataName = data[i];
         if (map.count(name) > 0)
         {
             ASSERT( (map[name] == dataName) && "The order of tensorRangeMin/Max in context misaligns with the order of the attribute trt_outputs_range_min/max.", nvonnxparser::ErrorCode::kINVALID_GRAPH);
@@ -105,155 +131,407 @@ static std::string makeErrorExplanation(std::exception const& e, std::string con
     return result.str();
 }
 
-Status parseGraph(
-    IImporterContext* ctx, ::ONNX_NAMESPACE::GraphProto const& graph, bool deserializingINetwork, int* currentNode)
+//! Import the initializers of a graph. With kPARALLEL_INITIALIZER_IMPORT the conversions run on a pool of threads,
+//! but naming the temporary weights of the conversions and registration always happen afterwards in graph order, so
+//! that the generated names are the same as with a sequential import.
+static Status importInitializers(IImporterContext* ctx, ::ONNX_NAMESPACE::GraphProto const& graph)
 {
-    // Import initializers.
-    for (::ONNX_NAMESPACE::TensorProto const& initializer : graph.initializer())
+    auto const& initializers = graph.initializer();
+    int32_t const nbInitializers = initializers.size();
+    auto* ctxImpl = static_cast<ImporterContext*>(ctx);
+    if (ctxImpl->getFlag(nvonnxparser::OnnxParserFlag::kLAZY_INITIALIZER_IMPORT) && !ctxImpl->isInSubgraph())
     {
-        LOG_VERBOSE("Importing initializer: " << initializer.name());
-        ShapedWeights weights;
-        ASSERT(convertOnnxWeights(initializer, &weights, ctx) && "Failed to import initializer.", ErrorCode::kUNSUPPORTED_NODE);
-        ctx->registerTensor(TensorOrWeights{std::move(weights)}, initializer.name());
+        auto& lazyInitializers = ctxImpl->lazyInitializers();
+        lazyInitializers.reserve(nbInitializers);
+        for (::ONNX_NAMESPACE::TensorProto const& initializer : initializers)
+        {
+            lazyInitializers.emplace(initializer.name(), &initializer);
+        }
+        LOG_VERBOSE("Deferred the import of " << nbInitializers << " initializers to their first use");
+        return Status::success();
+    }
+    uint32_t const parallelFlag
+        = 1U << static_cast<uint32_t>(nvonnxparser::OnnxParserFlag::kPARALLEL_INITIALIZER_IMPORT);
+    size_t nbThreads{1};
+    if (ctx->getFlags() & parallelFlag)
+    {
+        nbThreads = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1U), nbInitializers);
     }
 
-    std::vector<size_t> topoOrder;
-    ASSERT(toposort(graph.node(), &topoOrder) && "Failed to sort the model topologically.", ErrorCode::kINVALID_GRAPH);
+    if (nbThreads <= 1)
+    {
+        for (::ONNX_NAMESPACE::TensorProto const& initializer : initializers)
+        {
+            LOG_VERBOSE("Importing initializer: " << initializer.name());
+            ShapedWeights weights;
+            ASSERT(convertOnnxWeights(initializer, &weights, ctx) && "Failed to import initializer.", ErrorCode::kUNSUPPORTED_NODE);
+            ctx->registerTensor(TensorOrWeights{std::move(weights)}, initializer.name());
+        }
+        return Status::success();
+    }
 
-    string_map<NodeImporter> const& opImporters = getBuiltinOpImporterMap();
-    for (auto const& nodeIndex : topoOrder)
+    LOG_VERBOSE("Converting " << nbInitializers << " initializers on " << nbThreads << " threads");
+    std::vector<ShapedWeights> weights(nbInitializers);
+    std::vector<uint8_t> converted(nbInitializers, 0);
+    std::vector<int64_t> nbTempWeights(nbInitializers, 0);
+    std::atomic<int32_t> nextInitializer{0};
+    auto worker = [&]() {
+        for (int32_t i = nextInitializer++; i < nbInitializers; i = nextInitializer++)
+        {
+            try
+            {
+                ImporterContext::DeferTempWeightsNames const deferNames(nbTempWeights[i]);
+                converted[i] = convertOnnxWeights(initializers.Get(i), &weights[i], ctx);
+            }
+            catch (std::exception const& e)
+            {
+                LOG_ERROR("Failed to import initializer " << initializers.Get(i).name() << ": " << e.what());
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(nbThreads - 1);
+    for (size_t i = 1; i < nbThreads; ++i)
     {
-        if (currentNode)
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers)
+    {
+        thread.join();
+    }
+
+    for (int32_t i = 0; i < nbInitializers; ++i)
+    {
+        LOG_VERBOSE("Importing initializer: " << initializers.Get(i).name());
+        ASSERT(converted[i] && "Failed to import initializer.", ErrorCode::kUNSUPPORTED_NODE);
+        ctxImpl->reserveTempWeightsNames(nbTempWeights[i]);
+        ctx->registerTensor(TensorOrWeights{std::move(weights[i])}, initializers.Get(i).name());
+    }
+    return Status::success();
+}
+
+//! Convert and register a lazily imported initializer, if name refers to one that has not been used yet.
+static Status importLazyInitializer(ImporterContext* ctx, std::string const& name)
+{
+    auto& lazyInitializers = ctx->lazyInitializers();
+    auto const iter = lazyInitializers.find(name);
+    if (iter == lazyInitializers.end())
+    {
+        return Status::success();
+    }
+    ::ONNX_NAMESPACE::TensorProto const& initializer = *iter->second;
+    lazyInitializers.erase(iter);
+    LOG_VERBOSE("Importing initializer: " << initializer.name());
+    ShapedWeights weights;
+    ASSERT(convertOnnxWeights(initializer, &weights, ctx) && "Failed to import initializer.", ErrorCode::kUNSUPPORTED_NODE);
+    ctx->registerTensor(TensorOrWeights{std::move(weights)}, initializer.name());
+    return Status::success();
+}
+
+//! Import the lazily imported initializers read by a node of the main graph, including those read from the outer
+//! scope by the nodes of its subgraphs. They are registered before any subgraph scope is entered, so they keep their
+//! names and stay visible to the rest of the main graph.
+static Status importLazyInitializers(ImporterContext* ctx, ::ONNX_NAMESPACE::NodeProto const& node)
+{
+    for (auto const& inputName : node.input())
+    {
+        CHECK(importLazyInitializer(ctx, inputName));
+    }
+    auto const importSubgraph = [ctx](::ONNX_NAMESPACE::GraphProto const& subgraph) -> Status {
+        for (auto const& subgraphNode : subgraph.node())
         {
-            *currentNode = nodeIndex;
+            CHECK(importLazyInitializers(ctx, subgraphNode));
+        }
+        for (auto const& output : subgraph.output())
+        {
+            CHECK(importLazyInitializer(ctx, output.name()));
+        }
+        return Status::success();
+    };
+    for (auto const& attribute : node.attribute())
+    {
+        if (attribute.has_g())
+        {
+            CHECK(importSubgraph(attribute.g()));
+        }
+        for (auto const& subgraph : attribute.graphs())
+        {
+            CHECK(importSubgraph(subgraph));
         }
-        auto const& node = graph.node(nodeIndex);
-        std::string const& nodeName = getNodeName(node);
-        LOG_VERBOSE("Parsing node: " << nodeName << " [" << node.op_type() << "]");
+    }
+    return Status::success();
+}
 
-        // Assemble node inputs. These may come from outside the subgraph.
-        std::vector<TensorOrWeights> nodeInputs;
-        std::ostringstream ssInputs{};
+//! Import a single node of graph into the network.
+static Status parseNode(IImporterContext* ctx, ::ONNX_NAMESPACE::GraphProto const& graph,
+    ::ONNX_NAMESPACE::NodeProto const& node, bool deserializingINetwork, bool verbose)
+{
+    auto* ctxImpl = static_cast<ImporterContext*>(ctx);
+    ParseProfiler& profiler = ctxImpl->profiler();
+    std::string const& nodeName = getNodeName(node);
+    LOG_VERBOSE("Parsing node: " << nodeName << " [" << node.op_type() << "]");
+    if (!ctxImpl->lazyInitializers().empty() && !ctxImpl->isInSubgraph())
+    {
+        CHECK(importLazyInitializers(ctxImpl, node));
+    }
+
+    // Assemble node inputs. These may come from outside the subgraph.
+    std::vector<TensorOrWeights> nodeInputs;
+    nodeInputs.reserve(node.input().size());
+    std::ostringstream ssInputs{};
+    if (verbose)
+    {
         ssInputs << nodeName << " [" << node.op_type() << "] inputs: ";
-        for (auto const& inputName : node.input())
+    }
+    for (auto const& inputName : node.input())
+    {
+        // Empty input names indicate optional inputs which have not been supplied.
+        if (inputName.empty())
         {
-            // Empty input names indicate optional inputs which have not been supplied.
-            if (inputName.empty())
+            // Push back null input as place holder.
+            nodeInputs.emplace_back(nullptr);
+            if (verbose)
             {
-                // Push back null input as place holder.
-                nodeInputs.emplace_back(nullptr);
                 ssInputs << "[optional input, not set], ";
             }
-            else
+        }
+        else
+        {
+            LOG_VERBOSE("Searching for input: " << inputName);
+            auto const tensor = ctx->tensors().find(inputName);
+            ASSERT((tensor != ctx->tensors().end()) && "Node input was not registered.", ErrorCode::kINVALID_GRAPH);
+            nodeInputs.push_back(tensor->second);
+            if (verbose)
             {
-                LOG_VERBOSE("Searching for input: " << inputName);
-                ASSERT( (ctx->tensors().count(inputName)) && "Node input was not registered.", ErrorCode::kINVALID_GRAPH);
-                nodeInputs.push_back(ctx->tensors().at(inputName));
                 ssInputs << "[" << inputName << " -> " << nodeInputs.back().shape() << "["
                          << nodeInputs.back().getType() << "]"
                          << "], ";
             }
         }
-        LOG_VERBOSE(ssInputs.str());
+    }
+    LOG_VERBOSE(ssInputs.str());
+
+    // Dispatch to appropriate converter.
+    BuiltinOpImporters const& opImporters = getBuiltinOpImporters();
+    NodeImportFunction importFunc = opImporters.getFallbackImporter();
+    int32_t const opId = opImporters.getId(node.op_type());
+    if (opId != BuiltinOpImporters::kINVALID_ID)
+    {
+        importFunc = opImporters.getImporter(opId);
+    }
+    else
+    {
+        LOG_INFO("No importer registered for op: " << node.op_type() << ". Attempting to import as plugin.");
+    }
+    std::vector<TensorOrWeights> outputs;
 
-        // Dispatch to appropriate converter.
-        NodeImporter const* importFunc{nullptr};
-        if (opImporters.count(node.op_type()))
+    auto const nodeStart = ParseProfiler::Clock::now();
+    size_t const nodeBytes = ctxImpl->getTempWeightsAllocatedBytes();
+    try
+    {
+        // Nodes that only compute on weights are evaluated here instead of being added to the network. Models
+        // serialized by TensorRT are imported as is, so that their layers keep the precisions stored for them.
+        if (!deserializingINetwork && ctxImpl->getFlag(nvonnxparser::OnnxParserFlag::kFOLD_CONSTANT_NODES)
+            && foldConstantNode(ctx, node, nodeInputs, outputs))
         {
-            importFunc = &opImporters.at(node.op_type());
+            LOG_VERBOSE("Folded node: " << nodeName << " [" << node.op_type() << "] into weights.");
         }
         else
         {
-            LOG_INFO("No importer registered for op: " << node.op_type() << ". Attempting to import as plugin.");
-            importFunc = &opImporters.at("FallbackPluginImporter");
+            GET_VALUE(importFunc(ctx, node, nodeInputs), &outputs);
+        }
+    }
+    catch (std::exception const& e)
+    {
+        return MAKE_ERROR(makeErrorExplanation(e, nodeName), ErrorCode::kINVALID_NODE);
+    }
+    profiler.addNode(node.op_type(), nodeStart, ctxImpl->getTempWeightsAllocatedBytes() - nodeBytes);
+    if (ctx->hasError())
+    {
+        return MAKE_ERROR(makeErrorExplanation(ctx, nodeName), ErrorCode::kINVALID_NODE);
+    }
+
+    for (auto const& output : outputs)
+    {
+        if (output.is_tensor())
+        {
+            // check that we can resolve output dims
+            // in the future we may have a network/layer.validate() which will help with that as well
+            output.tensor().getDimensions();
+
+            if (ctx->hasError())
+            {
+                return MAKE_ERROR(makeErrorExplanation(ctx, nodeName), ErrorCode::kINVALID_NODE);
+            }
         }
-        std::vector<TensorOrWeights> outputs;
+    }
 
-        try
+    if (deserializingINetwork)
+    {
+        OnnxAttrs attrs(node, ctx);
+
+        // Tensor locations, dynamic ranges and layer precisions will be set after parsing the network. The attribute
+        // values are read in place.
+        if (attrs.count("trt_outputs_loc"))
         {
-            GET_VALUE((*importFunc)(ctx, node, nodeInputs), &outputs);
+            CHECK(setTensorLocations(ctx, node.output(), attrs.strings("trt_outputs_loc")));
         }
-        catch (std::exception const& e)
+        if (attrs.count("trt_outputs_range_min"))
         {
-            return MAKE_ERROR(makeErrorExplanation(e, nodeName), ErrorCode::kINVALID_NODE);
+            CHECK(setStringMap<float>(
+                ctx, node.output(), attrs.floats("trt_outputs_range_min"), ctx->tensorRangeMins()));
         }
-        if (ctx->hasError())
+        if (attrs.count("trt_outputs_range_max"))
         {
-            return MAKE_ERROR(makeErrorExplanation(ctx, nodeName), ErrorCode::kINVALID_NODE);
+            CHECK(setStringMap<float>(
+                ctx, node.output(), attrs.floats("trt_outputs_range_max"), ctx->tensorRangeMaxes()));
         }
 
-        for (auto const& output : outputs)
+        if (attrs.count("trt_layer_precision"))
         {
-            if (output.is_tensor())
-            {
-                // check that we can resolve output dims
-                // in the future we may have a network/layer.validate() which will help with that as well
-                output.tensor().getDimensions();
+            std::vector<std::string> layerName{nodeName};
+            std::vector<nvinfer1::DataType> layerPrecision{attrs.get<nvinfer1::DataType>("trt_layer_precision")};
+            CHECK(setStringMap<nvinfer1::DataType>(ctx, layerName, layerPrecision, ctx->layerPrecisions()));
+        }
+    }
 
-                if (ctx->hasError())
+    ASSERT((node.output().size() <= static_cast<int32_t>(outputs.size()))
+            && "Node has more output tensors than TRT expected.",
+        ErrorCode::kINVALID_GRAPH);
+
+    // Set output names and register outputs with the context.
+    std::ostringstream ssOutputs{};
+    if (verbose)
+    {
+        ssOutputs << nodeName << " [" << node.op_type() << "] outputs: ";
+    }
+    for (int32_t i = 0; i < node.output().size(); ++i)
+    {
+        auto const& outputName = node.output(i);
+        auto& output = outputs.at(i);
+        if (verbose)
+        {
+            ssOutputs << "[" << outputName << " -> " << output.shape() << "[" << output.getType() << "]"
+                      << "], ";
+        }
+        // Note: This condition is to allow ONNX outputs to be ignored
+        // Always register output weights (even empty ones) as it may be mapped to an unused input
+        if ((output || output.is_weights()) && !outputName.empty())
+        {
+            ctx->registerTensor(std::move(output), outputName);
+        }
+        // UINT8 is only allowed as network inputs and outputs. Therefore any node that produces an UINT8-typed
+        // output that is not also a graph output is unsupported.
+        if (output.getType() == "UINT8")
+        {
+            bool legalUINT8 = false;
+            for (auto const& graphOutput : graph.output())
+            {
+                if (graphOutput.name() == outputName)
                 {
-                    return MAKE_ERROR(makeErrorExplanation(ctx, nodeName), ErrorCode::kINVALID_NODE);
+                    legalUINT8 = true;
                 }
             }
+            ASSERT(legalUINT8 && "TensorRT does not support UINT8 types for intermediate tensors!", ErrorCode::kUNSUPPORTED_NODE);
         }
+    }
+    LOG_VERBOSE(ssOutputs.str());
+    return Status::success();
+}
 
-        if (deserializingINetwork)
-        {
-            OnnxAttrs attrs(node, ctx);
+Status parseGraph(IImporterContext* ctx, ::ONNX_NAMESPACE::GraphProto const& graph, bool deserializingINetwork,
+    int* currentNode, std::vector<size_t>* topologicalOrder)
+{
+    auto* ctxImpl = static_cast<ImporterContext*>(ctx);
+    ParseProfiler& profiler = ctxImpl->profiler();
+    // The phases of subgraphs are part of the time of the node that owns them, and are not recorded again.
+    bool const recordPhases = !ctxImpl->isInSubgraph();
 
-            // Tensor locations, dynamic ranges and layer precisions will be set after parsing the network
-            std::vector<std::string> outputsLocation = attrs.get<std::vector<std::string>>("trt_outputs_loc", {});
-            std::vector<std::string> outputsVec(node.output().begin(), node.output().end());
-            std::vector<std::string> layerName{nodeName};
-            CHECK(setTensorLocations(ctx, outputsVec, outputsLocation));
+    // Import initializers.
+    auto phaseStart = ParseProfiler::Clock::now();
+    size_t phaseBytes = ctxImpl->getTempWeightsAllocatedBytes();
+    CHECK(importInitializers(ctx, graph));
+    if (recordPhases)
+    {
+        profiler.addPhase("importInitializers", phaseStart, ctxImpl->getTempWeightsAllocatedBytes() - phaseBytes);
+    }
 
-            auto outputsRangeMin = attrs.get<std::vector<float>>("trt_outputs_range_min", {});
-            CHECK(setStringMap<float>(ctx, outputsVec, outputsRangeMin, ctx->tensorRangeMins()));
-            auto outputsRangeMax = attrs.get<std::vector<float>>("trt_outputs_range_max", {});
-            CHECK(setStringMap<float>(ctx, outputsVec, outputsRangeMax, ctx->tensorRangeMaxes()));
+    phaseStart = ParseProfiler::Clock::now();
+    std::vector<size_t> localTopoOrder;
+    std::vector<size_t>& topoOrder = topologicalOrder ? *topologicalOrder : localTopoOrder;
+    std::string sortError;
+    if (!toposort(graph.node(), &topoOrder, &sortError))
+    {
+        LOG_ERROR(sortError);
+        topoOrder.clear();
+        ASSERT(false && "Failed to sort the model topologically.", ErrorCode::kINVALID_GRAPH);
+    }
+    if (recordPhases)
+    {
+        profiler.addPhase("toposort", phaseStart);
+    }
 
-            if (attrs.count("trt_layer_precision"))
-            {
-                std::vector<nvinfer1::DataType> layerPrecision{attrs.get<nvinfer1::DataType>("trt_layer_precision")};
-                CHECK(setStringMap<nvinfer1::DataType>(ctx, layerName, layerPrecision, ctx->layerPrecisions()));
-            }
+    // Models serialized by TensorRT are imported as is, their layers were fused when they were built.
+    FusionPlan fusions;
+    if (!deserializingINetwork && ctxImpl->getFlag(nvonnxparser::OnnxParserFlag::kFUSE_PATTERNS))
+    {
+        phaseStart = ParseProfiler::Clock::now();
+        size_t const fuseBytes = ctxImpl->getTempWeightsAllocatedBytes();
+        findFusions(ctx, graph, fusions);
+        for (auto const& match : fusions.matches)
+        {
+            LOG_INFO("Fused " << match.second << " " << match.first << " pattern(s) in graph: " << graph.name());
+            profiler.addPattern(match.first, match.second);
         }
+        if (recordPhases)
+        {
+            profiler.addPhase("fusePatterns", phaseStart, ctxImpl->getTempWeightsAllocatedBytes() - fuseBytes);
+        }
+    }
 
-        ASSERT((node.output().size() <= static_cast<int32_t>(outputs.size()))
-                && "Node has more output tensors than TRT expected.",
-            ErrorCode::kINVALID_GRAPH);
+    // Per-node input and output summaries are only formatted when they will be logged.
+    bool const verbose = ctx->getLoggerSeverity() >= nvinfer1::ILogger::Severity::kVERBOSE;
+    std::vector<Status>* const nodeErrors = ctxImpl->isInSubgraph() ? nullptr : ctxImpl->nodeErrors();
+    std::unordered_set<std::string> skippedTensors; // Outputs of failed nodes and of the nodes that depend on them.
+    for (auto const& nodeIndex : topoOrder)
+    {
+        if (currentNode)
+        {
+            *currentNode = nodeIndex;
+        }
+        if (fusions.removed.count(nodeIndex))
+        {
+            continue;
+        }
+        auto const fused = fusions.replacements.find(nodeIndex);
+        auto const& node = fused == fusions.replacements.end() ? graph.node(nodeIndex) : fused->second;
+        if (!nodeErrors)
+        {
+            CHECK(parseNode(ctx, graph, node, deserializingINetwork, verbose));
+            continue;
+        }
 
-        // Set output names and register outputs with the context.
-        std::ostringstream ssOutputs{};
-        ssOutputs << nodeName << " [" << node.op_type() << "] outputs: ";
-        for (int32_t i = 0; i < node.output().size(); ++i)
+        // Capability check of supportsModel(): nodes that depend on a failed node cannot be imported and are
+        // skipped, all other nodes are still checked.
+        bool const skipped = std::any_of(node.input().begin(), node.input().end(),
+            [&skippedTensors](std::string const& input) { return skippedTensors.count(input) != 0; });
+        if (!skipped)
         {
-            auto const& outputName = node.output(i);
-            auto& output = outputs.at(i);
-            ssOutputs << "[" << outputName << " -> " << output.shape() << "[" << output.getType() << "]"
-                      << "], ";
-            // Note: This condition is to allow ONNX outputs to be ignored
-            // Always register output weights (even empty ones) as it may be mapped to an unused input
-            if ((output || output.is_weights()) && !outputName.empty())
+            Status status = parseNode(ctx, graph, node, deserializingINetwork, verbose);
+            if (status.is_success())
             {
-                ctx->registerTensor(std::move(output), outputName);
+                continue;
             }
-            // UINT8 is only allowed as network inputs and outputs. Therefore any node that produces an UINT8-typed
-            // output that is not also a graph output is unsupported.
-            if (output.getType() == "UINT8")
+            status.setNode(nodeIndex);
+            nodeErrors->push_back(status);
+            // The failure has been reported, the next nodes start with a clean error recorder.
+            if (auto* recorder = ctx->getErrorRecorder())
             {
-                bool legalUINT8 = false;
-                for (auto const& graphOutput : graph.output())
-                {
-                    if (graphOutput.name() == outputName)
-                    {
-                        legalUINT8 = true;
-                    }
-                }
-                ASSERT(legalUINT8 && "TensorRT does not support UINT8 types for intermediate tensors!", ErrorCode::kUNSUPPORTED_NODE);
+                recorder->clear();
             }
         }
-        LOG_VERBOSE(ssOutputs.str());
+        skippedTensors.insert(node.output().begin(), node.output().end());
     }
     return Status::success();
 }
@@ -376,11 +654,22 @@ Status deserialize_onnx_model(int32_t fd, bool is_serialized_as_text, ::ONNX_NAM
 bool ModelImporter::supportsModel(void const* serialized_onnx_model, size_t serialized_onnx_model_size,
     SubGraphCollection_t& sub_graph_collection, char const* model_path)
 {
-    ::ONNX_NAMESPACE::ModelProto model;
+    auto* ctx = &mImporterCtx;
+    if (ctx->network()->getNbLayers() > 0)
+    {
+        LOG_ERROR("supportsModel was called with a non-empty network definition");
+        return false;
+    }
+
+    // The model is deserialized once and kept, as the network built from it refers to its weights.
+    mONNXModels.emplace_back();
+    ::ONNX_NAMESPACE::ModelProto& model = mONNXModels.back();
     bool is_serialized_as_text = false;
+    mImporterCtx.profiler().clear();
+    auto const deserializeStart = ParseProfiler::Clock::now();
     Status status
         = deserialize_onnx_model(serialized_onnx_model, serialized_onnx_model_size, is_serialized_as_text, &model);
-
+    mImporterCtx.profiler().addDeserialize(deserializeStart, serialized_onnx_model_size);
     if (status.is_error())
     {
         mErrors.push_back(status);
@@ -392,36 +681,39 @@ bool ModelImporter::supportsModel(void const* serialized_onnx_model, size_t seri
         mImporterCtx.setOnnxFileLocation(model_path);
     }
 
-    bool allSupported{true};
+    // Import the graph once, going on past failing nodes so that all of them are reported.
+    std::vector<Status> nodeErrors;
+    mImporterCtx.setNodeErrors(&nodeErrors);
+    mCurrentNode = -1;
+    status = importModel(model);
+    mImporterCtx.setNodeErrors(nullptr);
 
-    // Parse the graph and see if we hit any parsing errors
-    allSupported = parse(serialized_onnx_model, serialized_onnx_model_size);
+    std::unordered_set<int32_t> errorNodes;
+    for (auto const& nodeError : nodeErrors)
+    {
+        errorNodes.insert(nodeError.node());
+        mErrors.push_back(nodeError);
+    }
+    bool allSupported = status.is_success() && nodeErrors.empty();
 
-    int32_t error_node = -1;
     std::string input_node{};
-
-    if (!allSupported)
+    if (status.is_error())
     {
-        int32_t nerror = getNbErrors();
-        for (int32_t i = 0; i < nerror; ++i)
+        status.setNode(mCurrentNode);
+        mErrors.push_back(status);
+        if (status.node() != -1)
         {
-            nvonnxparser::IParserError const* error = getError(i);
-            if (error->node() != -1)
-            {
-                error_node = error->node();
-                allSupported = false;
-            }
-            // The node that we failed on is one of the input nodes (-1). Get the name of the input node
-            // that we failed on and remove all nodes that spawn out of it.
-            else
-            {
-                // Node name is extracted through error->file as all errors thrown on input nodes are wrapped
-                // around MAKE_INPUT_ERROR.
-                input_node = error->file();
-            }
+            errorNodes.insert(status.node());
+        }
+        // The node that we failed on is one of the input nodes (-1). Get the name of the input node
+        // that we failed on and remove all nodes that spawn out of it.
+        else
+        {
+            // Node name is extracted through error->file as all errors thrown on input nodes are wrapped
+            // around MAKE_INPUT_ERROR.
+            input_node = status.file();
         }
     }
-    auto* ctx = &mImporterCtx;
     auto checkForInput = [&input_node, &ctx](::ONNX_NAMESPACE::NodeProto const& node) {
         for (auto input : node.input())
         {
@@ -434,12 +726,22 @@ bool ModelImporter::supportsModel(void const* serialized_onnx_model, size_t seri
     };
 
     bool newSubGraph(true);
-    // Sort and partition supported subgraphs
+    // Sort and partition supported subgraphs. The import above already sorted the same graph unless it failed before
+    // reaching the nodes.
     std::vector<size_t> topological_order;
-    if (!toposort(model.graph().node(), &topological_order))
+    if (mTopologicalOrder.size() == static_cast<size_t>(model.graph().node_size()))
     {
-        LOG_VERBOSE("Failed to sort model topologically, exiting ...");
-        return false;
+        topological_order = mTopologicalOrder;
+    }
+    else
+    {
+        std::string sortError;
+        if (!toposort(model.graph().node(), &topological_order, &sortError))
+        {
+            LOG_VERBOSE(sortError);
+            LOG_VERBOSE("Failed to sort model topologically, exiting ...");
+            return false;
+        }
     }
 
     for (int32_t node_idx : topological_order)
@@ -449,7 +751,7 @@ bool ModelImporter::supportsModel(void const* serialized_onnx_model, size_t seri
         //     1. It is not directly connected to an unsupported input
         //     2. The importer function did not throw an assertion
         bool unsupportedInput = (input_node.empty()) ? false : checkForInput(node);
-        bool unsuccessfulParse = node_idx == error_node;
+        bool unsuccessfulParse = errorNodes.count(node_idx) != 0;
         if (!unsupportedInput && !unsuccessfulParse)
         {
             if (newSubGraph)
@@ -479,9 +781,323 @@ bool ModelImporter::supportsModel(void const* serialized_onnx_model, size_t seri
     return allSupported;
 }
 
+namespace
+{
+
+//! Add the names of the tensors node reads to names, including those the nodes of its subgraphs read.
+void collectNodeInputs(::ONNX_NAMESPACE::NodeProto const& node, std::unordered_set<std::string>& names)
+{
+    for (auto const& input : node.input())
+    {
+        if (!input.empty())
+        {
+            names.insert(input);
+        }
+    }
+    for (auto const& attribute : node.attribute())
+    {
+        if (attribute.has_g())
+        {
+            for (auto const& subgraphNode : attribute.g().node())
+            {
+                collectNodeInputs(subgraphNode, names);
+            }
+        }
+        for (auto const& subgraph : attribute.graphs())
+        {
+            for (auto const& subgraphNode : subgraph.node())
+            {
+                collectNodeInputs(subgraphNode, names);
+            }
+        }
+    }
+}
+
+//! Tensors of the main graph of a model and the nodes reading them, to cut partitions out of the graph.
+struct GraphScope
+{
+    explicit GraphScope(::ONNX_NAMESPACE::GraphProto const& graph)
+        : nodeInputs(graph.node_size())
+    {
+        for (auto const& initializer : graph.initializer())
+        {
+            initializers.emplace(initializer.name(), &initializer);
+        }
+        for (auto const& input : graph.input())
+        {
+            tensors.insert(input.name());
+            valueInfos.emplace(input.name(), &input);
+        }
+        for (auto const& info : graph.value_info())
+        {
+            valueInfos.emplace(info.name(), &info);
+        }
+        for (auto const& output : graph.output())
+        {
+            graphOutputs.insert(output.name());
+            valueInfos.emplace(output.name(), &output);
+        }
+        for (int32_t i = 0; i < graph.node_size(); ++i)
+        {
+            collectNodeInputs(graph.node(i), nodeInputs[i]);
+            for (auto const& name : nodeInputs[i])
+            {
+                consumers[name].push_back(i);
+            }
+            for (auto const& output : graph.node(i).output())
+            {
+                tensors.insert(output);
+            }
+        }
+    }
+
+    string_map<::ONNX_NAMESPACE::TensorProto const*> initializers;
+    string_map<::ONNX_NAMESPACE::ValueInfoProto const*> valueInfos;
+    //! Graph inputs and node outputs, i.e. the tensors other than initializers visible to all nodes of the graph.
+    std::unordered_set<std::string> tensors;
+    std::unordered_set<std::string> graphOutputs;
+    //! Tensors read by each node and the nodes reading each tensor.
+    std::vector<std::unordered_set<std::string>> nodeInputs;
+    string_map<std::vector<size_t>> consumers;
+};
+
+//! Make subModel a model of the given nodes of the main graph of model. Tensors the nodes read from other nodes or
+//! graph inputs become inputs of its graph, and tensors they produce for other nodes or as graph outputs become its
+//! outputs. The initializers the nodes read are not copied but added to initializers.
+Status cutSubGraph(::ONNX_NAMESPACE::ModelProto const& model, GraphScope const& scope, std::vector<size_t> const& nodes,
+    ::ONNX_NAMESPACE::ModelProto& subModel, std::vector<::ONNX_NAMESPACE::TensorProto const*>& initializers)
+{
+    ::ONNX_NAMESPACE::GraphProto const& graph = model.graph();
+    subModel.set_ir_version(model.ir_version());
+    *subModel.mutable_opset_import() = model.opset_import();
+    subModel.set_producer_name(model.producer_name());
+    subModel.set_producer_version(model.producer_version());
+    subModel.set_domain(model.domain());
+    subModel.set_model_version(model.model_version());
+    ::ONNX_NAMESPACE::GraphProto* subGraph = subModel.mutable_graph();
+    subGraph->set_name(graph.name());
+
+    std::unordered_set<size_t> const members(nodes.begin(), nodes.end());
+    std::unordered_set<std::string> produced;
+    for (size_t const nodeIdx : nodes)
+    {
+        ASSERT(nodeIdx < static_cast<size_t>(graph.node_size())
+                && "The subgraph refers to a node the model does not have.",
+            ErrorCode::kINVALID_VALUE);
+        ::ONNX_NAMESPACE::NodeProto const& node = graph.node(nodeIdx);
+        *subGraph->add_node() = node;
+        produced.insert(node.output().begin(), node.output().end());
+    }
+
+    std::unordered_set<std::string> visited;
+    for (size_t const nodeIdx : nodes)
+    {
+        for (auto const& name : scope.nodeInputs[nodeIdx])
+        {
+            if (produced.count(name) || !visited.insert(name).second)
+            {
+                continue;
+            }
+            auto const initializer = scope.initializers.find(name);
+            if (initializer != scope.initializers.end())
+            {
+                initializers.push_back(initializer->second);
+                continue;
+            }
+            // Names of the subgraphs of the node that are not visible to the main graph are resolved inside them.
+            if (!scope.tensors.count(name))
+            {
+                continue;
+            }
+            auto const info = scope.valueInfos.find(name);
+            ASSERT_INPUT(info != scope.valueInfos.end()
+                    && "The type of a tensor read by the subgraph is unknown. Run shape inference on the model.",
+                ErrorCode::kINVALID_GRAPH, name);
+            *subGraph->add_input() = *info->second;
+        }
+    }
+
+    for (size_t const nodeIdx : nodes)
+    {
+        for (auto const& output : graph.node(nodeIdx).output())
+        {
+            if (output.empty())
+            {
+                continue;
+            }
+            bool isOutput = scope.graphOutputs.count(output) != 0;
+            auto const consumers = scope.consumers.find(output);
+            if (!isOutput && consumers != scope.consumers.end())
+            {
+                isOutput = std::any_of(consumers->second.begin(), consumers->second.end(),
+                    [&members](size_t consumer) { return members.count(consumer) == 0; });
+            }
+            if (!isOutput)
+            {
+                continue;
+            }
+            auto const info = scope.valueInfos.find(output);
+            ASSERT_INPUT(info != scope.valueInfos.end()
+                    && "The type of a tensor produced by the subgraph is unknown. Run shape inference on the model.",
+                ErrorCode::kINVALID_GRAPH, output);
+            *subGraph->add_output() = *info->second;
+        }
+    }
+    return Status::success();
+}
+
+} // namespace
+
+bool ModelImporter::parseSubGraphs(void const* serialized_onnx_model, size_t serialized_onnx_model_size,
+    SubGraphCollection_t const& sub_graph_collection, nvonnxparser::ISubGraphBuilder& builder, int32_t nbThreads,
+    char const* model_path) noexcept
+{
+    auto* ctx = &mImporterCtx;
+    try
+    {
+        // The networks of an earlier call refer to the importers and weights released here.
+        mSubGraphImporters.clear();
+        mSubGraphWeightsCtx.reset();
+
+        // The model is deserialized once and kept, as all networks refer to its weights.
+        mONNXModels.emplace_back();
+        ::ONNX_NAMESPACE::ModelProto& model = mONNXModels.back();
+        mImporterCtx.profiler().clear();
+        auto phaseStart = ParseProfiler::Clock::now();
+        Status status = deserialize_onnx_model(serialized_onnx_model, serialized_onnx_model_size, false, &model);
+        mImporterCtx.profiler().addDeserialize(phaseStart, serialized_onnx_model_size);
+        if (status.is_error())
+        {
+            mErrors.push_back(status);
+            return false;
+        }
+
+        size_t const nbSubGraphs = sub_graph_collection.size();
+        GraphScope const scope(model.graph());
+        std::vector<::ONNX_NAMESPACE::ModelProto> subModels(nbSubGraphs);
+        std::vector<std::vector<::ONNX_NAMESPACE::TensorProto const*>> subGraphInitializers(nbSubGraphs);
+        std::vector<Status> statuses(nbSubGraphs, Status::success());
+        for (size_t i = 0; i < nbSubGraphs; ++i)
+        {
+            statuses[i]
+                = cutSubGraph(model, scope, sub_graph_collection[i].first, subModels[i], subGraphInitializers[i]);
+        }
+
+        // Convert each initializer read by any subgraph once, in a context of its own that outlives the networks.
+        // The workers only read the converted weights. An initializer that fails to convert fails the subgraphs
+        // reading it.
+        phaseStart = ParseProfiler::Clock::now();
+        mSubGraphWeightsCtx = std::make_unique<ImporterContext>(nullptr, &mImporterCtx.logger());
+        mSubGraphWeightsCtx->setLoggerSeverity(mImporterCtx.getLoggerSeverity());
+        if (model_path)
+        {
+            mSubGraphWeightsCtx->setOnnxFileLocation(model_path);
+        }
+        string_map<ShapedWeights> sharedWeights;
+        for (auto const& initializers : subGraphInitializers)
+        {
+            for (::ONNX_NAMESPACE::TensorProto const* initializer : initializers)
+            {
+                ShapedWeights weights;
+                if (!sharedWeights.count(initializer->name())
+                    && convertOnnxWeights(*initializer, &weights, mSubGraphWeightsCtx.get()))
+                {
+                    sharedWeights.emplace(initializer->name(), std::move(weights));
+                }
+            }
+        }
+        mImporterCtx.profiler().addPhase("importInitializers", phaseStart);
+
+        // Each subgraph is imported by an importer of its own, which is kept as its network refers to the weights
+        // created by its importers.
+        mSubGraphImporters.resize(nbSubGraphs);
+        auto const importSubGraph = [&](size_t i) -> Status {
+            CHECK(statuses[i]);
+            nvinfer1::INetworkDefinition* network = builder.createNetwork(static_cast<int64_t>(i));
+            ASSERT(network && "No network was created for the subgraph.", ErrorCode::kINTERNAL_ERROR);
+            auto& importer = mSubGraphImporters[i];
+            importer = std::make_unique<ModelImporter>(network, &mImporterCtx.logger());
+            importer->mImporterCtx.setLoggerSeverity(mImporterCtx.getLoggerSeverity());
+            importer->setFlags(getFlags());
+            importer->mONNXModels.push_back(std::move(subModels[i]));
+            ::ONNX_NAMESPACE::ModelProto const& subModel = importer->mONNXModels.back();
+            for (::ONNX_NAMESPACE::TensorProto const* initializer : subGraphInitializers[i])
+            {
+                auto const weights = sharedWeights.find(initializer->name());
+                ASSERT_INPUT(weights != sharedWeights.end() && "Failed to import initializer.",
+                    ErrorCode::kUNSUPPORTED_NODE, initializer->name());
+                importer->mImporterCtx.registerTensor(TensorOrWeights{weights->second}, initializer->name());
+            }
+
+            importer->mCurrentNode = -1;
+            Status importStatus = importer->importModel(subModel);
+            if (importStatus.is_error())
+            {
+                // Report the node by its index in the model rather than in the subgraph.
+                auto const& nodes = sub_graph_collection[i].first;
+                int32_t const node = importer->mCurrentNode;
+                importStatus.setNode(0 <= node && static_cast<size_t>(node) < nodes.size() ? nodes[node] : -1);
+                return importStatus;
+            }
+            ASSERT(builder.buildNetwork(static_cast<int64_t>(i), *network) && "Failed to build the subgraph.",
+                ErrorCode::kINTERNAL_ERROR);
+            return Status::success();
+        };
+
+        size_t const nbWorkers = std::min<size_t>(
+            nbThreads > 0 ? static_cast<size_t>(nbThreads) : std::max(std::thread::hardware_concurrency(), 1U),
+            nbSubGraphs);
+        LOG_VERBOSE("Importing and building " << nbSubGraphs << " subgraphs on " << nbWorkers << " threads");
+        phaseStart = ParseProfiler::Clock::now();
+        std::atomic<size_t> nextSubGraph{0};
+        auto worker = [&]() {
+            for (size_t i = nextSubGraph++; i < nbSubGraphs; i = nextSubGraph++)
+            {
+                try
+                {
+                    statuses[i] = importSubGraph(i);
+                }
+                catch (std::exception const& e)
+                {
+                    statuses[i] = MAKE_ERROR(e.what(), ErrorCode::kINTERNAL_ERROR);
+                }
+            }
+        };
+        std::vector<std::thread> workers;
+        workers.reserve(nbWorkers > 0 ? nbWorkers - 1 : 0);
+        for (size_t i = 1; i < nbWorkers; ++i)
+        {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : workers)
+        {
+            thread.join();
+        }
+        mImporterCtx.profiler().addPhase("importSubGraphs", phaseStart);
+
+        bool success = true;
+        for (size_t i = 0; i < nbSubGraphs; ++i)
+        {
+            if (statuses[i].is_error())
+            {
+                LOG_ERROR("Failed to import or build subgraph " << i << ": " << statuses[i].desc());
+                mErrors.push_back(statuses[i]);
+                success = false;
+            }
+        }
+        return success;
+    }
+    catch (std::exception const& e)
+    {
+        LOG_ERROR("Failed to import the subgraphs: " << e.what());
+        return false;
+    }
+}
+
 bool ModelImporter::supportsOperator(char const* op_name) const
 {
-    return _op_importers.count(op_name);
+    return getBuiltinOpImporters().getId(op_name) != BuiltinOpImporters::kINVALID_ID;
 }
 
 bool ModelImporter::parseWithWeightDescriptors(void const* serialized_onnx_model, size_t serialized_onnx_model_size)
@@ -493,8 +1109,11 @@ bool ModelImporter::parseWithWeightDescriptors(void const* serialized_onnx_model
     mONNXModels.emplace_back();
     ::ONNX_NAMESPACE::ModelProto& model = mONNXModels.back();
     bool is_serialized_as_text = false;
+    mImporterCtx.profiler().clear();
+    auto const deserializeStart = ParseProfiler::Clock::now();
     Status status
         = deserialize_onnx_model(serialized_onnx_model, serialized_onnx_model_size, is_serialized_as_text, &model);
+    mImporterCtx.profiler().addDeserialize(deserializeStart, serialized_onnx_model_size);
     if (status.is_error())
     {
         mErrors.push_back(status);
@@ -532,8 +1151,12 @@ Status ModelImporter::importModel(::ONNX_NAMESPACE::ModelProto const& model)
     auto* ctx = &mImporterCtx;
     mImporterCtx.clearOpsets();
 #if ENABLE_STD_PLUGIN
-    // Initialize plugin registry
-    initLibNvInferPlugins(static_cast<void*>(&ctx->logger()), "");
+    // Initialize plugin registry. parseSubGraphs() imports models on several threads at once.
+    {
+        static std::mutex pluginRegistryMutex;
+        std::lock_guard<std::mutex> lock(pluginRegistryMutex);
+        initLibNvInferPlugins(static_cast<void*>(&ctx->logger()), "");
+    }
 #endif // ENABLE_STD_PLUGIN
     for (int32_t i = 0; i < model.opset_import().size(); ++i)
     {
@@ -559,15 +1182,27 @@ Status ModelImporter::importModel(::ONNX_NAMESPACE::ModelProto const& model)
 
     // Propagate OnnxParserFlags down to the importer context.
     mImporterCtx.setFlags(getFlags());
+    mImporterCtx.lazyInitializers().clear();
+    mTopologicalOrder.clear();
 
     mCurrentNode = -1;
+    auto phaseStart = ParseProfiler::Clock::now();
     CHECK(importInputs(&mImporterCtx, graph, &mImporterCtx.tensors()));
-    CHECK(parseGraph(&mImporterCtx, graph, model.producer_name() == "TensorRT", &mCurrentNode));
+    mImporterCtx.profiler().addPhase("importInputs", phaseStart);
+    CHECK(parseGraph(&mImporterCtx, graph, model.producer_name() == "TensorRT", &mCurrentNode, &mTopologicalOrder));
+    if (mImporterCtx.nodeErrors() && !mImporterCtx.nodeErrors()->empty())
+    {
+        // Capability check with failed nodes: the outputs they would have produced are missing, so the outputs cannot
+        // be marked. The nodes report the errors.
+        return Status::success();
+    }
 
     mCurrentNode = -1;
+    phaseStart = ParseProfiler::Clock::now();
     // Mark outputs defined in the ONNX model (unless tensors are user-requested)
     for (::ONNX_NAMESPACE::ValueInfoProto const& output : graph.output())
     {
+        CHECK(importLazyInitializer(&mImporterCtx, output.name()));
         ASSERT((mImporterCtx.tensors().count(output.name())) && "The output tensor was not registered.",
             ErrorCode::kINVALID_GRAPH);
         nvinfer1::ITensor* output_tensor_ptr
@@ -606,12 +1241,20 @@ Status ModelImporter::importModel(::ONNX_NAMESPACE::ModelProto const& model)
     {
         std::string user_output_name = user_output_entry.first;
         nvinfer1::ITensor** user_output_ptr = user_output_entry.second;
+        CHECK(importLazyInitializer(&mImporterCtx, user_output_name));
         ASSERT((mImporterCtx.tensors().count(user_output_name)) && "The user-requested output was not registered.",
             ErrorCode::kINVALID_VALUE);
         TensorOrWeights user_output = mImporterCtx.tensors().at(user_output_name);
         ASSERT((user_output.is_tensor()) && "The user-requested output must be a tensor.", ErrorCode::kINVALID_VALUE);
         *user_output_ptr = &user_output.tensor();
     }
+    mImporterCtx.profiler().addPhase("markOutputs", phaseStart);
+
+    // Initializers still registered as lazy were never used. They are kept so releaseParseState() can free them.
+    if (!mImporterCtx.lazyInitializers().empty())
+    {
+        LOG_VERBOSE(mImporterCtx.lazyInitializers().size() << " initializers are not used and were not imported.");
+    }
 
     if (model.producer_name() == "TensorRT")
     {
@@ -680,6 +1323,8 @@ Status ModelImporter::importModel(::ONNX_NAMESPACE::ModelProto const& model)
         }
     }
 
+    LOG_VERBOSE("Temporary weights use " << mImporterCtx.getTempWeightsBytes() << " bytes of host memory.");
+
     // Regenerate the plugin library list
     mPluginLibraryList = ctx->getUsedVCPluginLibraries();
     mPluginLibraryListCStr.clear();
@@ -692,9 +1337,18 @@ Status ModelImporter::importModel(::ONNX_NAMESPACE::ModelProto const& model)
     return Status::success();
 }
 
+// verbosity is the least severe level reported by the caller's logger, so skip formatting anything above it.
+static nvinfer1::ILogger::Severity verbositySeverity(int32_t verbosity)
+{
+    int32_t const maxVerbosity = static_cast<int32_t>(nvinfer1::ILogger::Severity::kVERBOSE);
+    return static_cast<nvinfer1::ILogger::Severity>(
+        std::max(static_cast<int32_t>(nvinfer1::ILogger::Severity::kINTERNAL_ERROR), std::min(verbosity, maxVerbosity)));
+}
+
 bool ModelImporter::parseFromFile(char const* onnxModelFile, int32_t verbosity)
 {
     auto* ctx = &mImporterCtx;
+    LoggerSeverityScope severityScope(mImporterCtx, verbositySeverity(verbosity));
 
     // Define S_ISREG macro for Windows
 #if !defined(S_ISREG)
@@ -702,25 +1356,45 @@ bool ModelImporter::parseFromFile(char const* onnxModelFile, int32_t verbosity)
 #endif
 
     struct stat sb;
-    if (stat(onnxModelFile, &sb) == 0 && !S_ISREG(sb.st_mode))
+    bool const statOk = stat(onnxModelFile, &sb) == 0;
+    if (statOk && !S_ISREG(sb.st_mode))
     {
 	LOG_ERROR("Input is not a regular file: " << onnxModelFile);
 	return false;
     }
 
+    if (ctx->network()->getNbLayers() > 0)
+    {
+        LOG_ERROR("Parse was called with a non-empty network definition");
+        return false;
+    }
+
     GOOGLE_PROTOBUF_VERIFY_VERSION;
-    ::ONNX_NAMESPACE::ModelProto onnx_model;
 
+    // Deserialize the model only once, directly into the storage that owns the weights for the lifetime of the
+    // parser. The same ModelProto is used for the header and the error reporting below.
+    mONNXModels.emplace_back();
+    ::ONNX_NAMESPACE::ModelProto& onnx_model = mONNXModels.back();
+
+    mImporterCtx.profiler().clear();
+    auto const deserializeStart = ParseProfiler::Clock::now();
     bool const is_binary = ParseFromFile_WAR(&onnx_model, onnxModelFile);
     if (!is_binary && !ParseFromTextFile(&onnx_model, onnxModelFile))
     {
         LOG_ERROR("Failed to parse ONNX model from file: " << onnxModelFile);
+        mONNXModels.pop_back();
         return false;
     }
+    mImporterCtx.profiler().addDeserialize(deserializeStart, statOk ? static_cast<size_t>(sb.st_size) : 0);
 
     // Keep track of the absolute path to the ONNX file.
     mImporterCtx.setOnnxFileLocation(onnxModelFile);
+    return importModelFile(onnx_model, onnxModelFile);
+}
 
+bool ModelImporter::importModelFile(::ONNX_NAMESPACE::ModelProto const& onnx_model, char const* onnxModelFile)
+{
+    auto* ctx = &mImporterCtx;
     int64_t const opset_version = (onnx_model.opset_import().size() ? onnx_model.opset_import(0).version() : 0);
     LOG_INFO("----------------------------------------------------------------");
     LOG_INFO("Input filename:   " << onnxModelFile);
@@ -733,39 +1407,351 @@ bool ModelImporter::parseFromFile(char const* onnxModelFile, int32_t verbosity)
     LOG_INFO("Doc string:       " << onnx_model.doc_string());
     LOG_INFO("----------------------------------------------------------------");
 
-    { //...Read input file, parse it
-        std::ifstream onnx_file(onnxModelFile, std::ios::binary | std::ios::ate);
-        auto const file_size = onnx_file.tellg();
-        onnx_file.seekg(0, std::ios::beg);
-        std::vector<char> onnx_buf(file_size);
-        if (!onnx_file.read(onnx_buf.data(), onnx_buf.size()))
+    mCurrentNode = -1;
+    Status status = this->importModel(onnx_model);
+    if (status.is_error())
+    {
+        status.setNode(mCurrentNode);
+        mErrors.push_back(status);
+
+        int32_t const nerror = getNbErrors();
+        for (int32_t i = 0; i < nerror; ++i)
+        {
+            nvonnxparser::IParserError const* error = getError(i);
+            if (error->node() != -1)
+            {
+                ::ONNX_NAMESPACE::NodeProto const& node = onnx_model.graph().node(error->node());
+                LOG_ERROR("While parsing node number " << error->node() << " [" << node.op_type() << " -> \"" << node.output(0) << "\"" << "]:");
+                LOG_ERROR("--- Begin node ---");
+                LOG_ERROR(pretty_print_onnx_to_string(node));
+                LOG_ERROR("--- End node ---");
+            }
+            LOG_ERROR("ERROR: " << error->file() << ":" << error->line() << " In function " << error->func() << ":\n"
+                 << "[" << static_cast<int>(error->code()) << "] " << error->desc());
+        }
+        return false;
+    }
+    return true;
+}
+
+bool ModelImporter::parseFromFileWithSnapshot(
+    char const* onnxModelFile, char const* snapshotFile, int32_t verbosity) noexcept
+{
+    auto* ctx = &mImporterCtx;
+    try
+    {
+        if (!snapshotFile)
+        {
+            return parseFromFile(onnxModelFile, verbosity);
+        }
+        LoggerSeverityScope severityScope(mImporterCtx, verbositySeverity(verbosity));
+        if (ctx->network()->getNbLayers() > 0)
         {
-            LOG_ERROR("Failed to read from file: " << onnxModelFile);
+            LOG_ERROR("Parse was called with a non-empty network definition");
             return false;
         }
-        if (!parse(onnx_buf.data(), onnx_buf.size()))
+        GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+        // The snapshot is keyed by the contents of the model file, which is much cheaper to hash than to parse.
+        uint64_t const modelHash = hashModelFile(onnxModelFile);
+        if (modelHash != 0)
         {
-            int32_t const nerror = getNbErrors();
-            for (int32_t i = 0; i < nerror; ++i)
+            mONNXModels.emplace_back();
+            ::ONNX_NAMESPACE::ModelProto& onnx_model = mONNXModels.back();
+            mImporterCtx.profiler().clear();
+            auto const deserializeStart = ParseProfiler::Clock::now();
+            size_t modelBytes{0};
+            if (readParsedSnapshot(ctx, snapshotFile, modelHash, onnx_model, &modelBytes))
             {
-                nvonnxparser::IParserError const* error = getError(i);
-                if (error->node() != -1)
+                mImporterCtx.profiler().addDeserialize(deserializeStart, modelBytes);
+                LOG_INFO("Importing the parsed snapshot " << snapshotFile);
+                // The initializers of the snapshot refer to their converted values in the snapshot itself.
+                mImporterCtx.setOnnxFileLocation(snapshotFile);
+                return importModelFile(onnx_model, onnxModelFile);
+            }
+            mONNXModels.pop_back();
+        }
+
+        if (!parseFromFile(onnxModelFile, verbosity))
+        {
+            return false;
+        }
+        // The network is complete at this point, so failing to write the snapshot only costs the next parse.
+        if (modelHash != 0)
+        {
+            try
+            {
+                Status const status
+                    = writeParsedSnapshot(ctx, mONNXModels.back(), onnxModelFile, modelHash, snapshotFile);
+                if (status.is_error())
                 {
-                    ::ONNX_NAMESPACE::NodeProto const& node = onnx_model.graph().node(error->node());
-                    LOG_ERROR("While parsing node number " << error->node() << " [" << node.op_type() << " -> \"" << node.output(0) << "\"" << "]:");
-                    LOG_ERROR("--- Begin node ---");
-                    LOG_ERROR(pretty_print_onnx_to_string(node));
-                    LOG_ERROR("--- End node ---");
+                    LOG_WARNING("Failed to write the parsed snapshot " << snapshotFile << ": " << status.desc());
                 }
-                LOG_ERROR("ERROR: " << error->file() << ":" << error->line() << " In function " << error->func() << ":\n"
-                     << "[" << static_cast<int>(error->code()) << "] " << error->desc());
             }
+            catch (std::exception const& e)
+            {
+                LOG_WARNING("Failed to write the parsed snapshot " << snapshotFile << ": " << e.what());
+            }
+        }
+        return true;
+    }
+    catch (std::exception const& e)
+    {
+        LOG_ERROR("Failed to parse " << onnxModelFile << " with the snapshot " << snapshotFile << ": " << e.what());
+        return false;
+    }
+}
+
+char const* ModelImporter::getParseProfile() const noexcept
+{
+    try
+    {
+        mParseProfile = mImporterCtx.profiler().toJson();
+    }
+    catch (std::exception const&)
+    {
+        return nullptr;
+    }
+    return mParseProfile.c_str();
+}
+
+bool ModelImporter::loadRefitWeights(
+    void const* serialized_onnx_model, size_t serialized_onnx_model_size, char const* model_path) noexcept
+{
+    mRefitWeights.clear();
+    mRefitCtx.reset();
+    try
+    {
+        mRefitModel = std::make_unique<::ONNX_NAMESPACE::ModelProto>();
+        Status status = deserialize_onnx_model(serialized_onnx_model, serialized_onnx_model_size, false, mRefitModel.get());
+        if (!status.is_error())
+        {
+            status = importRefitWeights(model_path);
+        }
+        if (status.is_error())
+        {
+            mErrors.push_back(status);
+            mRefitWeights.clear();
+            mRefitCtx.reset();
+            mRefitModel.reset();
             return false;
         }
-    } //...End Reading input file, parsing it
+    }
+    catch (std::exception const& e)
+    {
+        auto* ctx = &mImporterCtx;
+        LOG_ERROR("Failed to load refit weights: " << e.what());
+        mRefitWeights.clear();
+        mRefitCtx.reset();
+        mRefitModel.reset();
+        return false;
+    }
     return true;
 }
 
+//! Type of the weights convertOnnxWeights() makes of an initializer of the given type. Initializers of parsed
+//! snapshots are stored with the converted type.
+static int32_t convertedType(int32_t onnxType)
+{
+    switch (onnxType)
+    {
+    case ::ONNX_NAMESPACE::TensorProto::INT64:
+    case ::ONNX_NAMESPACE::TensorProto::UINT8: return ::ONNX_NAMESPACE::TensorProto::INT32;
+    case ::ONNX_NAMESPACE::TensorProto::DOUBLE: return ::ONNX_NAMESPACE::TensorProto::FLOAT;
+    default: return onnxType;
+    }
+}
+
+Status ModelImporter::importRefitWeights(char const* model_path)
+{
+    auto* ctx = &mImporterCtx;
+    ::ONNX_NAMESPACE::GraphProto const& graph = mRefitModel->graph();
+
+    // Engines can only be refit with weights for the network they were built from, so reject anything that does not
+    // line up with the parsed model.
+    if (!mONNXModels.empty())
+    {
+        ::ONNX_NAMESPACE::GraphProto const& parsedGraph = mONNXModels.back().graph();
+        ASSERT(graph.node_size() == parsedGraph.node_size()
+                && "The refit model has a different number of nodes than the parsed model.",
+            ErrorCode::kINVALID_GRAPH);
+        for (int32_t i = 0; i < graph.node_size(); ++i)
+        {
+            ASSERT(graph.node(i).op_type() == parsedGraph.node(i).op_type()
+                    && "The refit model has a different topology than the parsed model.",
+                ErrorCode::kINVALID_GRAPH);
+        }
+        string_map<::ONNX_NAMESPACE::TensorProto const*> parsedInitializers;
+        for (::ONNX_NAMESPACE::TensorProto const& initializer : parsedGraph.initializer())
+        {
+            parsedInitializers.emplace(initializer.name(), &initializer);
+        }
+        for (::ONNX_NAMESPACE::TensorProto const& initializer : graph.initializer())
+        {
+            auto const iter = parsedInitializers.find(initializer.name());
+            ASSERT(iter != parsedInitializers.end() && "The refit model has an initializer the parsed model does not.",
+                ErrorCode::kINVALID_GRAPH);
+            ::ONNX_NAMESPACE::TensorProto const& parsed = *iter->second;
+            ASSERT(convertedType(initializer.data_type()) == convertedType(parsed.data_type())
+                    && std::equal(initializer.dims().begin(), initializer.dims().end(), parsed.dims().begin(),
+                        parsed.dims().end())
+                    && "The type or shape of a refit initializer differs from the parsed model.",
+                ErrorCode::kINVALID_GRAPH);
+        }
+    }
+
+    // Convert through a context of its own, so the refit weights are not mixed into the storage of the network's
+    // weights and are freed with the next call. Deduplication is left off, every initializer gets its own values,
+    // and so is lazy import, as every initializer is wanted.
+    mRefitCtx = std::make_unique<ImporterContext>(nullptr, &mImporterCtx.logger());
+    mRefitCtx->setLoggerSeverity(mImporterCtx.getLoggerSeverity());
+    mRefitCtx->setFlags(getFlags()
+        & ~(1U << static_cast<uint32_t>(nvonnxparser::OnnxParserFlag::kDEDUPLICATE_WEIGHTS))
+        & ~(1U << static_cast<uint32_t>(nvonnxparser::OnnxParserFlag::kLAZY_INITIALIZER_IMPORT)));
+    mRefitCtx->setOnnxFileLocation(model_path ? std::string{model_path} : mImporterCtx.getOnnxFileLocation());
+    CHECK(importInitializers(mRefitCtx.get(), graph));
+
+    mRefitWeights.reserve(graph.initializer_size());
+    for (::ONNX_NAMESPACE::TensorProto const& initializer : graph.initializer())
+    {
+        mRefitWeights.push_back(mRefitCtx->tensors().at(initializer.name()).weights());
+    }
+    LOG_VERBOSE("Loaded " << mRefitWeights.size() << " refit weights, " << mRefitCtx->getTempWeightsBytes()
+                          << " bytes of them converted.");
+    return Status::success();
+}
+
+bool ModelImporter::applyRefitWeights(nvinfer1::IRefitter& refitter) noexcept
+{
+    auto* ctx = &mImporterCtx;
+    try
+    {
+        string_map<nvinfer1::Weights> weightsByName;
+        for (auto const& weights : mRefitWeights)
+        {
+            weightsByName.emplace(weights.getName(), static_cast<nvinfer1::Weights>(weights));
+        }
+
+        int32_t const nbNames = refitter.getAllWeights(0, nullptr);
+        std::vector<char const*> names(std::max(nbNames, 0));
+        refitter.getAllWeights(nbNames, names.data());
+
+        bool success = true;
+        int32_t nbMissing = 0;
+        for (char const* name : names)
+        {
+            auto const iter = weightsByName.find(name);
+            if (iter == weightsByName.end())
+            {
+                LOG_VERBOSE("No refit weights loaded for: " << name);
+                ++nbMissing;
+                continue;
+            }
+            if (!refitter.setNamedWeights(name, iter->second))
+            {
+                LOG_ERROR("The refitter rejected the weights: " << name);
+                success = false;
+            }
+        }
+        if (nbMissing > 0)
+        {
+            LOG_WARNING(nbMissing << " of " << nbNames
+                                  << " refittable weights have no loaded counterpart and keep their current values.");
+        }
+        return success;
+    }
+    catch (std::exception const& e)
+    {
+        LOG_ERROR("Failed to apply refit weights: " << e.what());
+        return false;
+    }
+}
+
+namespace
+{
+
+//! Whether convertOnnxWeights() copies the values of an initializer stored in the proto, so the network never refers
+//! to the proto's own copy.
+bool isImportedByCopy(::ONNX_NAMESPACE::TensorProto const& initializer)
+{
+    if (initializer.data_location() == ::ONNX_NAMESPACE::TensorProto::EXTERNAL)
+    {
+        return false;
+    }
+    switch (initializer.data_type())
+    {
+    case ::ONNX_NAMESPACE::TensorProto::INT64:
+    case ::ONNX_NAMESPACE::TensorProto::DOUBLE: return true;
+    case ::ONNX_NAMESPACE::TensorProto::UINT8: return !initializer.raw_data().empty();
+    case ::ONNX_NAMESPACE::TensorProto::FLOAT16:
+    case ::ONNX_NAMESPACE::TensorProto::INT8:
+    case ::ONNX_NAMESPACE::TensorProto::BOOL: return initializer.raw_data().empty();
+    default: return false;
+    }
+}
+
+//! Free the values stored in an initializer, returning the number of bytes released.
+size_t clearInitializerData(::ONNX_NAMESPACE::TensorProto& initializer)
+{
+    size_t const bytes = initializer.raw_data().size() + initializer.float_data().size() * sizeof(float)
+        + initializer.int32_data().size() * sizeof(int32_t) + initializer.int64_data().size() * sizeof(int64_t)
+        + initializer.double_data().size() * sizeof(double);
+    // clear_*() keeps the capacity of the fields, swapping with empty ones gives it back.
+    std::string{}.swap(*initializer.mutable_raw_data());
+    ::google::protobuf::RepeatedField<float>{}.Swap(initializer.mutable_float_data());
+    ::google::protobuf::RepeatedField<int32_t>{}.Swap(initializer.mutable_int32_data());
+    ::google::protobuf::RepeatedField<int64_t>{}.Swap(initializer.mutable_int64_data());
+    ::google::protobuf::RepeatedField<double>{}.Swap(initializer.mutable_double_data());
+    return bytes;
+}
+
+} // namespace
+
+void ModelImporter::releaseParseState() noexcept
+{
+    auto* ctx = &mImporterCtx;
+    try
+    {
+        size_t releasedBytes{0};
+        auto const& unusedInitializers = mImporterCtx.lazyInitializers();
+        for (auto& model : mONNXModels)
+        {
+            for (auto& initializer : *model.mutable_graph()->mutable_initializer())
+            {
+                if (isImportedByCopy(initializer) || unusedInitializers.count(initializer.name()))
+                {
+                    releasedBytes += clearInitializerData(initializer);
+                }
+            }
+        }
+        mImporterCtx.clearParseState();
+        for (auto& importer : mSubGraphImporters)
+        {
+            if (importer)
+            {
+                importer->releaseParseState();
+            }
+        }
+        LOG_VERBOSE("Released the parse state and " << releasedBytes << " bytes of initializers not used by the network.");
+    }
+    catch (std::exception const& e)
+    {
+        LOG_ERROR("Failed to release the parse state: " << e.what());
+    }
+}
+
+void ModelImporter::releaseWeightsMemory() noexcept
+{
+    auto* ctx = &mImporterCtx;
+    releaseParseState();
+    LOG_VERBOSE("Releasing " << mImporterCtx.getTempWeightsBytes() << " bytes of temporary weights.");
+    mONNXModels.clear();
+    mImporterCtx.releaseTempWeights();
+    mImporterCtx.releaseMappedFiles();
+    mSubGraphImporters.clear();
+    mSubGraphWeightsCtx.reset();
+}
+
 char const* const* ModelImporter::getUsedVCPluginLibraries(int64_t& nbPluginLibs) const noexcept
 {
     nbPluginLibs = mPluginLibraryListCStr.size();
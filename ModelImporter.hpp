@@ -13,13 +13,14 @@
 namespace onnx2trt
 {
 
+//! Import the nodes of graph into the network. If topologicalOrder is not null, it receives the order the nodes were
+//! imported in.
 Status parseGraph(IImporterContext* ctx, ::ONNX_NAMESPACE::GraphProto const& graph, bool deserializingINetwork = false,
-    int32_t* currentNode = nullptr);
+    int32_t* currentNode = nullptr, std::vector<size_t>* topologicalOrder = nullptr);
 
 class ModelImporter : public nvonnxparser::IParser
 {
 protected:
-    string_map<NodeImporter> _op_importers;
     virtual Status importModel(::ONNX_NAMESPACE::ModelProto const& model);
 
 private:
@@ -30,12 +31,22 @@ private:
     std::list<::ONNX_NAMESPACE::ModelProto> mONNXModels; // Needed for ownership of weights
     int mCurrentNode;
     std::vector<Status> mErrors;
+    std::vector<size_t> mTopologicalOrder; // Order the nodes of the main graph were imported in by the last parse
     nvonnxparser::OnnxParserFlags mOnnxParserFlags{0};
+    mutable std::string mParseProfile; // JSON returned by getParseProfile()
+    std::unique_ptr<::ONNX_NAMESPACE::ModelProto> mRefitModel; // Owner of the refit weights stored in the model
+    std::unique_ptr<ImporterContext> mRefitCtx; // Owner of the refit weights converted or mapped from files
+    std::vector<ShapedWeights> mRefitWeights; // Refit weights in initializer order
+    std::unique_ptr<ImporterContext> mSubGraphWeightsCtx; // Owner of the initializers shared by parseSubGraphs()
+    std::vector<std::unique_ptr<ModelImporter>> mSubGraphImporters; // Importers of the networks of parseSubGraphs()
+
+    Status importRefitWeights(char const* model_path);
+    //! Log the header of onnx_model, read from onnxModelFile, import it and report any error.
+    bool importModelFile(::ONNX_NAMESPACE::ModelProto const& onnx_model, char const* onnxModelFile);
 
 public:
     ModelImporter(nvinfer1::INetworkDefinition* network, nvinfer1::ILogger* logger)
-        : _op_importers(getBuiltinOpImporterMap())
-        , mImporterCtx(network, logger)
+        : mImporterCtx(network, logger)
     {
     }
     bool parseWithWeightDescriptors(void const* serialized_onnx_model, size_t serialized_onnx_model_size) override;
@@ -90,7 +101,54 @@ public:
 
     bool parseFromFile(char const* onnxModelFile, int32_t verbosity) override;
 
+    bool parseFromFileWithSnapshot(
+        char const* onnxModelFile, char const* snapshotFile, int32_t verbosity) noexcept override;
+
+    bool parseSubGraphs(void const* serialized_onnx_model, size_t serialized_onnx_model_size,
+        SubGraphCollection_t const& sub_graph_collection, nvonnxparser::ISubGraphBuilder& builder,
+        int32_t nbThreads = 0, char const* model_path = nullptr) noexcept override;
+
+    void setLoggerSeverity(nvinfer1::ILogger::Severity severity) noexcept override
+    {
+        mImporterCtx.setLoggerSeverity(severity);
+    }
+
+    nvinfer1::ILogger::Severity getLoggerSeverity() const noexcept override
+    {
+        return mImporterCtx.getLoggerSeverity();
+    }
+
     virtual char const* const* getUsedVCPluginLibraries(int64_t& nbPluginLibs) const noexcept override;
+
+    char const* getParseProfile() const noexcept override;
+
+    bool loadRefitWeights(void const* serialized_onnx_model, size_t serialized_onnx_model_size,
+        char const* model_path = nullptr) noexcept override;
+
+    int64_t getNbRefitWeights() const noexcept override
+    {
+        return mRefitWeights.size();
+    }
+
+    char const* getRefitWeightsName(int64_t index) const noexcept override
+    {
+        return (0 <= index && index < getNbRefitWeights()) ? mRefitWeights[index].getName() : nullptr;
+    }
+
+    nvinfer1::Weights getRefitWeights(int64_t index) const noexcept override
+    {
+        if (index < 0 || index >= getNbRefitWeights())
+        {
+            return nvinfer1::Weights{nvinfer1::DataType::kFLOAT, nullptr, 0};
+        }
+        return mRefitWeights[index];
+    }
+
+    bool applyRefitWeights(nvinfer1::IRefitter& refitter) noexcept override;
+
+    void releaseParseState() noexcept override;
+
+    void releaseWeightsMemory() noexcept override;
 };
 
 } // namespace onnx2trt
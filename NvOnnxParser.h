@@ -92,7 +92,44 @@ enum class OnnxParserFlag : int32_t
     //! implementation over the plugin implementation for InstanceNormalization nodes. This flag is planned to be
     //! deprecated in TensorRT 8.7 and removed in TensorRT 9.0. This flag is required when building version-compatible
     //! or hardware-compatible engines. There may be performance degradations when this flag is enabled.
-    kNATIVE_INSTANCENORM = 0
+    kNATIVE_INSTANCENORM = 0,
+    //! Convert the initializers of each graph on multiple threads before importing its nodes. Initializers are still
+    //! registered in their original order, so tensor and weight names are identical to a sequential import.
+    kPARALLEL_INITIALIZER_IMPORT = 1,
+    //! Share one buffer and one IConstantLayer between initializers and Constant nodes that have identical type,
+    //! shape and contents. This reduces host memory during parsing and the size of the serialized engine, but only
+    //! the first of a set of identical weights keeps its name in the network, so the others cannot be refitted
+    //! individually.
+    kDEDUPLICATE_WEIGHTS = 2,
+    //! Register the initializers of the main graph without converting them, and convert each one when the first node
+    //! or graph output that reads it is imported. Initializers no node reads are never converted, and the pages of
+    //! external weights files are only touched for the weights that are used. Takes precedence over
+    //! kPARALLEL_INITIALIZER_IMPORT for the main graph.
+    kLAZY_INITIALIZER_IMPORT = 3,
+    //! Before importing the nodes of each graph, replace the subgraphs exporters emit for operations TensorRT
+    //! implements as a single layer with that operation. Decomposed layer normalizations (ReduceMean, Sub, Pow,
+    //! ReduceMean, Add, Sqrt, Div, Mul and an optional Add) are imported as one INormalizationLayer named after the
+    //! last node of the subgraph. The number of matches of each pattern is logged and reported by getParseProfile().
+    kFUSE_PATTERNS = 4,
+    //! Quantize constant weights read by an INT8 QuantizeLinear with a zero zero-point on the host, per tensor or per
+    //! channel. The network receives INT8 constants that feed the DequantizeLinear instead of FLOAT constants and
+    //! quantize layers, which makes it smaller and faster to build. The quantized weights cannot be refitted under
+    //! the names of the FLOAT initializers.
+    kFOLD_WEIGHT_QUANTIZATION = 5,
+    //! Compute X * W^T + Wb of the LSTM, GRU and RNN operators for all timesteps with one matrix multiplication
+    //! before their loop, so that each iteration only multiplies the hidden state by R. This trades a buffer of
+    //! sequence length x batch size x gate width per direction for much larger, tensor core friendly GEMMs.
+    kPRECOMPUTE_RNN_INPUT_PROJECTION = 6,
+    //! Have the OS read the external weights of at least 1 MiB in the background as soon as the initializer is
+    //! converted, instead of on first access. Most importers do not read the values of weights, which are copied by
+    //! the builder, so the reads from disk overlap the import of the remaining nodes and the start of the build.
+    //! Only has an effect on platforms with madvise().
+    kPREFETCH_EXTERNAL_WEIGHTS = 7,
+    //! Evaluate Shape, Size, Identity, Cast, Reshape, Squeeze, Unsqueeze, Concat, Gather and integer arithmetic nodes
+    //! whose inputs are all INT32 or INT64 weights on the host, and pass their results to the nodes that read them as
+    //! weights instead of adding layers. Only results of up to 4096 elements are computed. Floating-point weights are
+    //! never folded, so refit names are not affected.
+    kFOLD_CONSTANT_NODES = 8
 };
 
 //!
@@ -103,7 +140,7 @@ enum class OnnxParserFlag : int32_t
 template <>
 constexpr inline int32_t EnumMax<OnnxParserFlag>()
 {
-    return 1;
+    return 9;
 }
 
 //!
@@ -143,6 +180,39 @@ protected:
     virtual ~IParserError() {}
 };
 
+//!
+//! \class ISubGraphBuilder
+//!
+//! \brief Application callbacks of IParser::parseSubGraphs() that provide the network of each subgraph and build it.
+//!
+//! The methods are called on the parser's worker threads, concurrently for different subgraphs, and must be
+//! thread-safe. Use a builder of its own for each network being built, as an IBuilder must not be used from several
+//! threads at once. The logger given to the parser is also called from all workers.
+//!
+class ISubGraphBuilder
+{
+public:
+    //!
+    //! \brief Create the empty explicit batch network to import subgraph \p index of the collection into.
+    //!
+    //! The network is owned by the application and must outlive its use by the parser, i.e. until the next call to
+    //! parseSubGraphs() or releaseWeightsMemory(), or the destruction of the parser.
+    //!
+    //! \return The network, or nullptr to fail the subgraph.
+    //!
+    virtual nvinfer1::INetworkDefinition* createNetwork(int64_t index) noexcept = 0;
+
+    //!
+    //! \brief Build the engine of subgraph \p index, whose nodes were all imported into \p network.
+    //!
+    //! \return false if the build failed.
+    //!
+    virtual bool buildNetwork(int64_t index, nvinfer1::INetworkDefinition& network) noexcept = 0;
+
+protected:
+    virtual ~ISubGraphBuilder() {}
+};
+
 //!
 //! \class IParser
 //!
@@ -174,7 +244,8 @@ public:
     //!         calls parse method inside.
     //!
     //! \param onnxModelFile name
-    //! \param verbosity Level
+    //! \param verbosity Level, given as the least severe nvinfer1::ILogger::Severity reported by the logger.
+    //!        Messages of lower severity are not formatted or passed to the logger during this call.
     //!
     //! \return true if the model was parsed successfully
     //!
@@ -186,6 +257,10 @@ public:
     //! 	       If the function returns True, one can proceed to engine building
     //! 	       without having to call \p parse or \p parseFromFile.
     //!
+    //! The model is imported into the network once. A node that fails to import does not stop the check: its error
+    //! is added to the parser errors, the nodes that depend on it are skipped and all other nodes are still checked,
+    //! so every failing node is reported and excluded from \p sub_graph_collection in a single call.
+    //!
     //! \param serialized_onnx_model Pointer to the serialized ONNX model
     //! \param serialized_onnx_model_size Size of the serialized ONNX model
     //!        in bytes
@@ -317,6 +392,170 @@ public:
     //! \return True if flag is set, false if unset.
     //!
     virtual bool getFlag(OnnxParserFlag onnxParserFlag) const noexcept = 0;
+
+    //!
+    //! \brief Get a report of where time was spent during the most recent call to parse(), parseFromFile() or
+    //! parseWithWeightDescriptors().
+    //!
+    //! The report is a JSON object with three arrays. "phases" lists the parse phases (deserialize, importInputs,
+    //! importInitializers, toposort, fusePatterns, markOutputs) and "nodes" lists the node importers grouped by
+    //! op_type, sorted by descending time. Each entry holds a "count", the wall time in "milliseconds" and the
+    //! "weight_bytes" of temporary weights allocated by the parser. Phases also hold the "model_bytes" of the
+    //! serialized model that was read, which is only set for deserialize. Phases are only recorded for the main graph: times of
+    //! nodes with subgraphs include the time spent importing their bodies. "patterns" lists the "name" and "count" of
+    //! the subgraphs fused with OnnxParserFlag::kFUSE_PATTERNS.
+    //!
+    //! \return A null-terminated JSON string owned by the parser, valid until the next call to this function, or
+    //! nullptr if the report could not be generated.
+    //!
+    virtual char const* getParseProfile() const noexcept = 0;
+
+    //!
+    //! \brief Load the initializers of an ONNX model with the same topology as the parsed one as refit weights.
+    //!
+    //! Initializers are converted exactly as during parsing, including the narrowing of INT64 and DOUBLE data and the
+    //! loading of external weights, which are looked up relative to \p model_path, or to the parsed model if
+    //! \p model_path is null. Only the initializers of the main graph are loaded, not those of subgraphs.
+    //! Replaces the weights of any earlier call.
+    //!
+    //! \param serialized_onnx_model Pointer to the serialized ONNX model
+    //! \param serialized_onnx_model_size Size of the serialized ONNX model in bytes
+    //! \param model_path Absolute path to the model file for loading external weights if required
+    //! \return true if the weights were loaded, false if the model could not be read, its topology or initializer
+    //! shapes differ from the parsed model, or an initializer could not be converted.
+    //!
+    //! \see getNbRefitWeights() applyRefitWeights()
+    //!
+    virtual bool loadRefitWeights(void const* serialized_onnx_model, size_t serialized_onnx_model_size,
+        char const* model_path = nullptr) noexcept = 0;
+
+    //!
+    //! \brief Get the number of weights loaded by the last call to loadRefitWeights().
+    //!
+    virtual int64_t getNbRefitWeights() const noexcept = 0;
+
+    //!
+    //! \brief Get the name of a loaded refit weight, which is the name of its initializer and of the network weights
+    //! it replaces.
+    //!
+    //! \return The name, or nullptr if \p index is out of range.
+    //!
+    virtual char const* getRefitWeightsName(int64_t index) const noexcept = 0;
+
+    //!
+    //! \brief Get the values of a loaded refit weight.
+    //!
+    //! The values are owned by the parser and stay valid until the next call to loadRefitWeights() or until the
+    //! parser is destroyed.
+    //!
+    //! \return The weights, or empty weights if \p index is out of range.
+    //!
+    virtual nvinfer1::Weights getRefitWeights(int64_t index) const noexcept = 0;
+
+    //!
+    //! \brief Set every loaded weight known to \p refitter with IRefitter::setNamedWeights().
+    //!
+    //! Refittable weights of the engine that have no loaded counterpart, such as weights folded from several
+    //! initializers by an importer, are reported with a warning and left unset. Call IRefitter::refitCudaEngine()
+    //! afterwards.
+    //!
+    //! \return false if the refitter rejected any of the weights.
+    //!
+    virtual bool applyRefitWeights(nvinfer1::IRefitter& refitter) noexcept = 0;
+
+    //!
+    //! \brief Free the host memory the parser only needs while parsing.
+    //!
+    //! Drops the name and tensor tables of the importer and the data of initializers the network does not point to,
+    //! i.e. initializers that were never used or that were converted into separate buffers. The network stays valid
+    //! and can still be built. Call after parse(), parseFromFile() or parseWithWeightDescriptors().
+    //!
+    //! \see releaseWeightsMemory()
+    //!
+    virtual void releaseParseState() noexcept = 0;
+
+    //!
+    //! \brief Free all host memory backing the weights of the parsed network.
+    //!
+    //! Releases the deserialized models, the buffers of converted weights and the mappings of external weights
+    //! files. Implies releaseParseState(). Only call this once every engine has been built from the network: the
+    //! network refers to the released weights and must not be built again afterwards. Refit weights loaded with
+    //! loadRefitWeights() are not affected.
+    //!
+    //! \see releaseParseState()
+    //!
+    virtual void releaseWeightsMemory() noexcept = 0;
+
+    //!
+    //! \brief Parse an ONNX model file like parseFromFile(), using a snapshot of an earlier parse when possible.
+    //!
+    //! A snapshot holds the graph of the model and the converted values of all its initializers, so that importing it
+    //! skips the deserialization of the weights and their conversion, e.g. the narrowing of INT64 and DOUBLE data:
+    //! the network is built from weights mapped straight from the snapshot. The nodes are still imported.
+    //!
+    //! If \p snapshotFile was written for the same contents of \p onnxModelFile by the same parser version, and the
+    //! external weights files of the model have not changed since, the snapshot is imported. Otherwise the model
+    //! file is parsed and the snapshot is rewritten. Failing to write the snapshot is reported as a warning and does
+    //! not fail the parse.
+    //!
+    //! The snapshot must stay in place as long as the network is used. When the network was imported from a
+    //! snapshot, pass the path of the model to loadRefitWeights() for refit models with external weights.
+    //!
+    //! \param onnxModelFile Path to the binary ONNX model file
+    //! \param snapshotFile Path to the snapshot to read or write, or nullptr to behave like parseFromFile()
+    //! \param verbosity Level, given as the least severe nvinfer1::ILogger::Severity reported by the logger.
+    //!
+    //! \return true if the model was parsed successfully
+    //!
+    //! \see parseFromFile()
+    //!
+    virtual bool parseFromFileWithSnapshot(
+        char const* onnxModelFile, char const* snapshotFile, int32_t verbosity) noexcept = 0;
+
+    //!
+    //! \brief Import the subgraphs of an ONNX model into networks of their own and build them, in parallel.
+    //!
+    //! Every subgraph of \p sub_graph_collection, as returned by supportsModel(), is imported on a worker thread into
+    //! the network returned by ISubGraphBuilder::createNetwork(), and handed to ISubGraphBuilder::buildNetwork() once
+    //! imported. The model is deserialized and its initializers converted once, and all networks refer to the same
+    //! weights. Tensors read by a subgraph from the rest of the model become inputs of its network, and tensors it
+    //! produces for the rest of the model or as outputs of the model become outputs of its network, keeping their
+    //! names. Their types and shapes are taken from the inputs, outputs and value_info of the graph, so run ONNX
+    //! shape inference on models that lack them.
+    //!
+    //! A subgraph that fails does not stop the others. Its errors are added to the parser errors with the node
+    //! indices of the model. The network of this parser is not used. The networks stay valid until the next call or
+    //! releaseWeightsMemory(), and loadRefitWeights() checks refit models against the whole model.
+    //!
+    //! \param serialized_onnx_model Pointer to the serialized ONNX model
+    //! \param serialized_onnx_model_size Size of the serialized ONNX model in bytes
+    //! \param sub_graph_collection Subgraphs to import, given as node indices of the model in topological order
+    //! \param builder Callbacks creating and building the network of each subgraph
+    //! \param nbThreads Number of worker threads, or 0 for one per hardware thread. No more threads than subgraphs
+    //!        are started.
+    //! \param model_path Absolute path to the model file for loading external weights if required
+    //! \return true if every subgraph was imported and built.
+    //!
+    //! \see supportsModel() getNbErrors() getError()
+    //!
+    virtual bool parseSubGraphs(void const* serialized_onnx_model, size_t serialized_onnx_model_size,
+        SubGraphCollection_t const& sub_graph_collection, ISubGraphBuilder& builder, int32_t nbThreads = 0,
+        char const* model_path = nullptr) noexcept = 0;
+
+    //!
+    //! \brief Set the least severe level of the messages the logger reports.
+    //!
+    //! Messages of lower severity are not formatted or passed to the logger by any call of the parser, which saves
+    //! most of the logging overhead on large models. Defaults to kVERBOSE, i.e. every message is passed to the
+    //! logger. The verbosity given to parseFromFile() or parseFromFileWithSnapshot() applies instead for the
+    //! duration of those calls.
+    //!
+    virtual void setLoggerSeverity(nvinfer1::ILogger::Severity severity) noexcept = 0;
+
+    //!
+    //! \brief Get the severity set with setLoggerSeverity().
+    //!
+    virtual nvinfer1::ILogger::Severity getLoggerSeverity() const noexcept = 0;
 };
 
 } // namespace nvonnxparser
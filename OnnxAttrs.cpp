@@ -8,19 +8,19 @@
 #include <onnx/onnx_pb.h>
 
 template <>
-float OnnxAttrs::get<float>(const std::string& key) const
+float OnnxAttrs::get<float>(std::string_view key) const
 {
     return this->at(key)->f();
 }
 
 template <>
-int OnnxAttrs::get<int>(const std::string& key) const
+int OnnxAttrs::get<int>(std::string_view key) const
 {
     return this->at(key)->i();
 }
 
 template <>
-bool OnnxAttrs::get<bool>(const std::string& key) const
+bool OnnxAttrs::get<bool>(std::string_view key) const
 {
     int value = this->at(key)->i();
     assert(value == bool(value));
@@ -28,34 +28,34 @@ bool OnnxAttrs::get<bool>(const std::string& key) const
 }
 
 template <>
-std::string OnnxAttrs::get<std::string>(const std::string& key) const
+std::string OnnxAttrs::get<std::string>(std::string_view key) const
 {
     return this->at(key)->s();
 }
 
 template <>
-std::vector<int> OnnxAttrs::get<std::vector<int>>(const std::string& key) const
+std::vector<int> OnnxAttrs::get<std::vector<int>>(std::string_view key) const
 {
-    auto attr = this->at(key)->ints();
+    auto const& attr = this->at(key)->ints();
     return std::vector<int>(attr.begin(), attr.end());
 }
 
 template <>
-std::vector<int64_t> OnnxAttrs::get<std::vector<int64_t>>(const std::string& key) const
+std::vector<int64_t> OnnxAttrs::get<std::vector<int64_t>>(std::string_view key) const
 {
-    auto attr = this->at(key)->ints();
+    auto const& attr = this->at(key)->ints();
     return std::vector<int64_t>(attr.begin(), attr.end());
 }
 
 template <>
-std::vector<float> OnnxAttrs::get<std::vector<float>>(const std::string& key) const
+std::vector<float> OnnxAttrs::get<std::vector<float>>(std::string_view key) const
 {
-    auto attr = this->at(key)->floats();
+    auto const& attr = this->at(key)->floats();
     return std::vector<float>(attr.begin(), attr.end());
 }
 
 template <>
-nvinfer1::Dims OnnxAttrs::get<nvinfer1::Dims>(const std::string& key) const
+nvinfer1::Dims OnnxAttrs::get<nvinfer1::Dims>(std::string_view key) const
 {
     auto values = this->get<std::vector<int>>(key);
     nvinfer1::Dims dims;
@@ -66,7 +66,7 @@ nvinfer1::Dims OnnxAttrs::get<nvinfer1::Dims>(const std::string& key) const
 }
 
 template <>
-nvinfer1::DimsHW OnnxAttrs::get<nvinfer1::DimsHW>(const std::string& key) const
+nvinfer1::DimsHW OnnxAttrs::get<nvinfer1::DimsHW>(std::string_view key) const
 {
     nvinfer1::Dims dims = this->get<nvinfer1::Dims>(key);
     assert(dims.nbDims == 2);
@@ -74,7 +74,7 @@ nvinfer1::DimsHW OnnxAttrs::get<nvinfer1::DimsHW>(const std::string& key) const
 }
 
 template <>
-nvinfer1::Permutation OnnxAttrs::get<nvinfer1::Permutation>(const std::string& key) const
+nvinfer1::Permutation OnnxAttrs::get<nvinfer1::Permutation>(std::string_view key) const
 {
     auto values = this->get<std::vector<int>>(key);
     nvinfer1::Permutation perm;
@@ -88,7 +88,7 @@ nvinfer1::Permutation OnnxAttrs::get<nvinfer1::Permutation>(const std::string& k
 }
 
 template <>
-onnx2trt::ShapedWeights OnnxAttrs::get<onnx2trt::ShapedWeights>(const std::string& key) const
+onnx2trt::ShapedWeights OnnxAttrs::get<onnx2trt::ShapedWeights>(std::string_view key) const
 {
     ::ONNX_NAMESPACE::TensorProto const& onnx_weights_tensor = this->at(key)->t();
     onnx2trt::ShapedWeights weights;
@@ -101,7 +101,7 @@ onnx2trt::ShapedWeights OnnxAttrs::get<onnx2trt::ShapedWeights>(const std::strin
 }
 
 template <>
-nvinfer1::DataType OnnxAttrs::get<nvinfer1::DataType>(const std::string& key) const
+nvinfer1::DataType OnnxAttrs::get<nvinfer1::DataType>(std::string_view key) const
 {
     ::ONNX_NAMESPACE::TensorProto::DataType onnx_dtype
         = static_cast<::ONNX_NAMESPACE::TensorProto::DataType>(this->at(key)->i());
@@ -114,9 +114,9 @@ nvinfer1::DataType OnnxAttrs::get<nvinfer1::DataType>(const std::string& key) co
 }
 
 template <>
-std::vector<nvinfer1::DataType> OnnxAttrs::get<std::vector<nvinfer1::DataType>>(const std::string& key) const
+std::vector<nvinfer1::DataType> OnnxAttrs::get<std::vector<nvinfer1::DataType>>(std::string_view key) const
 {
-    auto attr = this->at(key)->ints();
+    auto const& attr = this->at(key)->ints();
     auto onnx_dtypes = std::vector<int64_t>(attr.begin(), attr.end());
     std::vector<nvinfer1::DataType> dtypes{};
     for (auto onnx_dtype : onnx_dtypes)
@@ -177,7 +177,7 @@ inline nvinfer1::ActivationType activationStringToEnum(const std::string& type)
 }
 
 template <>
-nvinfer1::ActivationType OnnxAttrs::get<nvinfer1::ActivationType>(const std::string& key) const
+nvinfer1::ActivationType OnnxAttrs::get<nvinfer1::ActivationType>(std::string_view key) const
 {
     const std::string type = this->get<std::string>(key);
     return activationStringToEnum(type);
@@ -185,9 +185,9 @@ nvinfer1::ActivationType OnnxAttrs::get<nvinfer1::ActivationType>(const std::str
 
 template <>
 std::vector<nvinfer1::ActivationType> OnnxAttrs::get<std::vector<nvinfer1::ActivationType>>(
-    const std::string& key) const
+    std::string_view key) const
 {
-    const auto strings = this->at(key)->strings();
+    auto const& strings = this->at(key)->strings();
     std::vector<nvinfer1::ActivationType> actTypes;
     for (const auto& str : strings)
     {
@@ -197,13 +197,13 @@ std::vector<nvinfer1::ActivationType> OnnxAttrs::get<std::vector<nvinfer1::Activ
 }
 
 template <>
-const ::ONNX_NAMESPACE::GraphProto& OnnxAttrs::get<const ::ONNX_NAMESPACE::GraphProto&>(const std::string& key) const
+const ::ONNX_NAMESPACE::GraphProto& OnnxAttrs::get<const ::ONNX_NAMESPACE::GraphProto&>(std::string_view key) const
 {
     return this->at(key)->g();
 }
 
 template <>
-nvinfer1::RNNOperation OnnxAttrs::get<nvinfer1::RNNOperation>(const std::string& key) const
+nvinfer1::RNNOperation OnnxAttrs::get<nvinfer1::RNNOperation>(std::string_view key) const
 {
     std::string op = this->get<std::string>(key);
     if (op == std::string("relu"))
@@ -226,7 +226,7 @@ nvinfer1::RNNOperation OnnxAttrs::get<nvinfer1::RNNOperation>(const std::string&
 }
 
 template <>
-nvinfer1::RNNInputMode OnnxAttrs::get<nvinfer1::RNNInputMode>(const std::string& key) const
+nvinfer1::RNNInputMode OnnxAttrs::get<nvinfer1::RNNInputMode>(std::string_view key) const
 {
     std::string mode = this->get<std::string>(key);
     if (mode == std::string("skip"))
@@ -241,7 +241,7 @@ nvinfer1::RNNInputMode OnnxAttrs::get<nvinfer1::RNNInputMode>(const std::string&
 }
 
 template <>
-nvinfer1::RNNDirection OnnxAttrs::get<nvinfer1::RNNDirection>(const std::string& key) const
+nvinfer1::RNNDirection OnnxAttrs::get<nvinfer1::RNNDirection>(std::string_view key) const
 {
     std::string direction = this->get<std::string>(key);
     if (direction == std::string("unidirection"))
@@ -256,14 +256,14 @@ nvinfer1::RNNDirection OnnxAttrs::get<nvinfer1::RNNDirection>(const std::string&
 }
 
 template <>
-std::vector<std::string> OnnxAttrs::get<std::vector<std::string>>(const std::string& key) const
+std::vector<std::string> OnnxAttrs::get<std::vector<std::string>>(std::string_view key) const
 {
-    auto attr = this->at(key)->strings();
+    auto const& attr = this->at(key)->strings();
     return std::vector<std::string>(attr.begin(), attr.end());
 }
 
 template <>
-nvinfer1::ScaleMode OnnxAttrs::get<nvinfer1::ScaleMode>(const std::string& key) const
+nvinfer1::ScaleMode OnnxAttrs::get<nvinfer1::ScaleMode>(std::string_view key) const
 {
     std::string s = this->get<std::string>(key);
     if (s == "uniform")
@@ -282,7 +282,7 @@ nvinfer1::ScaleMode OnnxAttrs::get<nvinfer1::ScaleMode>(const std::string& key)
 }
 
 template <>
-nvinfer1::MatrixOperation OnnxAttrs::get<nvinfer1::MatrixOperation>(const std::string& key) const
+nvinfer1::MatrixOperation OnnxAttrs::get<nvinfer1::MatrixOperation>(std::string_view key) const
 {
     std::string s = this->get<std::string>(key);
     if (s == "none")
@@ -301,7 +301,7 @@ nvinfer1::MatrixOperation OnnxAttrs::get<nvinfer1::MatrixOperation>(const std::s
 }
 
 template <>
-nvinfer1::ResizeMode OnnxAttrs::get<nvinfer1::ResizeMode>(const std::string& key) const
+nvinfer1::ResizeMode OnnxAttrs::get<nvinfer1::ResizeMode>(std::string_view key) const
 {
     const auto& mode = this->get<std::string>(key);
     if (mode == "nearest")
@@ -317,7 +317,7 @@ nvinfer1::ResizeMode OnnxAttrs::get<nvinfer1::ResizeMode>(const std::string& key
 
 template <>
 nvinfer1::ResizeCoordinateTransformation OnnxAttrs::get<nvinfer1::ResizeCoordinateTransformation>(
-    const std::string& key) const
+    std::string_view key) const
 {
     const auto& transformation = this->get<std::string>(key);
     if (transformation == "align_corners")
@@ -336,7 +336,7 @@ nvinfer1::ResizeCoordinateTransformation OnnxAttrs::get<nvinfer1::ResizeCoordina
 }
 
 template <>
-nvinfer1::ResizeSelector OnnxAttrs::get<nvinfer1::ResizeSelector>(const std::string& key) const
+nvinfer1::ResizeSelector OnnxAttrs::get<nvinfer1::ResizeSelector>(std::string_view key) const
 {
     const auto& selector = this->get<std::string>(key);
     if (selector == "formula")
@@ -351,7 +351,7 @@ nvinfer1::ResizeSelector OnnxAttrs::get<nvinfer1::ResizeSelector>(const std::str
 }
 
 template <>
-nvinfer1::ResizeRoundMode OnnxAttrs::get<nvinfer1::ResizeRoundMode>(const std::string& key) const
+nvinfer1::ResizeRoundMode OnnxAttrs::get<nvinfer1::ResizeRoundMode>(std::string_view key) const
 {
     const auto& roundMode = this->get<std::string>(key);
     if (roundMode == "half_up")
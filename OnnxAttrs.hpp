@@ -6,55 +6,85 @@
 
 #include <NvInfer.h>
 #include <onnx/onnx_pb.h>
-#include <unordered_map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 #include <vector>
 
 #include "ImporterContext.hpp"
 
+//! Attributes of a node, looked up by name.
+//!
+//! Nodes have few attributes, so lookups scan the attributes of the node instead of building an index: constructing
+//! an OnnxAttrs allocates nothing and keys are compared as views.
 class OnnxAttrs
 {
-    template <typename T>
-    using string_map = std::unordered_map<std::string, T>;
-    typedef string_map<::ONNX_NAMESPACE::AttributeProto const*> AttrMap;
-    AttrMap _attrs;
+    ::google::protobuf::RepeatedPtrField<::ONNX_NAMESPACE::AttributeProto> const& mAttrs;
     onnx2trt::IImporterContext* mCtx;
 
-public:
-    explicit OnnxAttrs(::ONNX_NAMESPACE::NodeProto const& onnx_node, onnx2trt::IImporterContext* ctx)
-        : mCtx{ctx}
+    ::ONNX_NAMESPACE::AttributeProto const* find(std::string_view key) const
     {
-        for (auto const& attr : onnx_node.attribute())
+        for (auto const& attr : mAttrs)
         {
-            _attrs.insert({attr.name(), &attr});
+            if (attr.name() == key)
+            {
+                return &attr;
+            }
         }
+        return nullptr;
+    }
+
+public:
+    explicit OnnxAttrs(::ONNX_NAMESPACE::NodeProto const& onnx_node, onnx2trt::IImporterContext* ctx)
+        : mAttrs{onnx_node.attribute()}
+        , mCtx{ctx}
+    {
     }
 
-    bool count(const std::string& key) const
+    bool count(std::string_view key) const
     {
-        return _attrs.count(key);
+        return find(key) != nullptr;
     }
 
-    ::ONNX_NAMESPACE::AttributeProto const* at(std::string key) const
+    ::ONNX_NAMESPACE::AttributeProto const* at(std::string_view key) const
     {
-        if (!_attrs.count(key))
+        auto const* attr = find(key);
+        if (!attr)
         {
-            throw std::out_of_range("Attribute not found: " + key);
+            throw std::out_of_range("Attribute not found: " + std::string(key));
         }
-        return _attrs.at(key);
+        return attr;
     }
 
-    ::ONNX_NAMESPACE::AttributeProto::AttributeType type(const std::string& key) const
+    ::ONNX_NAMESPACE::AttributeProto::AttributeType type(std::string_view key) const
     {
         return this->at(key)->type();
     }
 
+    //! Values of an ints attribute, without copying them.
+    ::google::protobuf::RepeatedField<int64_t> const& ints(std::string_view key) const
+    {
+        return this->at(key)->ints();
+    }
+
+    //! Values of a floats attribute, without copying them.
+    ::google::protobuf::RepeatedField<float> const& floats(std::string_view key) const
+    {
+        return this->at(key)->floats();
+    }
+
+    //! Values of a strings attribute, without copying them.
+    ::google::protobuf::RepeatedPtrField<std::string> const& strings(std::string_view key) const
+    {
+        return this->at(key)->strings();
+    }
 
     template <typename T>
-    T get(const std::string& key) const;
+    T get(std::string_view key) const;
 
     template <typename T>
-    T get(const std::string& key, T const& default_value) const
+    T get(std::string_view key, T const& default_value) const
     {
-        return _attrs.count(key) ? this->get<T>(key) : default_value;
+        return count(key) ? this->get<T>(key) : default_value;
     }
 };
@@ -0,0 +1,155 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ParseProfiler.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+
+namespace onnx2trt
+{
+
+namespace
+{
+
+void writeJsonString(std::ostream& stream, std::string const& s)
+{
+    stream << '"';
+    for (char const c : s)
+    {
+        switch (c)
+        {
+        case '"': stream << "\\\""; break;
+        case '\\': stream << "\\\\"; break;
+        case '\n': stream << "\\n"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int32_t>(c)
+                       << std::dec << std::setfill(' ');
+            }
+            else
+            {
+                stream << c;
+            }
+        }
+    }
+    stream << '"';
+}
+
+void writeRecord(std::ostream& stream, char const* key, std::string const& name, ParseProfiler::Record const& record,
+    bool withModelBytes)
+{
+    stream << "{\"" << key << "\": ";
+    writeJsonString(stream, name);
+    stream << ", \"count\": " << record.count << ", \"milliseconds\": " << record.milliseconds;
+    if (withModelBytes)
+    {
+        stream << ", \"model_bytes\": " << record.modelBytes;
+    }
+    stream << ", \"weight_bytes\": " << record.weightBytes << "}";
+}
+
+} // namespace
+
+double ParseProfiler::elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+ParseProfiler::Record& ParseProfiler::phaseRecord(std::string const& phase)
+{
+    auto iter = std::find_if(
+        mPhases.begin(), mPhases.end(), [&phase](std::pair<std::string, Record> const& p) { return p.first == phase; });
+    if (iter == mPhases.end())
+    {
+        mPhases.emplace_back(phase, Record{});
+        iter = std::prev(mPhases.end());
+    }
+    return iter->second;
+}
+
+void ParseProfiler::addPhase(std::string const& phase, Clock::time_point start, size_t weightBytes)
+{
+    double const ms = elapsedMs(start);
+    auto& record = phaseRecord(phase);
+    ++record.count;
+    record.milliseconds += ms;
+    record.weightBytes += weightBytes;
+}
+
+void ParseProfiler::addDeserialize(Clock::time_point start, size_t modelBytes)
+{
+    double const ms = elapsedMs(start);
+    auto& record = phaseRecord("deserialize");
+    ++record.count;
+    record.milliseconds += ms;
+    record.modelBytes += modelBytes;
+}
+
+void ParseProfiler::addNode(std::string const& opType, Clock::time_point start, size_t weightBytes)
+{
+    double const ms = elapsedMs(start);
+    auto& record = mNodes[opType];
+    ++record.count;
+    record.milliseconds += ms;
+    record.weightBytes += weightBytes;
+}
+
+void ParseProfiler::addPattern(std::string const& name, int64_t count)
+{
+    auto iter = std::find_if(mPatterns.begin(), mPatterns.end(),
+        [&name](std::pair<std::string, int64_t> const& p) { return p.first == name; });
+    if (iter == mPatterns.end())
+    {
+        mPatterns.emplace_back(name, 0);
+        iter = std::prev(mPatterns.end());
+    }
+    iter->second += count;
+}
+
+void ParseProfiler::clear()
+{
+    mPhases.clear();
+    mNodes.clear();
+    mPatterns.clear();
+}
+
+std::string ParseProfiler::toJson() const
+{
+    std::vector<std::pair<std::string, Record>> nodes(mNodes.begin(), mNodes.end());
+    std::sort(nodes.begin(), nodes.end(), [](std::pair<std::string, Record> const& a,
+                                              std::pair<std::string, Record> const& b) {
+        return a.second.milliseconds > b.second.milliseconds
+            || (a.second.milliseconds == b.second.milliseconds && a.first < b.first);
+    });
+
+    std::ostringstream json;
+    json << std::setprecision(6) << std::fixed;
+    json << "{\"phases\": [";
+    for (size_t i = 0; i < mPhases.size(); ++i)
+    {
+        json << (i ? ", " : "");
+        writeRecord(json, "name", mPhases[i].first, mPhases[i].second, true);
+    }
+    json << "], \"nodes\": [";
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        json << (i ? ", " : "");
+        writeRecord(json, "op_type", nodes[i].first, nodes[i].second, false);
+    }
+    json << "], \"patterns\": [";
+    for (size_t i = 0; i < mPatterns.size(); ++i)
+    {
+        json << (i ? ", " : "") << "{\"name\": ";
+        writeJsonString(json, mPatterns[i].first);
+        json << ", \"count\": " << mPatterns[i].second << "}";
+    }
+    json << "]}";
+    return json.str();
+}
+
+} // namespace onnx2trt
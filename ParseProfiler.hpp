@@ -0,0 +1,60 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace onnx2trt
+{
+
+//! Accumulates wall time and allocated bytes for the phases of a parse and for each node importer, grouped by
+//! op_type. Times of nodes with subgraphs (If, Loop, Scan) include the time spent importing their bodies, whose
+//! phases are not recorded separately.
+class ParseProfiler
+{
+public:
+    struct Record
+    {
+        int64_t count{0};
+        double milliseconds{0.0};
+        size_t modelBytes{0};  //!< Size of the serialized model that was read.
+        size_t weightBytes{0}; //!< Temporary weights allocated by the parser.
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    void addPhase(std::string const& phase, Clock::time_point start, size_t weightBytes = 0);
+
+    //! Add the "deserialize" phase, which read a serialized model of modelBytes.
+    void addDeserialize(Clock::time_point start, size_t modelBytes);
+
+    void addNode(std::string const& opType, Clock::time_point start, size_t weightBytes = 0);
+
+    //! Add count matches of the fusion pattern name.
+    void addPattern(std::string const& name, int64_t count);
+
+    void clear();
+
+    //! Serialize the records as a JSON object with a "phases" array, in the order phases were first recorded,
+    //! a "nodes" array sorted by descending time and a "patterns" array in the order patterns were first recorded.
+    std::string toJson() const;
+
+private:
+    static double elapsedMs(Clock::time_point start);
+
+    Record& phaseRecord(std::string const& phase);
+
+    std::vector<std::pair<std::string, Record>> mPhases;
+    std::unordered_map<std::string, Record> mNodes;
+    std::vector<std::pair<std::string, int64_t>> mPatterns;
+};
+
+} // namespace onnx2trt
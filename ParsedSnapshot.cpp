@@ -0,0 +1,471 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ParsedSnapshot.hpp"
+#include "NvOnnxParser.h"
+#include "onnx2trt_utils.hpp"
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sys/stat.h>
+#include <vector>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace onnx2trt
+{
+
+namespace
+{
+
+constexpr char kSNAPSHOT_MAGIC[8] = {'T', 'R', 'T', 'O', 'N', 'N', 'X', 'S'};
+constexpr uint32_t kSNAPSHOT_FORMAT_VERSION{1};
+//! The first weights start on a page boundary and every other one on a cache line, so mapped values are aligned for
+//! any type.
+constexpr uint64_t kWEIGHTS_OFFSET{4096};
+constexpr uint64_t kWEIGHTS_ALIGNMENT{64};
+//! Prefix of the metadata entries recording the size and modification time of the external weights files of the
+//! model when the snapshot was written.
+constexpr char kEXTERNAL_FILE_KEY[] = "onnx2trt.snapshot.external_file:";
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t formatVersion;
+    uint32_t parserVersion;
+    uint64_t modelHash;
+    uint64_t modelOffset;
+    uint64_t modelSize;
+};
+
+//! Same mixing as the hash of deduplicated weights, eight bytes at a time.
+class Hasher
+{
+public:
+    void mix(uint64_t value)
+    {
+        mHash = (mHash ^ value) * kPRIME;
+        mHash ^= mHash >> 32;
+    }
+
+    void mix(char const* bytes, size_t size)
+    {
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, sizeof(word));
+            mix(word);
+        }
+        for (; i < size; ++i)
+        {
+            mix(static_cast<uint8_t>(bytes[i]));
+        }
+    }
+
+    uint64_t value() const
+    {
+        return mHash;
+    }
+
+private:
+    static constexpr uint64_t kPRIME{0x100000001b3ULL};
+    uint64_t mHash{0xcbf29ce484222325ULL};
+};
+
+//! Path of file in the directory of path, the way external weights are located relative to the model.
+std::string siblingPath(std::string const& path, std::string const& file)
+{
+#if defined(_WIN32)
+    size_t const slash = path.find_last_of("\\/");
+#else
+    size_t const slash = path.rfind('/');
+#endif
+    return slash == std::string::npos ? file : path.substr(0, slash + 1) + file;
+}
+
+std::string baseName(std::string const& path)
+{
+#if defined(_WIN32)
+    size_t const slash = path.find_last_of("\\/");
+#else
+    size_t const slash = path.rfind('/');
+#endif
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+//! Size and modification time of a file, or an empty string if it does not exist.
+std::string fileStamp(std::string const& path)
+{
+    struct stat sb;
+    if (stat(path.c_str(), &sb) != 0)
+    {
+        return {};
+    }
+    return std::to_string(static_cast<int64_t>(sb.st_size)) + ":" + std::to_string(static_cast<int64_t>(sb.st_mtime));
+}
+
+std::string externalLocation(::ONNX_NAMESPACE::TensorProto const& tensor)
+{
+    for (auto const& entry : tensor.external_data())
+    {
+        if (entry.key() == "location")
+        {
+            return entry.value();
+        }
+    }
+    return {};
+}
+
+void addExternalData(::ONNX_NAMESPACE::TensorProto& tensor, std::string const& key, std::string const& value)
+{
+    auto* entry = tensor.add_external_data();
+    entry->set_key(key);
+    entry->set_value(value);
+}
+
+//! Sequential writer of weights at aligned offsets of the snapshot file.
+class WeightsWriter
+{
+public:
+    WeightsWriter(std::ofstream& file, std::string location)
+        : mFile(file)
+        , mLocation(std::move(location))
+    {
+    }
+
+    //! Convert source with convertCtx, write its values and replace target with a tensor referring to them. source
+    //! and target may be the same tensor. Empty weights are kept inline, as a length of 0 would read to the end of
+    //! the snapshot.
+    Status append(IImporterContext* convertCtx, ::ONNX_NAMESPACE::TensorProto const& source,
+        ::ONNX_NAMESPACE::TensorProto& target)
+    {
+        auto* ctx = convertCtx;
+        ShapedWeights weights;
+        ASSERT(convertOnnxWeights(source, &weights, ctx) && "Failed to convert an initializer for the snapshot.",
+            ErrorCode::kINVALID_VALUE);
+        size_t const size = weights.size_bytes();
+        if (size == 0 || !weights.values)
+        {
+            if (&source != &target)
+            {
+                target.CopyFrom(source);
+            }
+            return Status::success();
+        }
+
+        uint64_t const offset = (mOffset + kWEIGHTS_ALIGNMENT - 1) / kWEIGHTS_ALIGNMENT * kWEIGHTS_ALIGNMENT;
+        mFile.seekp(static_cast<std::streamoff>(offset));
+        mFile.write(static_cast<char const*>(weights.values), static_cast<std::streamsize>(size));
+        ASSERT(mFile.good() && "Failed to write weights to the snapshot.", ErrorCode::kINTERNAL_ERROR);
+        mOffset = offset + size;
+
+        ::ONNX_NAMESPACE::TensorProto descriptor;
+        descriptor.set_name(source.name());
+        descriptor.set_data_type(weights.type);
+        for (int32_t i = 0; i < weights.shape.nbDims; ++i)
+        {
+            descriptor.add_dims(weights.shape.d[i]);
+        }
+        descriptor.set_data_location(::ONNX_NAMESPACE::TensorProto::EXTERNAL);
+        addExternalData(descriptor, "location", mLocation);
+        addExternalData(descriptor, "offset", std::to_string(offset));
+        addExternalData(descriptor, "length", std::to_string(size));
+        target.Swap(&descriptor);
+
+        // The converted copies are written, so drop them before converting the next initializer.
+        static_cast<ImporterContext*>(convertCtx)->releaseTempWeights();
+        return Status::success();
+    }
+
+    uint64_t end() const
+    {
+        return mOffset;
+    }
+
+private:
+    std::ofstream& mFile;
+    std::string mLocation;
+    uint64_t mOffset{kWEIGHTS_OFFSET};
+};
+
+//! Record the external weights files of graph and its subgraphs in externalFiles.
+void collectExternalFiles(::ONNX_NAMESPACE::GraphProto const& graph, std::string const& modelPath,
+    std::vector<std::string>& externalFiles)
+{
+    for (auto const& initializer : graph.initializer())
+    {
+        if (initializer.data_location() == ::ONNX_NAMESPACE::TensorProto::EXTERNAL)
+        {
+            std::string const path = siblingPath(modelPath, normalizePath(externalLocation(initializer)));
+            if (std::find(externalFiles.begin(), externalFiles.end(), path) == externalFiles.end())
+            {
+                externalFiles.push_back(path);
+            }
+        }
+    }
+    for (auto const& node : graph.node())
+    {
+        for (auto const& attribute : node.attribute())
+        {
+            if (attribute.has_g())
+            {
+                collectExternalFiles(attribute.g(), modelPath, externalFiles);
+            }
+            for (auto const& subgraph : attribute.graphs())
+            {
+                collectExternalFiles(subgraph, modelPath, externalFiles);
+            }
+        }
+    }
+}
+
+//! Move the initializers of the subgraphs of the nodes of graph into the snapshot, in place.
+Status appendSubgraphWeights(
+    IImporterContext* convertCtx, ::ONNX_NAMESPACE::GraphProto& graph, WeightsWriter& writer)
+{
+    for (auto& node : *graph.mutable_node())
+    {
+        for (auto& attribute : *node.mutable_attribute())
+        {
+            std::vector<::ONNX_NAMESPACE::GraphProto*> subgraphs;
+            if (attribute.has_g())
+            {
+                subgraphs.push_back(attribute.mutable_g());
+            }
+            for (auto& subgraph : *attribute.mutable_graphs())
+            {
+                subgraphs.push_back(&subgraph);
+            }
+            for (auto* subgraph : subgraphs)
+            {
+                for (auto& initializer : *subgraph->mutable_initializer())
+                {
+                    CHECK(writer.append(convertCtx, initializer, initializer));
+                }
+                CHECK(appendSubgraphWeights(convertCtx, *subgraph, writer));
+            }
+        }
+    }
+    return Status::success();
+}
+
+} // namespace
+
+uint64_t hashModelFile(std::string const& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return 0;
+    }
+    Hasher hasher;
+    std::vector<char> buffer(1 << 20);
+    uint64_t size{0};
+    while (file)
+    {
+        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        size_t const count = static_cast<size_t>(file.gcount());
+        // Chunks are a multiple of eight bytes, so only the tail of the file is mixed byte by byte.
+        hasher.mix(buffer.data(), count);
+        size += count;
+    }
+    if (file.bad())
+    {
+        return 0;
+    }
+    hasher.mix(size);
+    return hasher.value();
+}
+
+Status writeParsedSnapshot(IImporterContext* ctx, ::ONNX_NAMESPACE::ModelProto& model, std::string const& modelPath,
+    uint64_t modelHash, std::string const& snapshotPath)
+{
+    // Copy everything but the initializers of the main graph, which are by far the largest part of most models and
+    // are converted straight from the model below.
+    ::ONNX_NAMESPACE::ModelProto snapshot;
+    {
+        ::google::protobuf::RepeatedPtrField<::ONNX_NAMESPACE::TensorProto> initializers;
+        initializers.Swap(model.mutable_graph()->mutable_initializer());
+        try
+        {
+            snapshot.CopyFrom(model);
+        }
+        catch (...)
+        {
+            initializers.Swap(model.mutable_graph()->mutable_initializer());
+            throw;
+        }
+        initializers.Swap(model.mutable_graph()->mutable_initializer());
+    }
+
+    std::vector<std::string> externalFiles;
+    collectExternalFiles(model.graph(), modelPath, externalFiles);
+    for (auto const& path : externalFiles)
+    {
+        auto* entry = snapshot.add_metadata_props();
+        entry->set_key(kEXTERNAL_FILE_KEY + path);
+        entry->set_value(fileStamp(path));
+    }
+
+#if defined(_WIN32)
+    std::string const tempPath = snapshotPath + ".tmp." + std::to_string(_getpid());
+#else
+    std::string const tempPath = snapshotPath + ".tmp." + std::to_string(getpid());
+#endif
+    Status status = Status::success();
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        ASSERT(file && "Failed to create the snapshot file.", ErrorCode::kINTERNAL_ERROR);
+
+        // Conversions go through a context of their own so they neither show up in the parsed network's weights nor
+        // outlive the call. Its location resolves external weights the same way the parse did.
+        ImporterContext convertCtx(nullptr, &ctx->logger());
+        convertCtx.setOnnxFileLocation(modelPath);
+        WeightsWriter writer(file, baseName(snapshotPath));
+
+        auto const& initializers = model.graph().initializer();
+        auto* snapshotInitializers = snapshot.mutable_graph()->mutable_initializer();
+        snapshotInitializers->Reserve(initializers.size());
+        for (auto const& initializer : initializers)
+        {
+            status = writer.append(&convertCtx, initializer, *snapshotInitializers->Add());
+            if (status.is_error())
+            {
+                break;
+            }
+        }
+        if (status.is_success())
+        {
+            status = appendSubgraphWeights(&convertCtx, *snapshot.mutable_graph(), writer);
+        }
+        if (status.is_success())
+        {
+            std::string serialized;
+            if (!snapshot.SerializeToString(&serialized))
+            {
+                status = MAKE_ERROR("Failed to serialize the snapshot model.", ErrorCode::kINTERNAL_ERROR);
+            }
+            else
+            {
+                SnapshotHeader header{};
+                std::memcpy(header.magic, kSNAPSHOT_MAGIC, sizeof(header.magic));
+                header.formatVersion = kSNAPSHOT_FORMAT_VERSION;
+                header.parserVersion = static_cast<uint32_t>(NV_ONNX_PARSER_VERSION);
+                header.modelHash = modelHash;
+                header.modelOffset = writer.end();
+                header.modelSize = serialized.size();
+                file.seekp(static_cast<std::streamoff>(header.modelOffset));
+                file.write(serialized.data(), static_cast<std::streamsize>(serialized.size()));
+                file.seekp(0);
+                file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+                file.close();
+                if (!file)
+                {
+                    status = MAKE_ERROR("Failed to write the snapshot file.", ErrorCode::kINTERNAL_ERROR);
+                }
+            }
+        }
+    }
+    if (status.is_success())
+    {
+#if defined(_WIN32)
+        // rename() does not replace an existing file on Windows.
+        std::remove(snapshotPath.c_str());
+#endif
+        if (std::rename(tempPath.c_str(), snapshotPath.c_str()) != 0)
+        {
+            status = MAKE_ERROR("Failed to move the snapshot into place.", ErrorCode::kINTERNAL_ERROR);
+        }
+    }
+    if (status.is_error())
+    {
+        std::remove(tempPath.c_str());
+        return status;
+    }
+    LOG_VERBOSE("Wrote the parsed snapshot " << snapshotPath << " of " << modelPath);
+    return Status::success();
+}
+
+bool readParsedSnapshot(IImporterContext* ctx, std::string const& snapshotPath, uint64_t modelHash,
+    ::ONNX_NAMESPACE::ModelProto& model, size_t* modelBytes)
+{
+    std::ifstream file(snapshotPath, std::ios::binary);
+    if (!file)
+    {
+        LOG_VERBOSE("No parsed snapshot at " << snapshotPath);
+        return false;
+    }
+    file.seekg(0, std::ios::end);
+    uint64_t const fileSize = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+
+    SnapshotHeader header{};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, kSNAPSHOT_MAGIC, sizeof(header.magic)) != 0
+        || header.formatVersion != kSNAPSHOT_FORMAT_VERSION || header.modelOffset > fileSize
+        || header.modelSize > fileSize - header.modelOffset
+        || header.modelSize > static_cast<uint64_t>(std::numeric_limits<int>::max()))
+    {
+        LOG_WARNING("Ignoring " << snapshotPath << ", which is not a parsed snapshot of a supported format.");
+        return false;
+    }
+    if (header.parserVersion != static_cast<uint32_t>(NV_ONNX_PARSER_VERSION) || header.modelHash != modelHash)
+    {
+        LOG_VERBOSE("The parsed snapshot " << snapshotPath << " was written by another parser version or for another "
+                                           << "model.");
+        return false;
+    }
+
+    std::vector<char> serialized(header.modelSize);
+    file.seekg(static_cast<std::streamoff>(header.modelOffset));
+    file.read(serialized.data(), static_cast<std::streamsize>(serialized.size()));
+    if (!file)
+    {
+        LOG_WARNING("Failed to read the model of the parsed snapshot " << snapshotPath);
+        return false;
+    }
+    google::protobuf::io::ArrayInputStream rawInput(serialized.data(), static_cast<int>(serialized.size()));
+    google::protobuf::io::CodedInputStream codedInput(&rawInput);
+#if GOOGLE_PROTOBUF_VERSION >= 3011000
+    codedInput.SetTotalBytesLimit(std::numeric_limits<int>::max());
+#else
+    codedInput.SetTotalBytesLimit(std::numeric_limits<int>::max(), std::numeric_limits<int>::max() / 4);
+#endif
+    if (!model.ParseFromCodedStream(&codedInput))
+    {
+        LOG_WARNING("Failed to deserialize the model of the parsed snapshot " << snapshotPath);
+        return false;
+    }
+
+    size_t const keyLength = std::strlen(kEXTERNAL_FILE_KEY);
+    for (auto const& entry : model.metadata_props())
+    {
+        if (entry.key().compare(0, keyLength, kEXTERNAL_FILE_KEY) == 0
+            && fileStamp(entry.key().substr(keyLength)) != entry.value())
+        {
+            LOG_VERBOSE("The parsed snapshot " << snapshotPath << " is older than the external weights file "
+                                               << entry.key().substr(keyLength));
+            model.Clear();
+            return false;
+        }
+    }
+    if (modelBytes)
+    {
+        *modelBytes = serialized.size();
+    }
+    return true;
+}
+
+} // namespace onnx2trt
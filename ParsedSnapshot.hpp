@@ -0,0 +1,40 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Snapshots of parsed models that skip the deserialization and conversion of their weights on later parses.
+ *
+ */
+
+#pragma once
+
+#include "ImporterContext.hpp"
+#include <cstdint>
+#include <onnx/onnx_pb.h>
+#include <string>
+
+namespace onnx2trt
+{
+
+//! A snapshot file holds a header, the converted values of every initializer of a model at aligned offsets and the
+//! model itself, with each initializer rewritten to refer to its values in the snapshot as external data. Importing
+//! the snapshot's model maps the values in place instead of deserializing and converting them.
+
+//! Hash of the contents of the file at path, or 0 if it cannot be read.
+uint64_t hashModelFile(std::string const& path);
+
+//! Write a snapshot of model, which was parsed from modelPath with the contents hashed to modelHash, to
+//! snapshotPath. Initializers of the main graph and of all subgraphs are converted exactly as convertOnnxWeights()
+//! does, external weights being read relative to modelPath. The model is left unchanged. The snapshot is written to a
+//! temporary file first and renamed, so readers never see a partial snapshot.
+Status writeParsedSnapshot(IImporterContext* ctx, ::ONNX_NAMESPACE::ModelProto& model, std::string const& modelPath,
+    uint64_t modelHash, std::string const& snapshotPath);
+
+//! Read the model of the snapshot at snapshotPath into model. Returns false without logging an error if there is no
+//! such snapshot, or if it was written by another parser version, for a model with another hash or before an external
+//! weights file of the model changed. The initializer values are not read: import the model with the ONNX file
+//! location set to snapshotPath so they are mapped from the snapshot. The size of the serialized model that was read
+//! is returned in modelBytes, if set.
+bool readParsedSnapshot(IImporterContext* ctx, std::string const& snapshotPath, uint64_t modelHash,
+    ::ONNX_NAMESPACE::ModelProto& model, size_t* modelBytes = nullptr);
+
+} // namespace onnx2trt
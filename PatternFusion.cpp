@@ -0,0 +1,444 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "PatternFusion.hpp"
+#include "OnnxAttrs.hpp"
+#include "onnx2trt_utils.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+namespace onnx2trt
+{
+
+namespace
+{
+
+constexpr int64_t kNO_NODE = -1;
+
+bool isDefaultDomain(::ONNX_NAMESPACE::NodeProto const& node)
+{
+    return node.domain().empty() || node.domain() == "ai.onnx";
+}
+
+//! Producers, consumers and constant values of the tensors of a graph. Names are views into the graph, which must
+//! outlive the index.
+class GraphIndex
+{
+public:
+    explicit GraphIndex(::ONNX_NAMESPACE::GraphProto const& graph)
+        : mGraph(graph)
+    {
+        for (auto const& initializer : graph.initializer())
+        {
+            mConstants.emplace(initializer.name(), &initializer);
+        }
+        for (int32_t i = 0; i < graph.node().size(); ++i)
+        {
+            auto const& node = graph.node(i);
+            for (auto const& output : node.output())
+            {
+                mProducers.emplace(output, i);
+            }
+            for (auto const& input : node.input())
+            {
+                if (!input.empty())
+                {
+                    mConsumers[input].push_back(i);
+                }
+            }
+            if (node.op_type() == "Constant" && isDefaultDomain(node) && node.output().size() == 1)
+            {
+                for (auto const& attr : node.attribute())
+                {
+                    if (attr.name() == "value" && attr.has_t())
+                    {
+                        mConstants.emplace(node.output(0), &attr.t());
+                    }
+                }
+            }
+            pinSubgraphInputs(node);
+        }
+        for (auto const& output : graph.output())
+        {
+            mPinned.insert(output.name());
+        }
+        for (auto const* infos : {&graph.input(), &graph.value_info()})
+        {
+            for (auto const& info : *infos)
+            {
+                if (info.type().has_tensor_type() && info.type().tensor_type().has_shape())
+                {
+                    mShapes.emplace(info.name(), &info.type().tensor_type().shape());
+                }
+            }
+        }
+    }
+
+    //! Index of the node of type opType in the default domain that produces tensor, or kNO_NODE.
+    int64_t producer(std::string const& tensor, char const* opType) const
+    {
+        auto const iter = mProducers.find(tensor);
+        if (iter == mProducers.end())
+        {
+            return kNO_NODE;
+        }
+        auto const& node = mGraph.node(iter->second);
+        return node.op_type() == opType && isDefaultDomain(node) ? static_cast<int64_t>(iter->second) : kNO_NODE;
+    }
+
+    //! Index of the only node that reads tensor if it is of type opType in the default domain, or kNO_NODE.
+    int64_t soleConsumer(std::string const& tensor, char const* opType) const
+    {
+        auto const iter = mConsumers.find(tensor);
+        if (mPinned.count(tensor) || iter == mConsumers.end() || iter->second.size() != 1)
+        {
+            return kNO_NODE;
+        }
+        auto const& node = mGraph.node(iter->second.front());
+        return node.op_type() == opType && isDefaultDomain(node) ? static_cast<int64_t>(iter->second.front())
+                                                                 : kNO_NODE;
+    }
+
+    //! True if tensor is only read by nodes, once per entry, and not by a nested subgraph or as a graph output.
+    bool consumedOnlyBy(std::string const& tensor, std::vector<size_t> nodes) const
+    {
+        auto const iter = mConsumers.find(tensor);
+        if (mPinned.count(tensor) || iter == mConsumers.end())
+        {
+            return false;
+        }
+        std::sort(nodes.begin(), nodes.end());
+        return iter->second == nodes;
+    }
+
+    //! Initializer or value of the Constant node named tensor, or nullptr.
+    ::ONNX_NAMESPACE::TensorProto const* constant(std::string const& tensor) const
+    {
+        auto const iter = mConstants.find(tensor);
+        return iter == mConstants.end() ? nullptr : iter->second;
+    }
+
+    //! Shape of tensor declared by a graph input or value_info, or nullptr.
+    ::ONNX_NAMESPACE::TensorShapeProto const* shape(std::string const& tensor) const
+    {
+        auto const iter = mShapes.find(tensor);
+        return iter == mShapes.end() ? nullptr : iter->second;
+    }
+
+private:
+    //! Tensors read by the subgraphs of node can neither be removed nor replaced, since the bodies are imported as
+    //! they are.
+    void pinSubgraphInputs(::ONNX_NAMESPACE::NodeProto const& node)
+    {
+        for (auto const& attr : node.attribute())
+        {
+            if (attr.has_g())
+            {
+                pinGraphInputs(attr.g());
+            }
+            for (auto const& graph : attr.graphs())
+            {
+                pinGraphInputs(graph);
+            }
+        }
+    }
+
+    void pinGraphInputs(::ONNX_NAMESPACE::GraphProto const& graph)
+    {
+        for (auto const& node : graph.node())
+        {
+            mPinned.insert(node.input().begin(), node.input().end());
+            pinSubgraphInputs(node);
+        }
+        for (auto const& output : graph.output())
+        {
+            mPinned.insert(output.name());
+        }
+    }
+
+    ::ONNX_NAMESPACE::GraphProto const& mGraph;
+    std::unordered_map<std::string_view, size_t> mProducers;
+    std::unordered_map<std::string_view, std::vector<size_t>> mConsumers;
+    std::unordered_map<std::string_view, ::ONNX_NAMESPACE::TensorProto const*> mConstants;
+    std::unordered_map<std::string_view, ::ONNX_NAMESPACE::TensorShapeProto const*> mShapes;
+    std::unordered_set<std::string_view> mPinned;
+};
+
+//! Read a constant with a single element of type FLOAT, FLOAT16, INT32 or INT64.
+bool readScalar(IImporterContext* ctx, ::ONNX_NAMESPACE::TensorProto const* tensor, double& value)
+{
+    ShapedWeights weights;
+    if (!tensor || !convertOnnxWeights(*tensor, &weights, ctx) || weights.count() != 1)
+    {
+        return false;
+    }
+    switch (weights.type)
+    {
+    case ::ONNX_NAMESPACE::TensorProto::FLOAT: value = getSingleValueAsFloat(weights.values, false); return true;
+    case ::ONNX_NAMESPACE::TensorProto::FLOAT16: value = getSingleValueAsFloat(weights.values, true); return true;
+    case ::ONNX_NAMESPACE::TensorProto::INT32: value = *static_cast<int32_t const*>(weights.values); return true;
+    case ::ONNX_NAMESPACE::TensorProto::INT64: value = *static_cast<int64_t const*>(weights.values); return true;
+    default: return false;
+    }
+}
+
+//! Axes of a ReduceMean that keeps its dimensions and reduces trailing axes given as negative numbers, sorted. Axes are
+//! an attribute before opset 18 and a constant second input since.
+bool getTrailingReduceAxes(IImporterContext* ctx, GraphIndex const& index, ::ONNX_NAMESPACE::NodeProto const& node,
+    std::vector<int64_t>& axes)
+{
+    OnnxAttrs attrs(node, ctx);
+    if (attrs.get<int32_t>("keepdims", 1) != 1)
+    {
+        return false;
+    }
+    if (ctx->getOpsetVersion() >= 18)
+    {
+        ShapedWeights weights;
+        auto const* tensor = node.input().size() == 2 ? index.constant(node.input(1)) : nullptr;
+        if (!tensor || !convertOnnxWeights(*tensor, &weights, ctx)
+            || !weightsToVector<int64_t>(weights, &axes).is_success())
+        {
+            return false;
+        }
+    }
+    else
+    {
+        if (node.input().size() != 1 || !attrs.count("axes"))
+        {
+            return false;
+        }
+        axes = attrs.get<std::vector<int64_t>>("axes");
+    }
+    if (axes.empty())
+    {
+        return false;
+    }
+    std::sort(axes.begin(), axes.end());
+    for (size_t i = 0; i < axes.size(); ++i)
+    {
+        if (axes[i] != static_cast<int64_t>(i) - static_cast<int64_t>(axes.size()))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//! Whether tensor can be the scale or bias of a LayerNormalization of input over its nbAxes trailing axes: a FLOAT or
+//! FLOAT16 constant whose dimensions before those axes are 1, and whose dimensions on them are 1 or the dimension of
+//! input, where that is known. Anything else, such as a residual activation added after the normalization, changes
+//! the result when it is moved into the normalization.
+bool isNormalizationWeight(GraphIndex const& index, std::string const& tensor, std::string const& input, size_t nbAxes)
+{
+    auto const* weights = index.constant(tensor);
+    if (!weights
+        || (weights->data_type() != ::ONNX_NAMESPACE::TensorProto::FLOAT
+            && weights->data_type() != ::ONNX_NAMESPACE::TensorProto::FLOAT16))
+    {
+        return false;
+    }
+    auto const* inputShape = index.shape(input);
+    int32_t const rank = weights->dims().size();
+    for (int32_t i = 0; i < rank; ++i)
+    {
+        int64_t const dim = weights->dims(i);
+        // Position of the axis counted from the last one, which is 1.
+        int32_t const fromEnd = rank - i;
+        if (static_cast<size_t>(fromEnd) > nbAxes)
+        {
+            if (dim != 1)
+            {
+                return false;
+            }
+            continue;
+        }
+        if (dim == 1 || !inputShape)
+        {
+            continue;
+        }
+        int32_t const inputAxis = inputShape->dim_size() - fromEnd;
+        if (inputAxis < 0
+            || (inputShape->dim(inputAxis).has_dim_value() && inputShape->dim(inputAxis).dim_value() != dim))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//! Match the LayerNormalization pattern around the normalizing Div node at divIndex and add its replacement to plan.
+bool matchLayerNormalization(IImporterContext* ctx, ::ONNX_NAMESPACE::GraphProto const& graph, GraphIndex const& index,
+    size_t divIndex, FusionPlan& plan)
+{
+    auto const& div = graph.node(divIndex);
+    if (div.input().size() != 2 || div.output().size() != 1)
+    {
+        return false;
+    }
+    std::string const& centered = div.input(0);
+    std::string const& stdDev = div.input(1);
+    std::string const& normalized = div.output(0);
+
+    int64_t const sqrtIndex = index.producer(stdDev, "Sqrt");
+    if (sqrtIndex == kNO_NODE || graph.node(sqrtIndex).input().size() != 1)
+    {
+        return false;
+    }
+    std::string const& varianceEps = graph.node(sqrtIndex).input(0);
+
+    int64_t const addEpsIndex = index.producer(varianceEps, "Add");
+    if (addEpsIndex == kNO_NODE || graph.node(addEpsIndex).input().size() != 2)
+    {
+        return false;
+    }
+    auto const& addEps = graph.node(addEpsIndex);
+    double epsilon{0.0};
+    bool const epsFirst = readScalar(ctx, index.constant(addEps.input(0)), epsilon);
+    if (!epsFirst && !readScalar(ctx, index.constant(addEps.input(1)), epsilon))
+    {
+        return false;
+    }
+    std::string const& variance = addEps.input(epsFirst ? 1 : 0);
+
+    int64_t const varianceIndex = index.producer(variance, "ReduceMean");
+    if (varianceIndex == kNO_NODE || graph.node(varianceIndex).input().empty())
+    {
+        return false;
+    }
+    std::string const& squared = graph.node(varianceIndex).input(0);
+
+    int64_t const powIndex = index.producer(squared, "Pow");
+    if (powIndex == kNO_NODE)
+    {
+        return false;
+    }
+    auto const& pow = graph.node(powIndex);
+    double exponent{0.0};
+    if (pow.input().size() != 2 || pow.input(0) != centered || !readScalar(ctx, index.constant(pow.input(1)), exponent)
+        || exponent != 2.0)
+    {
+        return false;
+    }
+
+    int64_t const subIndex = index.producer(centered, "Sub");
+    if (subIndex == kNO_NODE || graph.node(subIndex).input().size() != 2)
+    {
+        return false;
+    }
+    std::string const& input = graph.node(subIndex).input(0);
+    std::string const& mean = graph.node(subIndex).input(1);
+
+    int64_t const meanIndex = index.producer(mean, "ReduceMean");
+    if (meanIndex == kNO_NODE || graph.node(meanIndex).input().empty() || graph.node(meanIndex).input(0) != input)
+    {
+        return false;
+    }
+
+    std::vector<int64_t> meanAxes;
+    std::vector<int64_t> varianceAxes;
+    if (!getTrailingReduceAxes(ctx, index, graph.node(meanIndex), meanAxes)
+        || !getTrailingReduceAxes(ctx, index, graph.node(varianceIndex), varianceAxes) || meanAxes != varianceAxes)
+    {
+        return false;
+    }
+
+    // The normalized tensor is scaled by a Mul and may be shifted by an Add.
+    int64_t const mulIndex = index.soleConsumer(normalized, "Mul");
+    if (mulIndex == kNO_NODE || graph.node(mulIndex).input().size() != 2 || graph.node(mulIndex).output().size() != 1)
+    {
+        return false;
+    }
+    auto const& mul = graph.node(mulIndex);
+    std::string const& scale = mul.input(0) == normalized ? mul.input(1) : mul.input(0);
+    if (scale == normalized || !isNormalizationWeight(index, scale, input, meanAxes.size()))
+    {
+        return false;
+    }
+    std::string const* bias{nullptr};
+    int64_t const biasIndex = index.soleConsumer(mul.output(0), "Add");
+    if (biasIndex != kNO_NODE && graph.node(biasIndex).input().size() == 2 && graph.node(biasIndex).output().size() == 1)
+    {
+        auto const& add = graph.node(biasIndex);
+        bias = add.input(0) == mul.output(0) ? &add.input(1) : &add.input(0);
+        // An Add of anything but a bias is left in the graph, after the fused normalization.
+        if (*bias == mul.output(0) || !isNormalizationWeight(index, *bias, input, meanAxes.size()))
+        {
+            bias = nullptr;
+        }
+    }
+
+    // Every intermediate tensor must be read by the next nodes of the pattern only.
+    std::vector<size_t> nodes{static_cast<size_t>(meanIndex), static_cast<size_t>(subIndex),
+        static_cast<size_t>(powIndex), static_cast<size_t>(varianceIndex), static_cast<size_t>(addEpsIndex),
+        static_cast<size_t>(sqrtIndex), divIndex, static_cast<size_t>(mulIndex)};
+    if (bias)
+    {
+        nodes.push_back(biasIndex);
+    }
+    if (!index.consumedOnlyBy(mean, {static_cast<size_t>(subIndex)})
+        || !index.consumedOnlyBy(centered, {static_cast<size_t>(powIndex), divIndex})
+        || !index.consumedOnlyBy(squared, {static_cast<size_t>(varianceIndex)})
+        || !index.consumedOnlyBy(variance, {static_cast<size_t>(addEpsIndex)})
+        || !index.consumedOnlyBy(varianceEps, {static_cast<size_t>(sqrtIndex)})
+        || !index.consumedOnlyBy(stdDev, {divIndex})
+        || !index.consumedOnlyBy(normalized, {static_cast<size_t>(mulIndex)}))
+    {
+        return false;
+    }
+    for (size_t const node : nodes)
+    {
+        if (plan.removed.count(node) || plan.replacements.count(node))
+        {
+            return false;
+        }
+    }
+
+    auto const& last = graph.node(nodes.back());
+    ::ONNX_NAMESPACE::NodeProto fused;
+    fused.set_name(getNodeName(last));
+    fused.set_op_type("LayerNormalization");
+    fused.add_input(input);
+    fused.add_input(scale);
+    if (bias)
+    {
+        fused.add_input(*bias);
+    }
+    fused.add_output(last.output(0));
+    auto* axisAttr = fused.add_attribute();
+    axisAttr->set_name("axis");
+    axisAttr->set_type(::ONNX_NAMESPACE::AttributeProto::INT);
+    axisAttr->set_i(meanAxes.front());
+    auto* epsilonAttr = fused.add_attribute();
+    epsilonAttr->set_name("epsilon");
+    epsilonAttr->set_type(::ONNX_NAMESPACE::AttributeProto::FLOAT);
+    epsilonAttr->set_f(static_cast<float>(epsilon));
+
+    LOG_VERBOSE("Fusing nodes " << getNodeName(graph.node(meanIndex)) << " to " << fused.name()
+                                << " into LayerNormalization.");
+    plan.replacements.emplace(nodes.back(), std::move(fused));
+    plan.removed.insert(nodes.begin(), std::prev(nodes.end()));
+    return true;
+}
+
+} // namespace
+
+void findFusions(IImporterContext* ctx, ::ONNX_NAMESPACE::GraphProto const& graph, FusionPlan& plan)
+{
+    GraphIndex const index(graph);
+    int64_t nbLayerNorms{0};
+    for (int32_t i = 0; i < graph.node().size(); ++i)
+    {
+        auto const& node = graph.node(i);
+        if (node.op_type() == "Div" && isDefaultDomain(node) && matchLayerNormalization(ctx, graph, index, i, plan))
+        {
+            ++nbLayerNorms;
+        }
+    }
+    plan.matches.emplace_back("LayerNormalization", nbLayerNorms);
+}
+
+} // namespace onnx2trt
@@ -0,0 +1,46 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Recognition of decomposed subgraphs that TensorRT implements as a single layer.
+ *
+ */
+
+#pragma once
+
+#include "ImporterContext.hpp"
+#include <onnx/onnx_pb.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace onnx2trt
+{
+
+//! Nodes of a graph to import in place of the subgraphs they fuse.
+struct FusionPlan
+{
+    //! Fused nodes by the index of the last node of the subgraph they replace. They are imported at that position of
+    //! the topological order and produce the same outputs as the node they replace.
+    std::unordered_map<size_t, ::ONNX_NAMESPACE::NodeProto> replacements;
+    //! Indices of the other nodes of the fused subgraphs, which are not imported.
+    std::unordered_set<size_t> removed;
+    //! Number of matches of each pattern, in the order the patterns are tried.
+    std::vector<std::pair<std::string, int64_t>> matches;
+};
+
+//! Find the subgraphs of graph that match a fusion pattern and fill plan with the nodes replacing them. Supported
+//! patterns are:
+//!
+//! - LayerNormalization: Mul(Div(d, Sqrt(Add(ReduceMean(Pow(d, 2)), epsilon))), scale) with an optional Add of a
+//!   bias, where d = Sub(x, ReduceMean(x)) and both ReduceMean nodes keep their dimensions and reduce the same
+//!   trailing axes given as negative numbers. scale and bias must be FLOAT or FLOAT16 initializers or Constant
+//!   outputs that only vary along the reduced axes, with the dimensions of x on them or 1; an Add of another tensor
+//!   is kept after the fused node. It is replaced by a LayerNormalization node.
+//!
+//! A subgraph only matches if none of its intermediate tensors is read by any other node, a nested subgraph or as a
+//! graph output, so that fusing it does not change the tensors the rest of the graph sees.
+void findFusions(IImporterContext* ctx, ::ONNX_NAMESPACE::GraphProto const& graph, FusionPlan& plan);
+
+} // namespace onnx2trt
@@ -10,20 +10,50 @@
 namespace onnx2trt
 {
 
-nvinfer1::ITensor* addRNNInput(IImporterContext* ctx, const ::ONNX_NAMESPACE::NodeProto& node, nvinfer1::ILoop* loop, std::vector<TensorOrWeights>& inputs, const std::string& direction)
+bool precomputeRNNInputProjection(IImporterContext* ctx)
+{
+    uint32_t const flag
+        = 1U << static_cast<uint32_t>(nvonnxparser::OnnxParserFlag::kPRECOMPUTE_RNN_INPUT_PROJECTION);
+    return ctx->getFlags() & flag;
+}
+
+nvinfer1::ITensor* addRNNInput(IImporterContext* ctx, const ::ONNX_NAMESPACE::NodeProto& node, nvinfer1::ILoop* loop, std::vector<TensorOrWeights>& inputs, const std::string& direction, nvinfer1::ITensor* projection)
 {
     // In the forward/reverse cases, we only use a single iterator. In the bidirectional case, a forward and reverse
     // iterator must be concatenated.
-    // Input dimensions: [1, B, E]
+    // Input dimensions: [1, B, E], or [1, B, G] for each direction of a projection.
     nvinfer1::ITensor* iterationInput{nullptr};
     nvinfer1::ITensor* input = &convertToTensor(inputs.at(0), ctx);
 
     const int sequenceLenIndex = 4;
     bool isRagged = inputs.size() > sequenceLenIndex && inputs.at(sequenceLenIndex);
 
+    // A projection of shape [numDirections, S, B, G] is iterated over its S axis, so its steps already have the
+    // leading direction axis.
+    auto const addStep = [&](nvinfer1::ITensor* sequence, bool reverse) -> nvinfer1::ITensor* {
+        if (projection)
+        {
+            return loop->addIterator(*sequence, 1, reverse)->getOutput(0);
+        }
+        nvinfer1::IIteratorLayer* iterator = loop->addIterator(*sequence);
+        iterator->setReverse(reverse);
+        return unsqueezeTensor(ctx, node, *iterator->getOutput(0), std::vector<int>{0});
+    };
+    // Sequence of one direction, [1, S, B, G] for a projection.
+    auto const getDirection = [&](int32_t index) -> nvinfer1::ITensor* {
+        if (!projection)
+        {
+            return input;
+        }
+        nvinfer1::ITensor* indexTensor
+            = addConstantScalar(ctx, index, ::ONNX_NAMESPACE::TensorProto::INT32, nvinfer1::Dims{1, 1})->getOutput(0);
+        return ctx->network()->addGather(*projection, *indexTensor, 0)->getOutput(0);
+    };
+    nvinfer1::ITensor* sequence = projection ? projection : input;
+
     if (direction == "forward")
     {
-        iterationInput = unsqueezeTensor(ctx, node, *loop->addIterator(*input)->getOutput(0), std::vector<int>{0});
+        iterationInput = addStep(sequence, false);
 
         if (isRagged)
         {
@@ -34,9 +64,7 @@ nvinfer1::ITensor* addRNNInput(IImporterContext* ctx, const ::ONNX_NAMESPACE::No
     }
     else if (direction == "reverse")
     {
-        nvinfer1::IIteratorLayer* reverseIterator = loop->addIterator(*input);
-        reverseIterator->setReverse(true);
-        iterationInput = unsqueezeTensor(ctx, node, *reverseIterator->getOutput(0), std::vector<int>{0});
+        iterationInput = addStep(sequence, true);
         if (isRagged)
         {
             nvinfer1::ITensor* seqLens = &convertToTensor(inputs.at(sequenceLenIndex), ctx);
@@ -46,12 +74,8 @@ nvinfer1::ITensor* addRNNInput(IImporterContext* ctx, const ::ONNX_NAMESPACE::No
     }
     else if (direction == "bidirectional")
     {
-        nvinfer1::IIteratorLayer* forward = loop->addIterator(*input);
-        nvinfer1::IIteratorLayer* reverse = loop->addIterator(*input);
-        reverse->setReverse(true);
-
-        auto forwardInput = unsqueezeTensor(ctx, node, *forward->getOutput(0), std::vector<int>{0});
-        auto reverseInput = unsqueezeTensor(ctx, node, *reverse->getOutput(0), std::vector<int>{0});
+        auto forwardInput = addStep(getDirection(0), false);
+        auto reverseInput = addStep(getDirection(1), true);
         if (isRagged)
         {
             nvinfer1::ITensor* seqLens = &convertToTensor(inputs.at(sequenceLenIndex), ctx);
@@ -74,6 +98,28 @@ nvinfer1::ITensor* addRNNInput(IImporterContext* ctx, const ::ONNX_NAMESPACE::No
     return iterationInput;
 }
 
+nvinfer1::ITensor* addRNNInputProjection(IImporterContext* ctx, const ::ONNX_NAMESPACE::NodeProto& node,
+    nvinfer1::ITensor* input, nvinfer1::ITensor* weights, nvinfer1::ITensor* bias)
+{
+    // (1, S, B, E) * (numDirections, 1, G, E)^T -> (numDirections, S, B, G)
+    nvinfer1::ITensor* sequence = unsqueezeTensor(ctx, node, *input, std::vector<int>{0});
+    nvinfer1::ITensor* directionWeights = unsqueezeTensor(ctx, node, *weights, std::vector<int>{1});
+    nvinfer1::ITensor* projection = ctx->network()
+                                        ->addMatrixMultiply(*sequence, nvinfer1::MatrixOperation::kNONE,
+                                            *directionWeights, nvinfer1::MatrixOperation::kTRANSPOSE)
+                                        ->getOutput(0);
+    if (bias)
+    {
+        // (numDirections, 1, G) -> (numDirections, 1, 1, G)
+        nvinfer1::ITensor* directionBias = unsqueezeTensor(ctx, node, *bias, std::vector<int>{1});
+        projection = ctx->network()
+                         ->addElementWise(*projection, *directionBias, nvinfer1::ElementWiseOperation::kSUM)
+                         ->getOutput(0);
+    }
+    LOG_VERBOSE("X * W^T for all timesteps -> " << projection->getDimensions());
+    return projection;
+}
+
 nvinfer1::ITensor* clearMissingSequenceElements(IImporterContext* ctx, const ::ONNX_NAMESPACE::NodeProto& node, nvinfer1::ILoop* loop,
     nvinfer1::ITensor* seqLens, nvinfer1::ITensor* toMask, nvinfer1::ITensor* maxLen, bool reverse,
     nvinfer1::ITensor* counter)
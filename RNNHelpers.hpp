@@ -14,7 +14,17 @@
 namespace onnx2trt
 {
 
-nvinfer1::ITensor* addRNNInput(IImporterContext* ctx, const ::ONNX_NAMESPACE::NodeProto& node, nvinfer1::ILoop* loop, std::vector<TensorOrWeights>& inputs, const std::string& direction);
+// Returns true if the parser flag kPRECOMPUTE_RNN_INPUT_PROJECTION is set
+bool precomputeRNNInputProjection(IImporterContext* ctx);
+
+// Adds X(t) to loop. If projection is not null, the iterators run over it instead of over X and each step has shape
+// (numDirections, B, G)
+nvinfer1::ITensor* addRNNInput(IImporterContext* ctx, const ::ONNX_NAMESPACE::NodeProto& node, nvinfer1::ILoop* loop, std::vector<TensorOrWeights>& inputs, const std::string& direction, nvinfer1::ITensor* projection = nullptr);
+
+// Computes X * W^T + bias for all timesteps with one matrix multiplication outside of the loop. input has shape
+// (S, B, E), weights (numDirections, G, E) and bias, which may be null, (numDirections, 1, G). Returns a tensor of
+// shape (numDirections, S, B, G)
+nvinfer1::ITensor* addRNNInputProjection(IImporterContext* ctx, const ::ONNX_NAMESPACE::NodeProto& node, nvinfer1::ITensor* input, nvinfer1::ITensor* weights, nvinfer1::ITensor* bias);
 
 // Zeros out invalid timesteps in toMask. maxLen must be provided if reverse is true
 nvinfer1::ITensor* clearMissingSequenceElements(IImporterContext* ctx, const ::ONNX_NAMESPACE::NodeProto& node, nvinfer1::ILoop* loop, nvinfer1::ITensor* seqLens, nvinfer1::ITensor* toMask, nvinfer1::ITensor* maxLen, bool reverse = false, nvinfer1::ITensor* counter = nullptr);
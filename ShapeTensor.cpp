@@ -3,14 +3,61 @@
  */
 
 #include "ShapeTensor.hpp"
+#include "ImporterContext.hpp"
 #include "TensorOrWeights.hpp"
 #include "onnx2trt_utils.hpp"
 #include <algorithm>
+#include <cstdint>
 #include <functional>
 
 namespace onnx2trt
 {
 
+//! Shape computations whose results are memoized in the importer context, so that for example the shape of a tensor
+//! that several nodes reshape by is computed by a single IShapeLayer.
+enum class ShapeOp : int64_t
+{
+    kSHAPE,
+    kELEMENTWISE,
+    kCONCAT,
+    kGATHER,
+    kCAST,
+    kFILL,
+    kTO_1D
+};
+
+//! Append operand x to key. Operands with known values are described by their values, so equal constants match
+//! without creating their constant layers first. Other operands are described by the identity of their tensor.
+static void appendOperand(IImporterContext* ctx, ShapeOpKey& key, ShapeTensor const& x)
+{
+    if (x.allValuesKnown())
+    {
+        key.push_back(1);
+        key.push_back(x.rank());
+        key.push_back(x.size());
+        key.insert(key.end(), x.begin(), x.end());
+    }
+    else
+    {
+        key.push_back(0);
+        key.push_back(static_cast<int64_t>(reinterpret_cast<intptr_t>(&x.tensor(ctx))));
+    }
+}
+
+//! Return the tensor computed earlier for key, or call addLayer to compute it and remember it.
+template <typename AddLayer>
+static nvinfer1::ITensor& memoize(IImporterContext* ctx, ShapeOpKey key, AddLayer&& addLayer)
+{
+    auto* ctxImpl = static_cast<ImporterContext*>(ctx);
+    if (nvinfer1::ITensor* tensor = ctxImpl->findShapeTensor(key))
+    {
+        return *tensor;
+    }
+    nvinfer1::ITensor* tensor = addLayer();
+    ctxImpl->addShapeTensor(std::move(key), tensor);
+    return *tensor;
+}
+
 ShapeTensor::ShapeTensor(int32_t rank_, std::vector<int64_t>&& values_)
     : mDepth(0)
     , mAllValuesKnown(true)
@@ -189,7 +236,10 @@ nvinfer1::ITensor& ShapeTensor::tensor(IImporterContext* ctx) const
             assert(mTensor);
             for (; mDepth > 0; --mDepth)
             {
-                mTensor = ctx->network()->addShape(*mTensor)->getOutput(0);
+                ShapeOpKey key{static_cast<int64_t>(ShapeOp::kSHAPE), 0};
+                key.push_back(static_cast<int64_t>(reinterpret_cast<intptr_t>(mTensor)));
+                mTensor = &memoize(
+                    ctx, std::move(key), [&]() { return ctx->network()->addShape(*mTensor)->getOutput(0); });
             }
         }
     }
@@ -218,9 +268,11 @@ ShapeTensor fillShapeVector(IImporterContext* ctx, int64_t value, const ShapeTen
     }
     else
     {
-        nvinfer1::ISliceLayer* slice
-            = addSlice(ctx, shapeVector(value).tensor(ctx), shapeVector(0), count, shapeVector(0));
-        return ShapeTensor(*slice->getOutput(0));
+        ShapeOpKey key{static_cast<int64_t>(ShapeOp::kFILL), value};
+        appendOperand(ctx, key, count);
+        return ShapeTensor(memoize(ctx, std::move(key), [&]() {
+            return addSlice(ctx, shapeVector(value).tensor(ctx), shapeVector(0), count, shapeVector(0))->getOutput(0);
+        }));
     }
 }
 
@@ -268,7 +320,13 @@ static ShapeTensor op(IImporterContext* ctx, const ShapeTensor& x, const ShapeTe
         }
         return ShapeTensor(x.rank(), std::move(values));
     }
-    return ShapeTensor(*ctx->network()->addElementWise(x.tensor(ctx), y.tensor(ctx), operation)->getOutput(0), 0);
+    ShapeOpKey key{static_cast<int64_t>(ShapeOp::kELEMENTWISE), static_cast<int64_t>(operation)};
+    appendOperand(ctx, key, x);
+    appendOperand(ctx, key, y);
+    return ShapeTensor(memoize(ctx, std::move(key), [&]() {
+        return ctx->network()->addElementWise(x.tensor(ctx), y.tensor(ctx), operation)->getOutput(0);
+    }),
+        0);
 }
 
 ShapeTensor add(IImporterContext* ctx, const ShapeTensor& x, const ShapeTensor& y)
@@ -345,8 +403,13 @@ ShapeTensor concat(IImporterContext* ctx, const ShapeTensor& x, const ShapeTenso
         return ShapeTensor(1, std::move(values));
     }
 
-    nvinfer1::ITensor* const args[2] = {&x.tensor(ctx), &y.tensor(ctx)};
-    return ShapeTensor(*ctx->network()->addConcatenation(args, 2)->getOutput(0));
+    ShapeOpKey key{static_cast<int64_t>(ShapeOp::kCONCAT), 0};
+    appendOperand(ctx, key, x);
+    appendOperand(ctx, key, y);
+    return ShapeTensor(memoize(ctx, std::move(key), [&]() {
+        nvinfer1::ITensor* const args[2] = {&x.tensor(ctx), &y.tensor(ctx)};
+        return ctx->network()->addConcatenation(args, 2)->getOutput(0);
+    }));
 }
 
 ShapeTensor gather(IImporterContext* ctx, const ShapeTensor& data, const ShapeTensor& indices)
@@ -363,15 +426,24 @@ ShapeTensor gather(IImporterContext* ctx, const ShapeTensor& data, const ShapeTe
         });
         return ShapeTensor(indices.rank(), std::move(z));
     }
-    return ShapeTensor(*ctx->network()->addGather(data.tensor(ctx), indices.tensor(ctx), 0)->getOutput(0));
+    ShapeOpKey key{static_cast<int64_t>(ShapeOp::kGATHER), 0};
+    appendOperand(ctx, key, data);
+    appendOperand(ctx, key, indices);
+    return ShapeTensor(memoize(ctx, std::move(key), [&]() {
+        return ctx->network()->addGather(data.tensor(ctx), indices.tensor(ctx), 0)->getOutput(0);
+    }));
 }
 
 ShapeTensor castToInt32(IImporterContext* ctx, ShapeTensor const& x)
 {
-    nvinfer1::ILayer* identity = ctx->network()->addIdentity(x.tensor(ctx));
-    assert(identity != nullptr);
-    identity->setOutputType(0, nvinfer1::DataType::kINT32);
-    return ShapeTensor(*identity->getOutput(0));
+    ShapeOpKey key{static_cast<int64_t>(ShapeOp::kCAST), 0};
+    appendOperand(ctx, key, x);
+    return ShapeTensor(memoize(ctx, std::move(key), [&]() {
+        nvinfer1::ILayer* identity = ctx->network()->addIdentity(x.tensor(ctx));
+        assert(identity != nullptr);
+        identity->setOutputType(0, nvinfer1::DataType::kINT32);
+        return identity->getOutput(0);
+    }));
 }
 
 ShapeTensor shapeOf(nvinfer1::ITensor& tensor)
@@ -412,7 +484,10 @@ ShapeTensor convertTo1D(IImporterContext* ctx, const ShapeTensor& tensor)
     {
         return shapeVector(tensor[0]);
     }
-    return ShapeTensor(*addShuffle(ctx, tensor.tensor(ctx), shapeVector(1))->getOutput(0));
+    ShapeOpKey key{static_cast<int64_t>(ShapeOp::kTO_1D), 0};
+    appendOperand(ctx, key, tensor);
+    return ShapeTensor(memoize(ctx, std::move(key),
+        [&]() { return addShuffle(ctx, tensor.tensor(ctx), shapeVector(1))->getOutput(0); }));
 }
 
 //! If all values of x are known, return Dims with those values,
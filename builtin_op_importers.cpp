@@ -28,10 +28,25 @@
 namespace onnx2trt
 {
 
-string_map<NodeImporter>& getBuiltinOpImporterMap()
+bool BuiltinOpImporters::add(std::string const& opType, NodeImportFunction importer)
 {
-    static string_map<NodeImporter> builtin_op_importers;
-    return builtin_op_importers;
+    if (!mIds.emplace(opType, size()).second)
+    {
+        return false;
+    }
+    mImporters.push_back(importer);
+    mOpTypes.push_back(opType);
+    if (opType == "FallbackPluginImporter")
+    {
+        mFallbackImporter = importer;
+    }
+    return true;
+}
+
+BuiltinOpImporters& getBuiltinOpImporters()
+{
+    static BuiltinOpImporters builtinOpImporters;
+    return builtinOpImporters;
 }
 
 namespace
@@ -104,9 +119,9 @@ void assertIsWeights(TensorOrWeights const& input, std::string const& specificMs
     }
 }
 
-bool registerBuiltinOpImporter(std::string op, NodeImporter const& importer)
+bool registerBuiltinOpImporter(std::string op, NodeImportFunction importer)
 {
-    bool inserted = getBuiltinOpImporterMap().insert({op, importer}).second;
+    bool inserted = getBuiltinOpImporters().add(op, importer);
     assert(inserted);
     return inserted;
 }
@@ -725,10 +740,10 @@ DEFINE_BUILTIN_OP_IMPORTER(Conv)
     layer->setNbGroups(ngroup);
     // Register layer name as well as kernel weights and bias weights (if any)
     ctx->registerLayer(layer, node);
-    ctx->network()->setWeightsName(kernelWeights, inputs.at(1).weights().getName());
+    setWeightsName(ctx, kernelWeights, inputs.at(1).weights().getName());
     if (inputs.size() == 3)
     {
-        ctx->network()->setWeightsName(bias_weights, inputs.at(2).weights().getName());
+        setWeightsName(ctx, bias_weights, inputs.at(2).weights().getName());
     }
     tensorPtr = layer->getOutput(0);
     dims = tensorPtr->getDimensions();
@@ -919,7 +934,7 @@ DEFINE_BUILTIN_OP_IMPORTER(ConvTranspose)
     }
     else
     {
-        ctx->network()->setWeightsName(kernelWeights, inputs.at(1).weights().getName());
+        setWeightsName(ctx, kernelWeights, inputs.at(1).weights().getName());
     }
     if (biasTensorPtr)
     {
@@ -987,7 +1002,7 @@ DEFINE_BUILTIN_OP_IMPORTER(ConvTranspose)
 
     if (inputs.size() > 2 && biasTensorPtr == nullptr)
     {
-        ctx->network()->setWeightsName(biasWeights, inputs.at(2).weights().getName());
+        setWeightsName(ctx, biasWeights, inputs.at(2).weights().getName());
     }
 
     if (needReshapeBack)
@@ -1168,7 +1183,7 @@ NodeImportResult QuantDequantLinearHelper(
         = [ctx, node](nvinfer1::INetworkDefinition& network, ShapedWeights const& weights) -> nvinfer1::ITensor* {
         nvinfer1::IConstantLayer* constLayer = network.addConstant(weights.shape, weights);
         ctx->registerLayer(constLayer, weights.getName(), &node);
-        network.setWeightsName(weights, weights.getName());
+        setWeightsName(ctx, weights, weights.getName());
         return constLayer->getOutput(0);
     };
 
@@ -1182,6 +1197,43 @@ NodeImportResult QuantDequantLinearHelper(
         nvonnxparser::ErrorCode::kINVALID_NODE);
 
     std::string nodeName = getNodeName(node);
+
+    // Constant weights quantized to INT8 are computed here. The network then holds the INT8 weights, which feed the
+    // DequantizeLinear, instead of the FLOAT weights and a quantize layer for the builder to fold.
+    uint32_t const foldFlag = 1U << static_cast<uint32_t>(nvonnxparser::OnnxParserFlag::kFOLD_WEIGHT_QUANTIZATION);
+    if (!isDQ && datatype == DataType::kINT8 && (ctx->getFlags() & foldFlag) && inputs.size() == 3
+        && inputs.at(0).is_weights() && inputs.at(0).weights().type == ::ONNX_NAMESPACE::TensorProto::FLOAT
+        && inputs.at(1).is_weights() && inputs.at(1).weights().type == ::ONNX_NAMESPACE::TensorProto::FLOAT
+        && inputs.at(2).is_weights() && inputs.at(2).weights().type == ::ONNX_NAMESPACE::TensorProto::INT8)
+    {
+        auto const& weights = inputs.at(0).weights();
+        auto const& scale = inputs.at(1).weights();
+        auto const& zeroPoint = inputs.at(2).weights();
+        auto const* scaleVal = static_cast<float const*>(scale.values);
+        bool const scaleAllPositive
+            = std::all_of(scaleVal, scaleVal + scale.count(), [](float x) { return x > 0; });
+
+        // Same axis as the quantize layer would use below.
+        OnnxAttrs attrs(node, ctx);
+        int32_t const nbDims = weights.shape.nbDims;
+        int32_t axis = attrs.get<int32_t>("axis", nbDims);
+        CHECK(convertAxis(axis, nbDims));
+        if (axis == nbDims)
+        {
+            axis = 0;
+        }
+        bool const perTensor = scale.count() == 1;
+        bool const perChannel = !perTensor && axis < nbDims && weights.shape.d[axis] == scale.count();
+
+        // Anything the quantize layer would reject is left to it, so that the error is the same with the flag set.
+        if (scale.count() > 0 && scaleAllPositive && zeroPoint.count() == scale.count() && shiftIsAllZeros(zeroPoint)
+            && (perTensor || perChannel))
+        {
+            LOG_VERBOSE("Quantizing the weights of " << nodeName << " to INT8 on the host.");
+            return {{quantizeWeightsINT8(ctx, weights, scale, axis)}};
+        }
+    }
+
     // Input 0 is the data to quantize or dequantize.
     nvinfer1::ITensor& dataInput = convertToTensor(inputs.at(0), ctx);
 
@@ -1802,6 +1854,7 @@ DEFINE_BUILTIN_OP_IMPORTER(GRU)
     int32_t const hiddenSize = attrs.get<int32_t>("hidden_size");
     int32_t const linearBeforeReset = attrs.get<int32_t>("linear_before_reset", 0);
     const float clip = attrs.get("clip", -1.f); // Clipping cannot be negative, so -1.0 is a good sentinel value.
+    bool const hoistInput = precomputeRNNInputProjection(ctx);
 
     // The input is in SBE format
     nvinfer1::ITensor* input = &convertToTensor(inputs.at(0), ctx);
@@ -1845,32 +1898,39 @@ DEFINE_BUILTIN_OP_IMPORTER(GRU)
         = addConstantScalar(ctx, 2 * hiddenSize, ::ONNX_NAMESPACE::TensorProto::INT32, Dims{1, 1})->getOutput(0);
     nvinfer1::ITensor* eDimTensor = getAxisLength(ctx, input, 2, Dims{1, 1});
 
-    nvinfer1::ITensor* weightsZRStart
-        = addConstant(ctx, std::vector<int32_t>{0, 0, 0}, ::ONNX_NAMESPACE::TensorProto::INT32, Dims{1, 3})
-              ->getOutput(0);
-    nvinfer1::ITensor* weightsZRSize
-        = net->addConcatenation(
-                 std::array<nvinfer1::ITensor*, 3>{{numDirectionsTensor, hiddenSizeDoubledTensor, eDimTensor}}.data(),
-                 3)
-              ->getOutput(0);
-    nvinfer1::ISliceLayer* weightsZRLayer = net->addSlice(weights, Dims{3}, Dims{3}, Dims3{1, 1, 1});
-    weightsZRLayer->setInput(1, *weightsZRStart);
-    weightsZRLayer->setInput(2, *weightsZRSize);
-    nvinfer1::ITensor* weightsZR = weightsZRLayer->getOutput(0);
-    LOG_VERBOSE("Weights for ZR gates shape is: " << weightsZR->getDimensions());
-
-    nvinfer1::ITensor* weightsHStart
-        = addConstant(ctx, std::vector<int32_t>{0, 2 * hiddenSize, 0}, ::ONNX_NAMESPACE::TensorProto::INT32, Dims{1, 3})
-              ->getOutput(0);
-    nvinfer1::ITensor* weightsHSize
-        = net->addConcatenation(
-                 std::array<nvinfer1::ITensor*, 3>{{numDirectionsTensor, hiddenSizeTensor, eDimTensor}}.data(), 3)
-              ->getOutput(0);
-    nvinfer1::ISliceLayer* weightsHLayer = net->addSlice(weights, Dims{3}, Dims{3}, Dims3{1, 1, 1});
-    weightsHLayer->setInput(1, *weightsHStart);
-    weightsHLayer->setInput(2, *weightsHSize);
-    nvinfer1::ITensor* weightsH = weightsHLayer->getOutput(0);
-    LOG_VERBOSE("Weights for H gate shape is: " << weightsH->getDimensions());
+    // The weights of X(t) are only sliced per gate when X(t) * W^T is computed in the loop.
+    nvinfer1::ITensor* weightsZR{nullptr};
+    nvinfer1::ITensor* weightsH{nullptr};
+    if (!hoistInput)
+    {
+        nvinfer1::ITensor* weightsZRStart
+            = addConstant(ctx, std::vector<int32_t>{0, 0, 0}, ::ONNX_NAMESPACE::TensorProto::INT32, Dims{1, 3})
+                  ->getOutput(0);
+        nvinfer1::ITensor* weightsZRSize
+            = net->addConcatenation(std::array<nvinfer1::ITensor*, 3>{{numDirectionsTensor,
+                                        hiddenSizeDoubledTensor, eDimTensor}}.data(),
+                     3)
+                  ->getOutput(0);
+        nvinfer1::ISliceLayer* weightsZRLayer = net->addSlice(weights, Dims{3}, Dims{3}, Dims3{1, 1, 1});
+        weightsZRLayer->setInput(1, *weightsZRStart);
+        weightsZRLayer->setInput(2, *weightsZRSize);
+        weightsZR = weightsZRLayer->getOutput(0);
+        LOG_VERBOSE("Weights for ZR gates shape is: " << weightsZR->getDimensions());
+
+        nvinfer1::ITensor* weightsHStart
+            = addConstant(
+                ctx, std::vector<int32_t>{0, 2 * hiddenSize, 0}, ::ONNX_NAMESPACE::TensorProto::INT32, Dims{1, 3})
+                  ->getOutput(0);
+        nvinfer1::ITensor* weightsHSize
+            = net->addConcatenation(
+                     std::array<nvinfer1::ITensor*, 3>{{numDirectionsTensor, hiddenSizeTensor, eDimTensor}}.data(), 3)
+                  ->getOutput(0);
+        nvinfer1::ISliceLayer* weightsHLayer = net->addSlice(weights, Dims{3}, Dims{3}, Dims3{1, 1, 1});
+        weightsHLayer->setInput(1, *weightsHStart);
+        weightsHLayer->setInput(2, *weightsHSize);
+        weightsH = weightsHLayer->getOutput(0);
+        LOG_VERBOSE("Weights for H gate shape is: " << weightsH->getDimensions());
+    }
 
     nvinfer1::ITensor* recurrenceWeightsZR = net->addSlice(recurrenceWeights, Dims3{0, 0, 0},
                                                     Dims3{numDirections, 2 * hiddenSize, hiddenSize}, Dims3{1, 1, 1})
@@ -1886,6 +1946,7 @@ DEFINE_BUILTIN_OP_IMPORTER(GRU)
     nvinfer1::ITensor* biasH{nullptr};
     nvinfer1::ITensor* recurrenceBiasZR{nullptr};
     nvinfer1::ITensor* recurrenceBiasH{nullptr};
+    nvinfer1::ITensor* inputBias{nullptr};
     if (inputs.size() > 3 && inputs.at(3))
     {
         // ONNX bias is a concatenation of Wb and Rb on the second axis, so has shape (numDirections, 2 * NUM_GATES *
@@ -1914,6 +1975,12 @@ DEFINE_BUILTIN_OP_IMPORTER(GRU)
                                  Dims3{numDirections, 1, hiddenSize}, Dims3{1, 1, 1})
                               ->getOutput(0);
         LOG_VERBOSE("Recurrence bias for H gate shape is: " << recurrenceBiasH->getDimensions());
+        if (hoistInput)
+        {
+            inputBias = net->addSlice(*concatenatedBias, Dims3{0, 0, 0},
+                               Dims3{numDirections, 1, NUM_GATES * hiddenSize}, Dims3{1, 1, 1})
+                            ->getOutput(0);
+        }
     }
 
     // Get a shape tensor containing: (numDirections, batchSize, hiddenSize)
@@ -1939,14 +2006,18 @@ DEFINE_BUILTIN_OP_IMPORTER(GRU)
     nvinfer1::ITensor* gateOutputShape = initialStateShape();
     LOG_VERBOSE("Gate output rank (equal to initial hidden/cell state rank): " << gateOutputShape->getDimensions());
 
+    // X(t) * W^T + Wb for all timesteps, if it is computed before the loop.
+    nvinfer1::ITensor* projection
+        = hoistInput ? addRNNInputProjection(ctx, node, input, &weights, inputBias) : nullptr;
+
     LOG_VERBOSE("Entering Loop");
     // Scan over the S dimension of the input
     auto loop = net->addLoop();
     nvinfer1::ITensor* tripLimit = getAxisLength(ctx, input, 0);
     loop->addTripLimit(*tripLimit, nvinfer1::TripLimit::kCOUNT);
 
-    // Add X(t)
-    nvinfer1::ITensor* iterationInput = addRNNInput(ctx, node, loop, inputs, direction);
+    // Add X(t), or the step of the input projection.
+    nvinfer1::ITensor* iterationInput = addRNNInput(ctx, node, loop, inputs, direction, projection);
     ASSERT(iterationInput && "Failed to add RNN input.", ErrorCode::kINVALID_NODE);
 
     // H(t-1)
@@ -1969,8 +2040,28 @@ DEFINE_BUILTIN_OP_IMPORTER(GRU)
 
     // Compute stackedZR(t) = f(X(t) * W[zr]^T + H(t-1) * R[zr]^T + (Wb[zr] + Rb[zr])). stackedZR(t) has shape
     // (numDirections, batchSize, 2 * hiddenSize)
-    nvinfer1::ITensor* xtWTZR
-        = net->addMatrixMultiply(*iterationInput, mOp::kNONE, *weightsZR, mOp::kTRANSPOSE)->getOutput(0);
+    nvinfer1::ITensor* xtWTZR{nullptr};
+    if (projection)
+    {
+        // The first 2 * hiddenSize values of the projection.
+        nvinfer1::ISliceLayer* isolateZR
+            = net->addSlice(*iterationInput, Dims3{0, 0, 0}, Dims3{0, 0, 0}, Dims3{1, 1, 1});
+        isolateZR->setInput(1,
+            *addConstant(ctx, std::vector<int32_t>{0, 0, 0}, ::ONNX_NAMESPACE::TensorProto_DataType_INT32, Dims{1, 3})
+                 ->getOutput(0));
+        isolateZR->setInput(2,
+            *net->addElementWise(*gateOutputShape,
+                    *addConstant(ctx, std::vector<int32_t>{1, 1, 2}, ::ONNX_NAMESPACE::TensorProto_DataType_INT32,
+                        Dims{1, 3})
+                         ->getOutput(0),
+                    eOp::kPROD)
+                 ->getOutput(0));
+        xtWTZR = isolateZR->getOutput(0);
+    }
+    else
+    {
+        xtWTZR = net->addMatrixMultiply(*iterationInput, mOp::kNONE, *weightsZR, mOp::kTRANSPOSE)->getOutput(0);
+    }
     LOG_VERBOSE("X(t) * W[zr]^T -> " << xtWTZR->getDimensions());
 
     nvinfer1::ITensor* ht1RT
@@ -1980,7 +2071,11 @@ DEFINE_BUILTIN_OP_IMPORTER(GRU)
     nvinfer1::ITensor* stackedZRt = net->addElementWise(*xtWTZR, *ht1RT, eOp::kSUM)->getOutput(0);
     if (biasZR && recurrenceBiasZR)
     {
-        stackedZRt = net->addElementWise(*stackedZRt, *biasZR, eOp::kSUM)->getOutput(0);
+        // Wb[zr] is already part of the projection.
+        if (!projection)
+        {
+            stackedZRt = net->addElementWise(*stackedZRt, *biasZR, eOp::kSUM)->getOutput(0);
+        }
         stackedZRt = net->addElementWise(*stackedZRt, *recurrenceBiasZR, eOp::kSUM)->getOutput(0);
     }
 
@@ -2013,8 +2108,9 @@ DEFINE_BUILTIN_OP_IMPORTER(GRU)
     // Compute h(t)
     nvinfer1::ITensor* ht{nullptr};
     // xtWTH = X(t) * (W[h]^T)
-    nvinfer1::ITensor* xtWTH
-        = net->addMatrixMultiply(*iterationInput, mOp::kNONE, *weightsH, mOp::kTRANSPOSE)->getOutput(0);
+    nvinfer1::ITensor* xtWTH = projection
+        ? isolateGate(iterationInput, 2)
+        : net->addMatrixMultiply(*iterationInput, mOp::kNONE, *weightsH, mOp::kTRANSPOSE)->getOutput(0);
     if (linearBeforeReset == 0)
     {
         // h(t) = g(xtWTH + (r(t) . H(t-1)) * (R[h]^T) + Rb[h] + Wb[h])
@@ -2030,7 +2126,9 @@ DEFINE_BUILTIN_OP_IMPORTER(GRU)
         // If bias is defines, both recurrence and normal bias must be present
         if (recurrenceBiasH && biasH)
         {
-            nvinfer1::ITensor* secondSum = net->addElementWise(*recurrenceBiasH, *biasH, eOp::kSUM)->getOutput(0);
+            nvinfer1::ITensor* secondSum = projection
+                ? recurrenceBiasH
+                : net->addElementWise(*recurrenceBiasH, *biasH, eOp::kSUM)->getOutput(0);
             actInput = net->addElementWise(*actInput, *secondSum, eOp::kSUM)->getOutput(0);
         }
 
@@ -2055,7 +2153,7 @@ DEFINE_BUILTIN_OP_IMPORTER(GRU)
         nvinfer1::ITensor* rtHtRhRbh = net->addElementWise(*rt, *ht1Rh, eOp::kPROD)->getOutput(0);
 
         // h(t) = g(xtWTH + rtHtRhRbh + Wb[h])
-        if (biasH)
+        if (biasH && !projection)
         {
             rtHtRhRbh = net->addElementWise(*rtHtRhRbh, *biasH, eOp::kSUM)->getOutput(0);
         }
@@ -2568,14 +2666,19 @@ DEFINE_BUILTIN_OP_IMPORTER(LSTM)
     nvinfer1::ITensor* initialCellState = getInitialInputValue(6);
     LOG_VERBOSE("Initial cell state shape: " << initialCellState->getDimensions());
 
+    // X(t) * W^T + (Wb + Rb) for all timesteps, if it is computed before the loop.
+    nvinfer1::ITensor* projection = precomputeRNNInputProjection(ctx)
+        ? addRNNInputProjection(ctx, node, input, weights, combinedBias)
+        : nullptr;
+
     LOG_VERBOSE("Entering Loop");
     // Scan over the S dimension of the input
     auto loop = ctx->network()->addLoop();
     nvinfer1::ITensor* tripLimit = getAxisLength(ctx, input, 0);
     loop->addTripLimit(*tripLimit, nvinfer1::TripLimit::kCOUNT);
 
-    // Add X(t)
-    nvinfer1::ITensor* iterationInput = addRNNInput(ctx, node, loop, inputs, direction);
+    // Add X(t), or the step of the input projection.
+    nvinfer1::ITensor* iterationInput = addRNNInput(ctx, node, loop, inputs, direction, projection);
     ASSERT(iterationInput && "Failed to add RNN input.", ErrorCode::kINVALID_NODE);
 
     // H(t-1)
@@ -2589,10 +2692,11 @@ DEFINE_BUILTIN_OP_IMPORTER(LSTM)
 
     // Compute intermediate(t) = (X(t) * W^T + H(t-1) * R^T + (Wb + Rb)). intermediate(t) has shape (numDirections,
     // batchSize, 4 * hiddenSize)
-    nvinfer1::ITensor* xtWT = ctx->network()
-                                  ->addMatrixMultiply(*iterationInput, nvinfer1::MatrixOperation::kNONE, *weights,
-                                      nvinfer1::MatrixOperation::kTRANSPOSE)
-                                  ->getOutput(0);
+    nvinfer1::ITensor* xtWT = projection ? iterationInput
+                                         : ctx->network()
+                                               ->addMatrixMultiply(*iterationInput, nvinfer1::MatrixOperation::kNONE,
+                                                   *weights, nvinfer1::MatrixOperation::kTRANSPOSE)
+                                               ->getOutput(0);
     LOG_VERBOSE("X(t) * W^T -> " << xtWT->getDimensions());
 
     nvinfer1::ITensor* ht1RT = ctx->network()
@@ -2602,7 +2706,7 @@ DEFINE_BUILTIN_OP_IMPORTER(LSTM)
     LOG_VERBOSE("H(t-1) * R^T -> " << ht1RT->getDimensions());
 
     nvinfer1::ITensor* intermediatet = ctx->network()->addElementWise(*xtWT, *ht1RT, eOp::kSUM)->getOutput(0);
-    if (combinedBias)
+    if (combinedBias && !projection)
     {
         intermediatet = ctx->network()->addElementWise(*intermediatet, *combinedBias, eOp::kSUM)->getOutput(0);
     }
@@ -2974,7 +3078,7 @@ DEFINE_BUILTIN_OP_IMPORTER(Mean)
     static_cast<float*>(scale_weights.values)[0] = scale_value;
     auto* constant_layer = ctx->network()->addConstant(scale_weights.shape, scale_weights);
     ASSERT(constant_layer && "Failed to create the scalar tensor.", ErrorCode::kUNSUPPORTED_NODE);
-    ctx->network()->setWeightsName(scale_weights, scale_weights.getName());
+    setWeightsName(ctx, scale_weights, scale_weights.getName());
     nvinfer1::ITensor& scale_constant = *constant_layer->getOutput(0);
     RETURN_FIRST_OUTPUT(
         ctx->network()->addElementWise(sum_tensor, scale_constant, nvinfer1::ElementWiseOperation::kPROD));
@@ -4081,14 +4185,19 @@ DEFINE_BUILTIN_OP_IMPORTER(RNN)
     nvinfer1::ITensor* initialHidden = getInitialInputValue(5);
     LOG_VERBOSE("Initial hidden state shape: " << initialHidden->getDimensions());
 
+    // X(t) * W^T + (Wb + Rb) for all timesteps, if it is computed before the loop.
+    nvinfer1::ITensor* projection = precomputeRNNInputProjection(ctx)
+        ? addRNNInputProjection(ctx, node, input, weights, combinedBias)
+        : nullptr;
+
     LOG_VERBOSE("Entering Loop");
     // Scan over the S dimension of the input
     auto loop = ctx->network()->addLoop();
     nvinfer1::ITensor* tripLimit = getAxisLength(ctx, input, 0);
     loop->addTripLimit(*tripLimit, nvinfer1::TripLimit::kCOUNT);
 
-    // Add X(t)
-    nvinfer1::ITensor* iterationInput = addRNNInput(ctx, node, loop, inputs, direction);
+    // Add X(t), or the step of the input projection.
+    nvinfer1::ITensor* iterationInput = addRNNInput(ctx, node, loop, inputs, direction, projection);
     ASSERT(iterationInput && "Failed to add RNN input.", ErrorCode::kINVALID_NODE);
 
     // H(t-1)
@@ -4097,10 +4206,11 @@ DEFINE_BUILTIN_OP_IMPORTER(RNN)
     LOG_VERBOSE("Hidden state shape: " << hiddenState->getOutput(0)->getDimensions());
 
     // Compute intermediate(t) = (X(t) * W^T + H(t-1) * R^T + (Wb + Rb)).
-    nvinfer1::ITensor* xtWT = ctx->network()
-                                  ->addMatrixMultiply(*iterationInput, nvinfer1::MatrixOperation::kNONE, *weights,
-                                      nvinfer1::MatrixOperation::kTRANSPOSE)
-                                  ->getOutput(0);
+    nvinfer1::ITensor* xtWT = projection ? iterationInput
+                                         : ctx->network()
+                                               ->addMatrixMultiply(*iterationInput, nvinfer1::MatrixOperation::kNONE,
+                                                   *weights, nvinfer1::MatrixOperation::kTRANSPOSE)
+                                               ->getOutput(0);
     LOG_VERBOSE("X(t) * W^T -> " << xtWT->getDimensions());
 
     nvinfer1::ITensor* ht1RT = ctx->network()
@@ -4111,7 +4221,7 @@ DEFINE_BUILTIN_OP_IMPORTER(RNN)
 
     nvinfer1::ITensor* intermediatet
         = ctx->network()->addElementWise(*xtWT, *ht1RT, nvinfer1::ElementWiseOperation::kSUM)->getOutput(0);
-    if (combinedBias)
+    if (combinedBias && !projection)
     {
         intermediatet = ctx->network()
                             ->addElementWise(*intermediatet, *combinedBias, nvinfer1::ElementWiseOperation::kSUM)
@@ -4462,8 +4572,15 @@ DEFINE_BUILTIN_OP_IMPORTER(Size)
 
     // "outputs a int64 scalar that equals to the total number of elements of the input tensor."
     ShapeTensor const size = product(ctx, shape, 0, shape.size(), /*rank=*/0);
+    if (size.allValuesKnown())
+    {
+        return {{&size.tensor(ctx)}};
+    }
 
-    return {{&size.tensor(ctx)}};
+    // The product may be shared with other shape computations, so give the output a tensor of its own to be named.
+    auto* layer = ctx->network()->addIdentity(size.tensor(ctx));
+    ctx->registerLayer(layer, node);
+    RETURN_FIRST_OUTPUT(layer);
 }
 
 DEFINE_BUILTIN_OP_IMPORTER(Slice)
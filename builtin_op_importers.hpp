@@ -6,10 +6,62 @@
 
 #include "onnx2trt.hpp"
 #include "utils.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
 
 namespace onnx2trt
 {
 
-string_map<NodeImporter>& getBuiltinOpImporterMap();
+//! Builtin importers are plain functions, calling them does not go through a std::function.
+using NodeImportFunction = NodeImportResult (*)(
+    IImporterContext* ctx, ::ONNX_NAMESPACE::NodeProto const& node, std::vector<TensorOrWeights>& inputs);
+
+//! Registry of the builtin op importers. Each op type gets a dense ID when it is registered, so that resolving an op
+//! type takes a single hash lookup and the importer is then found by indexing.
+class BuiltinOpImporters
+{
+public:
+    static constexpr int32_t kINVALID_ID{-1};
+
+    //! Register importer for opType. Returns false if opType already has an importer.
+    bool add(std::string const& opType, NodeImportFunction importer);
+
+    //! ID of the importer of opType, or kINVALID_ID if there is none.
+    int32_t getId(std::string const& opType) const
+    {
+        auto const iter = mIds.find(opType);
+        return iter == mIds.end() ? kINVALID_ID : iter->second;
+    }
+
+    NodeImportFunction getImporter(int32_t id) const
+    {
+        return mImporters[id];
+    }
+
+    std::string const& getOpType(int32_t id) const
+    {
+        return mOpTypes[id];
+    }
+
+    int32_t size() const
+    {
+        return static_cast<int32_t>(mImporters.size());
+    }
+
+    //! Importer of the ops without a builtin importer, which imports them as plugins.
+    NodeImportFunction getFallbackImporter() const
+    {
+        return mFallbackImporter;
+    }
+
+private:
+    string_map<int32_t> mIds;
+    std::vector<NodeImportFunction> mImporters; // Indexed by ID
+    std::vector<std::string> mOpTypes; // Indexed by ID
+    NodeImportFunction mFallbackImporter{nullptr};
+};
+
+BuiltinOpImporters& getBuiltinOpImporters();
 
 } // namespace onnx2trt
@@ -57,8 +57,18 @@ public:
     virtual void registerLayer(nvinfer1::ILayer* layer, ::ONNX_NAMESPACE::NodeProto const& node) = 0;
 
     virtual ShapedWeights createTempWeights(ShapedWeights::DataType type, nvinfer1::Dims shape, uint8_t value = 0) = 0;
+
+    //! Map an external weights file into memory. Each path is mapped at most once per context and stays mapped
+    //! for the lifetime of the context, so weights may point directly into the returned buffer.
+    virtual bool mapExternalFile(std::string const& path, void*& data, size_t& size) = 0;
+    //! Ask the OS to start reading a range of a file mapped by mapExternalFile() into memory in the background, so
+    //! that it is resident by the time it is used. This is only a hint and never blocks on I/O.
+    virtual void prefetchExternalData(void const* data, size_t size) = 0;
     virtual int64_t getOpsetVersion(const char* domain = "") const = 0;
     virtual nvinfer1::ILogger& logger() = 0;
+
+    //! Least severe message the logger reports. Messages of lower severity are dropped before being formatted.
+    virtual nvinfer1::ILogger::Severity getLoggerSeverity() const = 0;
     virtual bool hasError() const = 0;
     virtual nvinfer1::IErrorRecorder* getErrorRecorder() const = 0;
     virtual nvinfer1::IConstantLayer* getConstantLayer(const char* name) const = 0;
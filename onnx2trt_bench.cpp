@@ -0,0 +1,745 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Benchmarks of the ONNX parser and of the engines built from its networks. Models are either read from files or
+// produced by synthetic graph generators, and the results are written as one JSON document.
+
+#include "NvInferPlugin.h"
+#include "NvOnnxParser.h"
+#include "common.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cuda_runtime_api.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h> // For ::getopt
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// --------------------------------
+// Synthetic graphs
+// --------------------------------
+
+constexpr int64_t kWIDTH = 64;        // Feature width of the chain, fan-out and control flow graphs.
+constexpr int64_t kMATRIX_SIZE = 1024; // Rows and columns of the weights of the initializer graphs, 4 MiB each.
+constexpr char const* kEXTERNAL_DATA_FILE = "weights.bin";
+
+void setValueInfo(::ONNX_NAMESPACE::ValueInfoProto* info, std::string const& name, int32_t elemType,
+    std::vector<int64_t> const& shape)
+{
+    info->set_name(name);
+    auto* tensorType = info->mutable_type()->mutable_tensor_type();
+    tensorType->set_elem_type(elemType);
+    auto* tensorShape = tensorType->mutable_shape();
+    for (int64_t const d : shape)
+    {
+        tensorShape->add_dim()->set_dim_value(d);
+    }
+}
+
+::ONNX_NAMESPACE::NodeProto* addNode(::ONNX_NAMESPACE::GraphProto& graph, std::string const& opType,
+    std::vector<std::string> const& inputs, std::vector<std::string> const& outputs)
+{
+    auto* node = graph.add_node();
+    node->set_op_type(opType);
+    node->set_name(outputs.front());
+    for (auto const& input : inputs)
+    {
+        node->add_input(input);
+    }
+    for (auto const& output : outputs)
+    {
+        node->add_output(output);
+    }
+    return node;
+}
+
+//! Add a FLOAT initializer filled with value. If externalData is not null, its values are appended to it and the
+//! initializer refers to them in kEXTERNAL_DATA_FILE.
+void addFloatInitializer(::ONNX_NAMESPACE::GraphProto& graph, std::string const& name,
+    std::vector<int64_t> const& shape, float value, std::string* externalData = nullptr)
+{
+    auto* tensor = graph.add_initializer();
+    tensor->set_name(name);
+    tensor->set_data_type(::ONNX_NAMESPACE::TensorProto::FLOAT);
+    int64_t count{1};
+    for (int64_t const d : shape)
+    {
+        tensor->add_dims(d);
+        count *= d;
+    }
+    std::vector<float> const values(count, value);
+    std::string bytes(reinterpret_cast<char const*>(values.data()), values.size() * sizeof(float));
+    if (!externalData)
+    {
+        tensor->set_raw_data(std::move(bytes));
+        return;
+    }
+    tensor->set_data_location(::ONNX_NAMESPACE::TensorProto::EXTERNAL);
+    auto const addEntry = [tensor](std::string const& key, std::string const& value) {
+        auto* entry = tensor->add_external_data();
+        entry->set_key(key);
+        entry->set_value(value);
+    };
+    addEntry("location", kEXTERNAL_DATA_FILE);
+    addEntry("offset", std::to_string(externalData->size()));
+    addEntry("length", std::to_string(bytes.size()));
+    externalData->append(bytes);
+}
+
+void addScalarInitializer(::ONNX_NAMESPACE::GraphProto& graph, std::string const& name, int32_t dataType, int64_t value)
+{
+    auto* tensor = graph.add_initializer();
+    tensor->set_name(name);
+    tensor->set_data_type(dataType);
+    if (dataType == ::ONNX_NAMESPACE::TensorProto::BOOL)
+    {
+        tensor->add_int32_data(static_cast<int32_t>(value != 0));
+    }
+    else
+    {
+        tensor->add_int64_data(value);
+    }
+}
+
+//! size nodes alternating between Add and Relu, all in one dependency chain.
+void generateDeepChain(int64_t size, ::ONNX_NAMESPACE::GraphProto& graph, std::string* /*externalData*/)
+{
+    setValueInfo(graph.add_input(), "input", ::ONNX_NAMESPACE::TensorProto::FLOAT, {1, kWIDTH});
+    addFloatInitializer(graph, "bias", {kWIDTH}, 0.5F);
+    std::string previous = "input";
+    for (int64_t i = 0; i < size; ++i)
+    {
+        std::string const output = "chain_" + std::to_string(i);
+        if (i % 2 == 0)
+        {
+            addNode(graph, "Add", {previous, "bias"}, {output});
+        }
+        else
+        {
+            addNode(graph, "Relu", {previous}, {output});
+        }
+        previous = output;
+    }
+    setValueInfo(graph.add_output(), previous, ::ONNX_NAMESPACE::TensorProto::FLOAT, {1, kWIDTH});
+}
+
+//! size nodes that all read the graph input, concatenated into the graph output.
+void generateWideFanout(int64_t size, ::ONNX_NAMESPACE::GraphProto& graph, std::string* /*externalData*/)
+{
+    setValueInfo(graph.add_input(), "input", ::ONNX_NAMESPACE::TensorProto::FLOAT, {1, kWIDTH});
+    addFloatInitializer(graph, "bias", {kWIDTH}, 0.5F);
+    std::vector<std::string> branches;
+    branches.reserve(size);
+    for (int64_t i = 0; i < size; ++i)
+    {
+        branches.push_back("branch_" + std::to_string(i));
+        addNode(graph, "Add", {"input", "bias"}, {branches.back()});
+    }
+    auto* concat = addNode(graph, "Concat", branches, {"output"});
+    auto* axis = concat->add_attribute();
+    axis->set_name("axis");
+    axis->set_type(::ONNX_NAMESPACE::AttributeProto::INT);
+    axis->set_i(1);
+    setValueInfo(graph.add_output(), "output", ::ONNX_NAMESPACE::TensorProto::FLOAT, {1, kWIDTH * size});
+}
+
+//! A chain of MatMul nodes whose weights add up to size MiB.
+void generateMatMulChain(int64_t size, ::ONNX_NAMESPACE::GraphProto& graph, std::string* externalData)
+{
+    int64_t const matrixMiB = kMATRIX_SIZE * kMATRIX_SIZE * sizeof(float) >> 20;
+    int64_t const count = std::max<int64_t>(1, size / matrixMiB);
+    setValueInfo(graph.add_input(), "input", ::ONNX_NAMESPACE::TensorProto::FLOAT, {1, kMATRIX_SIZE});
+    std::string previous = "input";
+    for (int64_t i = 0; i < count; ++i)
+    {
+        std::string const weights = "weights_" + std::to_string(i);
+        std::string const output = "matmul_" + std::to_string(i);
+        addFloatInitializer(graph, weights, {kMATRIX_SIZE, kMATRIX_SIZE}, 1.F / kMATRIX_SIZE, externalData);
+        addNode(graph, "MatMul", {previous, weights}, {output});
+        previous = output;
+    }
+    setValueInfo(graph.add_output(), previous, ::ONNX_NAMESPACE::TensorProto::FLOAT, {1, kMATRIX_SIZE});
+}
+
+void generateLargeInitializers(int64_t size, ::ONNX_NAMESPACE::GraphProto& graph, std::string* /*externalData*/)
+{
+    generateMatMulChain(size, graph, nullptr);
+}
+
+void generateExternalData(int64_t size, ::ONNX_NAMESPACE::GraphProto& graph, std::string* externalData)
+{
+    generateMatMulChain(size, graph, externalData);
+}
+
+//! Fill graph, which reads x from its enclosing scope, with depth nested levels of alternating Loop and If nodes around
+//! an Add. Its only output is named output.
+void addControlFlowLevel(::ONNX_NAMESPACE::GraphProto& graph, int64_t depth, std::string const& x,
+    std::string const& output)
+{
+    std::string const prefix = "level" + std::to_string(depth) + "_";
+    if (depth == 0)
+    {
+        addNode(graph, "Add", {x, "bias"}, {output});
+        return;
+    }
+    auto const addBody = [&](::ONNX_NAMESPACE::AttributeProto* attr, std::string const& name) {
+        attr->set_name(name);
+        attr->set_type(::ONNX_NAMESPACE::AttributeProto::GRAPH);
+        auto* body = attr->mutable_g();
+        body->set_name(prefix + name);
+        return body;
+    };
+    if (depth % 2 == 0)
+    {
+        // Loop with two iterations that carries x.
+        auto* loop = addNode(graph, "Loop", {"trip_count", "loop_cond", x}, {output});
+        auto* body = addBody(loop->add_attribute(), "body");
+        setValueInfo(body->add_input(), prefix + "iteration", ::ONNX_NAMESPACE::TensorProto::INT64, {});
+        setValueInfo(body->add_input(), prefix + "cond_in", ::ONNX_NAMESPACE::TensorProto::BOOL, {});
+        setValueInfo(body->add_input(), prefix + "x_in", ::ONNX_NAMESPACE::TensorProto::FLOAT, {1, kWIDTH});
+        addNode(*body, "Identity", {prefix + "cond_in"}, {prefix + "cond_out"});
+        addControlFlowLevel(*body, depth - 1, prefix + "x_in", prefix + "x_out");
+        setValueInfo(body->add_output(), prefix + "cond_out", ::ONNX_NAMESPACE::TensorProto::BOOL, {});
+        setValueInfo(body->add_output(), prefix + "x_out", ::ONNX_NAMESPACE::TensorProto::FLOAT, {1, kWIDTH});
+    }
+    else
+    {
+        // If whose condition depends on the graph input, so that neither branch can be pruned while parsing.
+        auto* ifNode = addNode(graph, "If", {"if_cond"}, {output});
+        auto* thenBranch = addBody(ifNode->add_attribute(), "then_branch");
+        addControlFlowLevel(*thenBranch, depth - 1, x, prefix + "then_out");
+        setValueInfo(thenBranch->add_output(), prefix + "then_out", ::ONNX_NAMESPACE::TensorProto::FLOAT, {1, kWIDTH});
+        auto* elseBranch = addBody(ifNode->add_attribute(), "else_branch");
+        addNode(*elseBranch, "Identity", {x}, {prefix + "else_out"});
+        setValueInfo(elseBranch->add_output(), prefix + "else_out", ::ONNX_NAMESPACE::TensorProto::FLOAT, {1, kWIDTH});
+    }
+}
+
+//! size levels of nested Loop and If nodes.
+void generateNestedControlFlow(int64_t size, ::ONNX_NAMESPACE::GraphProto& graph, std::string* /*externalData*/)
+{
+    setValueInfo(graph.add_input(), "input", ::ONNX_NAMESPACE::TensorProto::FLOAT, {1, kWIDTH});
+    addFloatInitializer(graph, "bias", {kWIDTH}, 0.5F);
+    addFloatInitializer(graph, "threshold", {}, -1.F);
+    addScalarInitializer(graph, "trip_count", ::ONNX_NAMESPACE::TensorProto::INT64, 2);
+    addScalarInitializer(graph, "loop_cond", ::ONNX_NAMESPACE::TensorProto::BOOL, 1);
+    auto* sum = addNode(graph, "ReduceSum", {"input"}, {"input_sum"});
+    auto* keepdims = sum->add_attribute();
+    keepdims->set_name("keepdims");
+    keepdims->set_type(::ONNX_NAMESPACE::AttributeProto::INT);
+    keepdims->set_i(0);
+    addNode(graph, "Greater", {"input_sum", "threshold"}, {"if_cond"});
+    addControlFlowLevel(graph, size, "input", "output");
+    setValueInfo(graph.add_output(), "output", ::ONNX_NAMESPACE::TensorProto::FLOAT, {1, kWIDTH});
+}
+
+struct Generator
+{
+    char const* name;
+    int64_t defaultSize;
+    char const* sizeUnit;
+    void (*generate)(int64_t size, ::ONNX_NAMESPACE::GraphProto& graph, std::string* externalData);
+};
+
+constexpr Generator kGENERATORS[] = {
+    {"deep_chain", 100000, "nodes", &generateDeepChain},
+    {"wide_fanout", 10000, "nodes", &generateWideFanout},
+    {"large_initializers", 256, "MiB", &generateLargeInitializers},
+    {"external_data", 256, "MiB", &generateExternalData},
+    {"nested_control_flow", 8, "levels", &generateNestedControlFlow},
+};
+
+Generator const* findGenerator(std::string const& name)
+{
+    for (auto const& generator : kGENERATORS)
+    {
+        if (name == generator.name)
+        {
+            return &generator;
+        }
+    }
+    return nullptr;
+}
+
+//! Write the model of generator to directory as model.onnx, with its external data next to it. Returns the model path
+//! or an empty string on failure.
+std::string writeSyntheticModel(Generator const& generator, int64_t size, std::string const& directory)
+{
+    ::ONNX_NAMESPACE::ModelProto model;
+    model.set_ir_version(7);
+    model.set_producer_name("onnx2trt_bench");
+    auto* opset = model.add_opset_import();
+    opset->set_domain("");
+    opset->set_version(13);
+    auto* graph = model.mutable_graph();
+    graph->set_name(generator.name);
+
+    std::string externalData;
+    generator.generate(size, *graph, &externalData);
+
+    std::string const path = directory + "/model.onnx";
+    std::ofstream modelFile(path, std::ios::binary);
+    if (!model.SerializeToOstream(&modelFile))
+    {
+        return {};
+    }
+    if (!externalData.empty())
+    {
+        std::ofstream dataFile(directory + "/" + kEXTERNAL_DATA_FILE, std::ios::binary);
+        if (!dataFile.write(externalData.data(), externalData.size()))
+        {
+            return {};
+        }
+    }
+    return path;
+}
+
+// --------------------------------
+// Measurements
+// --------------------------------
+
+//! Read a field of /proc/self/status in kB, or -1 if it is not available.
+int64_t readProcStatusKb(char const* field)
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    size_t const length = std::strlen(field);
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, length, field) == 0 && line.size() > length && line[length] == ':')
+        {
+            return std::strtoll(line.c_str() + length + 1, nullptr, 10);
+        }
+    }
+    return -1;
+}
+
+//! Reset the peak resident set size of the process to its current size, so that the next reading covers only what
+//! happens in between. Supported since Linux 4.0, older kernels keep reporting the peak of the whole process.
+void resetPeakRss()
+{
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+}
+
+int64_t getPeakRssKb()
+{
+    return readProcStatusKb("VmHWM");
+}
+
+int64_t getRssKb()
+{
+    return readProcStatusKb("VmRSS");
+}
+
+int64_t getFileSize(std::string const& path)
+{
+    struct stat sb;
+    return stat(path.c_str(), &sb) == 0 ? static_cast<int64_t>(sb.st_size) : -1;
+}
+
+//! Value below which percent of the sorted samples lie, using the nearest rank.
+double percentile(std::vector<double> const& sorted, double percent)
+{
+    if (sorted.empty())
+    {
+        return 0.0;
+    }
+    size_t const rank = static_cast<size_t>(std::ceil(percent / 100.0 * sorted.size()));
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+size_t getElementSize(nvinfer1::DataType type)
+{
+    switch (type)
+    {
+    case nvinfer1::DataType::kFLOAT:
+    case nvinfer1::DataType::kINT32: return 4;
+    case nvinfer1::DataType::kHALF: return 2;
+    default: return 1;
+    }
+}
+
+void writeJsonString(std::ostream& stream, std::string const& s)
+{
+    stream << '"';
+    for (char const c : s)
+    {
+        switch (c)
+        {
+        case '"': stream << "\\\""; break;
+        case '\\': stream << "\\\\"; break;
+        case '\n': stream << "\\n"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int32_t>(c)
+                       << std::dec << std::setfill(' ');
+            }
+            else
+            {
+                stream << c;
+            }
+        }
+    }
+    stream << '"';
+}
+
+struct Options
+{
+    int32_t parseRuns{3};
+    bool build{false};
+    int32_t warmupIterations{10};
+    int32_t iterations{100};
+    nvonnxparser::OnnxParserFlags parserFlags{0};
+    size_t workspaceSize{size_t{1} << 30};
+    int32_t verbosity{static_cast<int32_t>(nvinfer1::ILogger::Severity::kWARNING)};
+};
+
+//! Build an engine from network, run it and add the build time and the inference latencies to json.
+bool benchmarkEngine(nvinfer1::IBuilder& builder, nvinfer1::INetworkDefinition& network, common::TRT_Logger& logger,
+    Options const& options, std::ostream& json, std::string& error)
+{
+    auto config = common::infer_object(builder.createBuilderConfig());
+    config->setMemoryPoolLimit(nvinfer1::MemoryPoolType::kWORKSPACE, options.workspaceSize);
+
+    // Dynamic dimensions of the inputs are benchmarked at 1.
+    nvinfer1::IOptimizationProfile* profile{nullptr};
+    for (int32_t i = 0; i < network.getNbInputs(); ++i)
+    {
+        auto* input = network.getInput(i);
+        nvinfer1::Dims dims = input->getDimensions();
+        if (std::none_of(dims.d, dims.d + dims.nbDims, [](int32_t d) { return d < 0; }))
+        {
+            continue;
+        }
+        if (input->isShapeTensor())
+        {
+            error = std::string("Shape tensor input ") + input->getName() + " needs values to be benchmarked.";
+            return false;
+        }
+        std::replace_if(dims.d, dims.d + dims.nbDims, [](int32_t d) { return d < 0; }, 1);
+        profile = profile ? profile : builder.createOptimizationProfile();
+        for (auto selector : {nvinfer1::OptProfileSelector::kMIN, nvinfer1::OptProfileSelector::kOPT,
+                 nvinfer1::OptProfileSelector::kMAX})
+        {
+            profile->setDimensions(input->getName(), selector, dims);
+        }
+    }
+    if (profile)
+    {
+        config->addOptimizationProfile(profile);
+    }
+
+    resetPeakRss();
+    auto const buildStart = Clock::now();
+    std::unique_ptr<nvinfer1::IHostMemory> plan{builder.buildSerializedNetwork(network, *config)};
+    double const buildMs = elapsedMs(buildStart);
+    int64_t const buildPeakRssKb = getPeakRssKb();
+    if (!plan)
+    {
+        error = "Failed to build the engine.";
+        return false;
+    }
+
+    auto runtime = common::infer_object(nvinfer1::createInferRuntime(logger));
+    auto engine = common::infer_object(runtime->deserializeCudaEngine(plan->data(), plan->size()));
+    auto context = common::infer_object(engine->createExecutionContext());
+
+    std::vector<void*> buffers;
+    auto const freeBuffers = [&buffers]() {
+        for (void* buffer : buffers)
+        {
+            cudaFree(buffer);
+        }
+    };
+    for (int32_t i = 0; i < engine->getNbIOTensors(); ++i)
+    {
+        char const* name = engine->getIOTensorName(i);
+        if (engine->getTensorIOMode(name) == nvinfer1::TensorIOMode::kINPUT)
+        {
+            nvinfer1::Dims dims = engine->getTensorShape(name);
+            std::replace_if(dims.d, dims.d + dims.nbDims, [](int32_t d) { return d < 0; }, 1);
+            context->setInputShape(name, dims);
+        }
+    }
+    for (int32_t i = 0; i < engine->getNbIOTensors(); ++i)
+    {
+        char const* name = engine->getIOTensorName(i);
+        nvinfer1::Dims const dims = context->getTensorShape(name);
+        size_t bytes = getElementSize(engine->getTensorDataType(name));
+        for (int32_t d = 0; d < dims.nbDims; ++d)
+        {
+            bytes *= static_cast<size_t>(std::max(dims.d[d], 0));
+        }
+        void* buffer{nullptr};
+        if (cudaMalloc(&buffer, std::max<size_t>(bytes, 1)) != cudaSuccess)
+        {
+            freeBuffers();
+            error = std::string("Failed to allocate the buffer of ") + name + ".";
+            return false;
+        }
+        buffers.push_back(buffer);
+        cudaMemset(buffer, 0, bytes);
+        context->setTensorAddress(name, buffer);
+    }
+
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+    std::vector<double> latencies;
+    latencies.reserve(options.iterations);
+    bool ok = true;
+    for (int32_t i = 0; i < options.warmupIterations + options.iterations && ok; ++i)
+    {
+        auto const start = Clock::now();
+        ok = context->enqueueV3(stream) && cudaStreamSynchronize(stream) == cudaSuccess;
+        if (i >= options.warmupIterations)
+        {
+            latencies.push_back(elapsedMs(start));
+        }
+    }
+    cudaStreamDestroy(stream);
+    freeBuffers();
+    if (!ok)
+    {
+        error = "Failed to run the engine.";
+        return false;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    double mean{0.0};
+    for (double const latency : latencies)
+    {
+        mean += latency / latencies.size();
+    }
+    json << ", \"build\": {\"milliseconds\": " << buildMs << ", \"peak_rss_kb\": " << buildPeakRssKb
+         << ", \"engine_bytes\": " << plan->size() << "}";
+    json << ", \"inference\": {\"iterations\": " << latencies.size() << ", \"mean_ms\": " << mean
+         << ", \"min_ms\": " << percentile(latencies, 0.0) << ", \"p50_ms\": " << percentile(latencies, 50.0)
+         << ", \"p90_ms\": " << percentile(latencies, 90.0) << ", \"p99_ms\": " << percentile(latencies, 99.0)
+         << ", \"max_ms\": " << (latencies.empty() ? 0.0 : latencies.back()) << "}";
+    return true;
+}
+
+//! Parse the model at path options.parseRuns times and, if requested, build and run the network of the last parse.
+//! Writes the JSON object of the benchmark, without its opening brace and name, to json.
+void benchmarkModel(std::string const& path, common::TRT_Logger& logger, Options const& options, std::ostream& json)
+{
+    json << ", \"model_bytes\": " << getFileSize(path);
+    auto builder = common::infer_object(nvinfer1::createInferBuilder(logger));
+    auto const explicitBatch
+        = 1U << static_cast<uint32_t>(nvinfer1::NetworkDefinitionCreationFlag::kEXPLICIT_BATCH);
+
+    std::shared_ptr<nvinfer1::INetworkDefinition> network;
+    std::shared_ptr<nvonnxparser::IParser> parser;
+    std::vector<double> parseMs;
+    int64_t rssBeforeKb{0};
+    int64_t parsePeakRssKb{0};
+    std::string error;
+    for (int32_t run = 0; run < options.parseRuns && error.empty(); ++run)
+    {
+        // Release the previous network first, so that the memory readings only cover this parse.
+        parser.reset();
+        network.reset();
+        network = common::infer_object(builder->createNetworkV2(explicitBatch));
+        parser = common::infer_object(nvonnxparser::createParser(*network, logger));
+        parser->setFlags(options.parserFlags);
+
+        rssBeforeKb = getRssKb();
+        resetPeakRss();
+        auto const start = Clock::now();
+        bool const parsed = parser->parseFromFile(path.c_str(), options.verbosity);
+        parseMs.push_back(elapsedMs(start));
+        parsePeakRssKb = getPeakRssKb();
+        if (!parsed)
+        {
+            error = parser->getNbErrors() ? parser->getError(0)->desc() : "Failed to parse the model.";
+        }
+    }
+
+    std::vector<double> sorted = parseMs;
+    std::sort(sorted.begin(), sorted.end());
+    json << ", \"parse\": {\"runs\": " << parseMs.size() << ", \"milliseconds\": [";
+    for (size_t i = 0; i < parseMs.size(); ++i)
+    {
+        json << (i ? ", " : "") << parseMs[i];
+    }
+    json << "], \"min_ms\": " << percentile(sorted, 0.0) << ", \"median_ms\": " << percentile(sorted, 50.0)
+         << ", \"rss_before_kb\": " << rssBeforeKb << ", \"peak_rss_kb\": " << parsePeakRssKb;
+    if (network)
+    {
+        json << ", \"layers\": " << network->getNbLayers();
+    }
+    char const* profile = parser ? parser->getParseProfile() : nullptr;
+    json << ", \"profile\": " << (profile ? profile : "null") << "}";
+
+    if (error.empty() && options.build)
+    {
+        benchmarkEngine(*builder, *network, logger, options, json, error);
+    }
+    if (!error.empty())
+    {
+        json << ", \"error\": ";
+        writeJsonString(json, error);
+    }
+}
+
+void printUsage()
+{
+    std::cout << "Benchmarks parsing ONNX models with TensorRT and, optionally, the engines built from them. "
+              << "Results are written as JSON." << std::endl;
+    std::cout << "Usage: onnx2trt_bench [-m model.onnx]... [-g generator[=size][,generator[=size]]...] [-r parse_runs]"
+              << " [-b] [-w warmup_iterations] [-i iterations] [-f parser_flags] [-o output.json] [-v verbosity]"
+              << std::endl;
+    std::cout << "Without -m or -g, all generators run with their default sizes:" << std::endl;
+    for (auto const& generator : kGENERATORS)
+    {
+        std::cout << "  " << generator.name << " (" << generator.defaultSize << " " << generator.sizeUnit << ")"
+                  << std::endl;
+    }
+    std::cout << "-b builds and runs the engine of each model, -f takes the OnnxParserFlags as an integer."
+              << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+    Options options;
+    std::vector<std::string> modelPaths;
+    std::vector<std::pair<Generator const*, int64_t>> generators;
+    std::string outputPath;
+    int c;
+    while ((c = getopt(argc, argv, "m:g:r:bw:i:f:o:v:h")) != -1)
+    {
+        switch (c)
+        {
+        case 'm': modelPaths.emplace_back(optarg); break;
+        case 'g':
+        {
+            std::stringstream list(optarg);
+            std::string item;
+            while (std::getline(list, item, ','))
+            {
+                size_t const equals = item.find('=');
+                Generator const* generator = findGenerator(item.substr(0, equals));
+                if (!generator)
+                {
+                    std::cerr << "Unknown generator: " << item << std::endl;
+                    return -1;
+                }
+                int64_t const size
+                    = equals == std::string::npos ? generator->defaultSize : std::atoll(item.c_str() + equals + 1);
+                generators.emplace_back(generator, size);
+            }
+            break;
+        }
+        case 'r': options.parseRuns = std::max(1, std::atoi(optarg)); break;
+        case 'b': options.build = true; break;
+        case 'w': options.warmupIterations = std::max(0, std::atoi(optarg)); break;
+        case 'i': options.iterations = std::max(1, std::atoi(optarg)); break;
+        case 'f':
+            options.parserFlags = static_cast<nvonnxparser::OnnxParserFlags>(std::strtoul(optarg, nullptr, 0));
+            break;
+        case 'o': outputPath = optarg; break;
+        case 'v': options.verbosity = std::atoi(optarg); break;
+        default: printUsage(); return c == 'h' ? 0 : -1;
+        }
+    }
+    if (modelPaths.empty() && generators.empty())
+    {
+        for (auto const& generator : kGENERATORS)
+        {
+            generators.emplace_back(&generator, generator.defaultSize);
+        }
+    }
+
+    // Logs go to stderr, so that the JSON can be written to stdout.
+    common::TRT_Logger logger(static_cast<nvinfer1::ILogger::Severity>(options.verbosity), std::cerr);
+    initLibNvInferPlugins(&logger, "");
+
+    std::ostringstream json;
+    json << std::setprecision(6) << std::fixed;
+    json << "{\"tensorrt_version\": " << getInferLibVersion() << ", \"parser_version\": " << getNvOnnxParserVersion()
+         << ", \"parser_flags\": " << options.parserFlags << ", \"benchmarks\": [";
+    bool first = true;
+    for (auto const& path : modelPaths)
+    {
+        json << (first ? "" : ", ") << "{\"name\": ";
+        writeJsonString(json, path);
+        benchmarkModel(path, logger, options, json);
+        json << "}";
+        first = false;
+    }
+
+    char const* tmpdir = std::getenv("TMPDIR");
+    for (auto const& entry : generators)
+    {
+        Generator const& generator = *entry.first;
+        int64_t const size = entry.second;
+        json << (first ? "" : ", ") << "{\"name\": \"" << generator.name << "\", \"size\": " << size
+             << ", \"size_unit\": \"" << generator.sizeUnit << "\"";
+        first = false;
+
+        std::string directory = std::string(tmpdir ? tmpdir : "/tmp") + "/onnx2trt_bench.XXXXXX";
+        if (!mkdtemp(&directory[0]))
+        {
+            json << ", \"error\": \"Failed to create a temporary directory.\"}";
+            continue;
+        }
+        std::cerr << "Generating " << generator.name << " with size " << size << std::endl;
+        std::string const path = writeSyntheticModel(generator, size, directory);
+        if (path.empty())
+        {
+            json << ", \"error\": \"Failed to write the model.\"";
+        }
+        else
+        {
+            benchmarkModel(path, logger, options, json);
+        }
+        json << "}";
+        std::remove((directory + "/model.onnx").c_str());
+        std::remove((directory + "/" + kEXTERNAL_DATA_FILE).c_str());
+        rmdir(directory.c_str());
+    }
+    json << "]}";
+
+    if (outputPath.empty())
+    {
+        std::cout << json.str() << std::endl;
+    }
+    else
+    {
+        std::ofstream output(outputPath);
+        output << json.str() << std::endl;
+        if (!output)
+        {
+            std::cerr << "ERROR: Failed to write " << outputPath << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -3,8 +3,10 @@
  */
 
 #include "onnx2trt_utils.hpp"
+#include "DataConversion.hpp"
 #include "OnnxAttrs.hpp"
 #include "NvInferSafeRuntime.h"
+#include <cmath>
 #include <set>
 
 namespace onnx2trt
@@ -367,39 +369,27 @@ bool convertDtype(int32_t onnx_dtype, nvinfer1::DataType* trt_dtype)
 int32_t* convertINT64(const int64_t* weightValues, nvinfer1::Dims shape, IImporterContext* ctx)
 {
     auto ctxImpl = static_cast<ImporterContext*>(ctx);
-    if (!ctxImpl->isConvertINT64Logged())
+    if (!ctxImpl->setConvertINT64Logged(true))
     {
         LOG_WARNING(
             "Your ONNX model has been generated with INT64 weights, while TensorRT does not natively support INT64. "
             "Attempting to cast down to INT32.");
-        ctxImpl->setConvertINT64Logged(true);
+        LOG_VERBOSE("Weight conversions use " << getDataConversionIsa() << " kernels.");
     }
 
     const size_t nbWeights = volume(shape);
     int32_t* int32Weights{
         reinterpret_cast<int32_t*>(ctx->createTempWeights(::ONNX_NAMESPACE::TensorProto::INT32, shape).values)};
 
-    bool outOfBounds{false};
-    for (size_t i = 0; i < nbWeights; i++)
+    size_t const nbClamped = convertInt64ToInt32(weightValues, int32Weights, nbWeights);
+    if (nbClamped > 0)
     {
-        if (weightValues[i] > static_cast<int64_t>(INT32_MAX) || weightValues[i] < static_cast<int64_t>(INT32_MIN))
-        {
-            int32Weights[i] = static_cast<int32_t>(
-                std::max(std::min(weightValues[i], static_cast<int64_t>(INT32_MAX)), static_cast<int64_t>(INT32_MIN)));
-            LOG_VERBOSE("Weight at index " << i << ": " << weightValues[i]
-                                           << " is out of range. Clamping to: " << int32Weights[i]);
-            outOfBounds = true;
-        }
-        else
+        LOG_VERBOSE(nbClamped << " of " << nbWeights << " INT64 weights are out of range and were clamped to INT32.");
+        if (!ctxImpl->setConvertINT64OutOfBoundsLogged(true))
         {
-            int32Weights[i] = static_cast<int32_t>(weightValues[i]);
+            LOG_WARNING("One or more weights outside the range of INT32 was clamped");
         }
     }
-    if (outOfBounds && !ctxImpl->isConvertINT64OutOfBoundsLogged())
-    {
-        LOG_WARNING("One or more weights outside the range of INT32 was clamped");
-        ctxImpl->setConvertINT64OutOfBoundsLogged(true);
-    }
 
     return int32Weights;
 }
@@ -467,6 +457,28 @@ onnx2trt::ShapedWeights createZeroShifts(const onnx2trt::ShapedWeights& shiftInt
     return shift;
 }
 
+onnx2trt::ShapedWeights quantizeWeightsINT8(
+    IImporterContext* ctx, onnx2trt::ShapedWeights const& weights, onnx2trt::ShapedWeights const& scale, int32_t axis)
+{
+    auto quantized = ctx->createTempWeights(::ONNX_NAMESPACE::TensorProto::INT8, weights.shape);
+    auto const* values = static_cast<float const*>(weights.values);
+    auto const* scales = static_cast<float const*>(scale.values);
+    auto* output = static_cast<int8_t*>(quantized.values);
+    int64_t const nbScales = scale.count();
+    int64_t innerVolume{1};
+    for (int32_t i = axis + 1; i < weights.shape.nbDims; ++i)
+    {
+        innerVolume *= weights.shape.d[i];
+    }
+    for (int64_t i = 0, n = weights.count(); i < n; ++i)
+    {
+        // std::nearbyint rounds half to even in the default rounding mode, like QuantizeLinear.
+        float const q = std::nearbyint(values[i] / scales[nbScales == 1 ? 0 : (i / innerVolume) % nbScales]);
+        output[i] = static_cast<int8_t>(std::max(-128.F, std::min(127.F, q)));
+    }
+    return quantized;
+}
+
 nvinfer1::ITensor* createZeroTensor(IImporterContext* ctx, nvinfer1::ITensor* data)
 {
     nvinfer1::ITensor* zero
@@ -496,54 +508,64 @@ int32_t* convertUINT8(const uint8_t* weightValues, nvinfer1::Dims shape, IImport
     int32_t* int32Weights{
         reinterpret_cast<int32_t*>(ctx->createTempWeights(::ONNX_NAMESPACE::TensorProto::INT32, shape).values)};
 
-    for (size_t i = 0; i < nbWeights; i++)
-    {
-        int32Weights[i] = static_cast<int32_t>(weightValues[i]);
-    }
+    convertUint8ToInt32(weightValues, int32Weights, nbWeights);
     return int32Weights;
 }
 
 float* convertDouble(const double* weightValues, nvinfer1::Dims shape, IImporterContext* ctx)
 {
     auto ctxImpl = static_cast<ImporterContext*>(ctx);
-    if (!ctxImpl->isConvertDoubleLogged())
+    if (!ctxImpl->setConvertDoubleLogged(true))
     {
         LOG_WARNING(
             "Your ONNX model has been generated with double-typed weights, while TensorRT does not natively support "
             "double. "
             "Attempting to cast down to float.");
-        ctxImpl->setConvertDoubleLogged(true);
     }
     const size_t nbWeights = volume(shape);
     float* floatWeights{
         reinterpret_cast<float*>(ctx->createTempWeights(::ONNX_NAMESPACE::TensorProto::FLOAT, shape).values)};
 
-    bool outOfBounds{false};
-    const double floatMax = static_cast<double>(std::numeric_limits<float>::max());
-    const double floatMin = static_cast<double>(std::numeric_limits<float>::lowest());
-    for (size_t i = 0; i < nbWeights; i++)
+    size_t const nbClamped = convertDoubleToFloat(weightValues, floatWeights, nbWeights);
+    if (nbClamped > 0)
     {
-        if (weightValues[i] > floatMax || weightValues[i] < floatMin)
+        LOG_VERBOSE(nbClamped << " of " << nbWeights << " DOUBLE weights are out of range and were clamped to FLOAT.");
+        if (!ctxImpl->setConvertDoubleOutOfBoundsLogged(true))
         {
-            floatWeights[i] = static_cast<float>(std::max(std::min(weightValues[i], floatMax), floatMin));
-            LOG_WARNING("Weight at index " << i << ": " << weightValues[i]
-                                           << " is out of range. Clamping to: " << floatWeights[i]);
-            outOfBounds = true;
+            LOG_WARNING("One or more weights outside the range of FLOAT was clamped");
         }
-        else
-        {
-            floatWeights[i] = static_cast<float>(weightValues[i]);
-        }
-    }
-    if (outOfBounds && !ctxImpl->isConvertDoubleOutOfBoundsLogged())
-    {
-        LOG_WARNING("One or more weights outside the range of FLOAT was clamped");
-        ctxImpl->setConvertDoubleOutOfBoundsLogged(true);
     }
 
     return floatWeights;
 }
 
+// Helper function to check that nbytes of external data hold exactly the elements of onnxDtype of shape. Computed
+// without overflow, as both come from the model.
+static bool isExternalDataSize(nvinfer1::Dims const& shape, int32_t onnxDtype, size_t nbytes)
+{
+    int const elementSize = getDtypeSize(onnxDtype);
+    if (elementSize <= 0 || nbytes % static_cast<size_t>(elementSize) != 0)
+    {
+        return false;
+    }
+    size_t const count = nbytes / static_cast<size_t>(elementSize);
+    size_t elements = 1;
+    for (int32_t i = 0; i < shape.nbDims; ++i)
+    {
+        if (shape.d[i] < 0)
+        {
+            return false;
+        }
+        size_t const dim = static_cast<size_t>(shape.d[i]);
+        if (dim != 0 && elements > count / dim)
+        {
+            return false;
+        }
+        elements *= dim;
+    }
+    return elements == count;
+}
+
 bool convertOnnxWeights(
     const ::ONNX_NAMESPACE::TensorProto& onnxTensor, onnx2trt::ShapedWeights* weights, IImporterContext* ctx)
 {
@@ -594,19 +616,24 @@ bool convertOnnxWeights(
             }
         }
 
-        // Buffer to hold the data read from the file
-        std::vector<char> dataBuf;
-        // Will update dataBuf and nbytes by reference.
-        if (!parseExternalWeights(ctx, location, ctx->getOnnxFileLocation(), offset, length, dataBuf, nbytes))
+        // Will update dataPtr and nbytes by reference. dataPtr points into a mapping owned by the context.
+        if (!parseExternalWeights(ctx, location, ctx->getOnnxFileLocation(), offset, length, dataPtr, nbytes))
         {
             return false;
         }
 
-        // For weights parsed from external files, createTempWeights is necessary to keep them in scope
-        ShapedWeights externalWeights;
-        dataPtr = dataBuf.data();
+        // Check the size of the external weights before the conversions below read the elements of shape from the
+        // mapping.
+        if (!isExternalDataSize(shape, onnxDtype, nbytes))
+        {
+            LOG_ERROR("Unexpected size for the external weights! Expected " << volume(shape) << " elements of "
+                << getDtypeSize(onnxDtype) << " bytes (shape = " << shape << "). Actual size: " << nbytes
+                << " bytes.");
+            return false;
+        }
 
-        // Cast non-native TRT types to their corresponding proxy types
+        // Cast non-native TRT types to their corresponding proxy types. These conversions read straight from the
+        // mapped file into temporary weights; every other type is used in place without a copy.
         if (onnxDtype == ::ONNX_NAMESPACE::TensorProto::INT64)
         {
             // Cast INT64 weights to INT32.
@@ -629,26 +656,7 @@ bool convertOnnxWeights(
             onnxDtype = ::ONNX_NAMESPACE::TensorProto::FLOAT;
         }
 
-        // Create the holder for external weights.
-        externalWeights = ctx->createTempWeights(onnxDtype, shape);
-
-        // Check if the size of external weights is as expected.
-        if (externalWeights.size_bytes() != nbytes)
-        {
-            LOG_ERROR("Unexpected size for the external weights! Expected size: "
-                << externalWeights.size_bytes()
-                << " bytes (shape = "
-                << shape
-                << "). Actual size: "
-                << nbytes
-                << " bytes.");
-            return false;
-        }
-
-        // Copy the weight values into externalWeights.
-        std::memcpy(externalWeights.values, dataPtr, nbytes);
-
-        *weights = externalWeights;
+        *weights = ShapedWeights(onnxDtype, dataPtr, shape);
         return true;
     }
 
@@ -793,16 +801,30 @@ nvinfer1::ITensor& convertToTensor(TensorOrWeights& input, IImporterContext* ctx
     {
         return *(existingConstantLayer->getOutput(0));
     }
+    // With kDEDUPLICATE_WEIGHTS, identical weights share a buffer and therefore a single constant layer.
+    auto* ctxImpl = static_cast<ImporterContext*>(ctx);
+    auto const sharedConstantLayer = ctxImpl->getSharedConstantLayer(weights);
+    if (sharedConstantLayer != nullptr)
+    {
+        return *(sharedConstantLayer->getOutput(0));
+    }
     auto* constantLayer = ctx->network()->addConstant(weights.shape, weights);
     // Register layer and constant name (if set) into RefitMap:
     if (weights.getName())
     {
         ctx->registerLayer(constantLayer, weights.getName(), nullptr);
-        ctx->network()->setWeightsName(weights, weights.getName());
+        setWeightsName(ctx, weights, weights.getName());
     }
+    ctxImpl->addSharedConstantLayer(weights, constantLayer);
     return *(constantLayer->getOutput(0));
 }
 
+void setWeightsName(IImporterContext* ctx, nvinfer1::Weights const& weights, char const* name)
+{
+    auto* ctxImpl = static_cast<ImporterContext*>(ctx);
+    ctx->network()->setWeightsName(weights, ctxImpl->getSharedWeightsName(weights.values, name));
+}
+
 nvinfer1::ITensor* convertToScalar(TensorOrWeights& input, IImporterContext* ctx)
 {
     if (input.is_tensor())
@@ -1469,7 +1491,7 @@ std::string normalizePath(std::string const& path)
 }
 
 bool parseExternalWeights(IImporterContext* ctx, std::string file, std::string path, int64_t offset, int64_t length,
-    std::vector<char>& weightsBuf, size_t& size)
+    void*& weightsBuf, size_t& size)
 {
     // Accessing parent directories (i.e. ../) is not allowed. Normalize path first.
     std::string normalizedFile = normalizePath(file);
@@ -1505,22 +1527,34 @@ bool parseExternalWeights(IImporterContext* ctx, std::string file, std::string p
         path = normalizedFile;
     }
     LOG_VERBOSE("Reading weights from external file: " << path);
-    std::ifstream relPathFile(path, std::ios::binary | std::ios::ate);
-    if (!relPathFile)
+    void* fileData{nullptr};
+    size_t fileSize{0};
+    if (!ctx->mapExternalFile(path, fileData, fileSize))
     {
-        LOG_ERROR("Failed to open file: " << path);
         return false;
     }
-    std::streamsize fileSize = relPathFile.tellg();
-    relPathFile.seekg(offset, std::ios::beg);
-    int64_t weightsBufSize = length == 0 ? fileSize : length;
-    weightsBuf.resize(weightsBufSize);
-    if (!relPathFile.read(weightsBuf.data(), weightsBuf.size()))
+    // A length of 0 means the weights extend to the end of the file. offset + length is never computed, as it can
+    // overflow for the values of a crafted model.
+    int64_t const fileBytes = static_cast<int64_t>(fileSize);
+    bool const validOffset = 0 <= offset && offset <= fileBytes;
+    int64_t const weightsBufSize = length == 0 && validOffset ? fileBytes - offset : length;
+    if (!validOffset || weightsBufSize < 0 || weightsBufSize > fileBytes - offset)
     {
-        LOG_ERROR("Failed to read weights from external file: " << path);
+        LOG_ERROR("Failed to read weights from external file: " << path << ". Requested " << weightsBufSize
+                                                               << " bytes at offset " << offset << " from a file of "
+                                                               << fileSize << " bytes.");
         return false;
     }
-    size = weightsBuf.size();
+    weightsBuf = fileData ? static_cast<uint8_t*>(fileData) + offset : nullptr;
+    size = static_cast<size_t>(weightsBufSize);
+    // Smaller weights are covered by the readahead of the OS.
+    constexpr size_t kPREFETCH_MIN_BYTES{1 << 20};
+    uint32_t const prefetchFlag = 1U << static_cast<uint32_t>(nvonnxparser::OnnxParserFlag::kPREFETCH_EXTERNAL_WEIGHTS);
+    if ((ctx->getFlags() & prefetchFlag) && size >= kPREFETCH_MIN_BYTES)
+    {
+        LOG_VERBOSE("Prefetching " << size << " bytes of external weights from " << path);
+        ctx->prefetchExternalData(weightsBuf, size);
+    }
     return true;
 }
 
@@ -2215,12 +2249,7 @@ float* convertFP16Data(void* weightValues, nvinfer1::Dims shape, IImporterContex
     size_t const nbWeights = volume(shape);
     float* newWeights{static_cast<float*>(ctx->createTempWeights(::ONNX_NAMESPACE::TensorProto::FLOAT, shape).values)};
 
-    half_float::half* tempValues = static_cast<half_float::half*>(weightValues);
-
-    for (size_t i = 0; i < nbWeights; i++)
-    {
-        newWeights[i] = tempValues[i];
-    }
+    convertHalfToFloat(static_cast<uint16_t const*>(weightValues), newWeights, nbWeights);
     return newWeights;
 }
 
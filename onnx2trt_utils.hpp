@@ -24,11 +24,14 @@
 #define LOG(msg, severity)                                                                                             \
     do                                                                                                                 \
     {                                                                                                                  \
-        std::stringstream ss{};                                                                                        \
-        if (severity <= nvinfer1::ILogger::Severity::kWARNING)                                                         \
-            ss << __FILENAME__ << ":" << __LINE__ << ": ";                                                             \
-        ss << msg;                                                                                                     \
-        ctx->logger().log(severity, ss.str().c_str());                                                                 \
+        if (severity <= ctx->getLoggerSeverity())                                                                      \
+        {                                                                                                              \
+            std::stringstream ss{};                                                                                    \
+            if (severity <= nvinfer1::ILogger::Severity::kWARNING)                                                     \
+                ss << __FILENAME__ << ":" << __LINE__ << ": ";                                                         \
+            ss << msg;                                                                                                 \
+            ctx->logger().log(severity, ss.str().c_str());                                                             \
+        }                                                                                                              \
     } while (0)
 
 #define LOG_VERBOSE(msg) LOG(msg, nvinfer1::ILogger::Severity::kVERBOSE)
@@ -190,6 +193,11 @@ bool shiftIsAllZeros(const ShapedWeights& shiftInt8);
 // Helper function to create zero shifts for QuantizeLinear/DequantizeLinear ops
 onnx2trt::ShapedWeights createZeroShifts(const onnx2trt::ShapedWeights& shiftInt8, int32_t type, IImporterContext* ctx);
 
+// Helper function to quantize FLOAT weights to INT8 on the host, rounding half to even and saturating. scale holds
+// either a single coefficient or one coefficient per index of axis.
+onnx2trt::ShapedWeights quantizeWeightsINT8(
+    IImporterContext* ctx, onnx2trt::ShapedWeights const& weights, onnx2trt::ShapedWeights const& scale, int32_t axis);
+
 // Helper function to create a tensor of all zeros with the same shape as a data tensor
 nvinfer1::ITensor* createZeroTensor(IImporterContext* ctx, nvinfer1::ITensor* data);
 
@@ -207,6 +215,10 @@ nvinfer1::ITensor* convertToScalar(IImporterContext* ctx, nvinfer1::ITensor* inp
 // Helper function to convert a ShapedWeights object into a tensor
 nvinfer1::ITensor& convertToTensor(TensorOrWeights& input, IImporterContext* ctx);
 
+// Helper function to name weights in the network. With kDEDUPLICATE_WEIGHTS, weights that share the buffer of earlier
+// identical weights are named after the first of them, as TensorRT only accepts one name per buffer.
+void setWeightsName(IImporterContext* ctx, nvinfer1::Weights const& weights, char const* name);
+
 // Helper function to convert a ShapedWeights object into a scalar
 nvinfer1::ITensor* convertToScalar(TensorOrWeights& input, IImporterContext* ctx);
 
@@ -300,9 +312,13 @@ NodeImportResult normalizationHelper(
 std::vector<float> parseLSTMActivationValues(const std::vector<nvinfer1::ActivationType>& activationTypes,
     const std::vector<float>& activationValues, bool isAlpha);
 
-// Helper function to read weights from an external file
+// Helper function to normalize a relative path, dropping repeated separators and resolving "./" and "../".
+std::string normalizePath(std::string const& path);
+
+// Helper function to locate weights in an external file. weightsBuf points into a memory mapping of the file owned
+// by ctx, so no copy of the data is made.
 bool parseExternalWeights(IImporterContext* ctx, std::string file, std::string path, int64_t offset, int64_t length,
-    std::vector<char>& weightsBuf, size_t& size);
+    void*& weightsBuf, size_t& size);
 
 // Helper function to map various ONNX pooling ops into TensorRT.
 NodeImportResult poolingHelper(IImporterContext* ctx, ::ONNX_NAMESPACE::NodeProto const& node,
@@ -0,0 +1,128 @@
+# SPDX-License-Identifier: Apache-2.0
+
+"""
+Measures the host overhead of a run of the Python backend on a small model, where it is comparable to the GPU time.
+Each call of TensorRTBackendRep.run() and Engine.run() is timed against the same copies and inference enqueued
+directly on the execution context, and the results are printed as JSON.
+"""
+
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+
+import argparse
+import json
+import time
+
+import numpy as np
+import onnx
+from onnx import helper as onnx_helper
+import tensorrt as trt
+
+import onnx_tensorrt.backend as backend
+
+
+def make_model(num_outputs, width, int64_outputs):
+    """
+    Returns a model with one input of shape (1, width) and num_outputs outputs, each the input plus a constant.
+    With int64_outputs, every other output is cast to INT64, which the backend widens back from INT32.
+    """
+    inputs = [onnx_helper.make_tensor_value_info("input", onnx.TensorProto.FLOAT, [1, width])]
+    nodes = []
+    initializers = []
+    outputs = []
+    for i in range(num_outputs):
+        bias = "bias_%i" % i
+        output = "output_%i" % i
+        initializers.append(onnx_helper.make_tensor(bias, onnx.TensorProto.FLOAT, [width], [float(i)] * width))
+        elem_type = onnx.TensorProto.FLOAT
+        if int64_outputs and i % 2 == 1:
+            nodes.append(onnx_helper.make_node("Add", ["input", bias], [output + "_float"]))
+            nodes.append(onnx_helper.make_node("Cast", [output + "_float"], [output], to=onnx.TensorProto.INT64))
+            elem_type = onnx.TensorProto.INT64
+        else:
+            nodes.append(onnx_helper.make_node("Add", ["input", bias], [output]))
+        outputs.append(onnx_helper.make_tensor_value_info(output, elem_type, [1, width]))
+    graph = onnx_helper.make_graph(nodes, "onnx_backend_bench", inputs, outputs, initializers)
+    return onnx_helper.make_model(graph, producer_name="onnx_backend_bench",
+                                  opset_imports=[onnx_helper.make_opsetid("", 13)])
+
+
+def time_calls(fn, warmup, iterations):
+    """
+    Returns the wall times of iterations calls of fn in microseconds, after warmup untimed calls.
+    """
+    for _ in range(warmup):
+        fn()
+    times = []
+    for _ in range(iterations):
+        start = time.perf_counter()
+        fn()
+        times.append((time.perf_counter() - start) * 1e6)
+    return times
+
+
+def summarize(times):
+    times = np.sort(np.array(times))
+    return {
+        "mean_us": float(np.mean(times)),
+        "p50_us": float(np.percentile(times, 50)),
+        "p90_us": float(np.percentile(times, 90)),
+        "p99_us": float(np.percentile(times, 99)),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--outputs", type=int, default=4, help="number of model outputs")
+    parser.add_argument("--width", type=int, default=16, help="elements per input and output")
+    parser.add_argument("--int64-outputs", action="store_true", help="make every other output INT64")
+    parser.add_argument("--warmup", type=int, default=100, help="untimed calls before measuring")
+    parser.add_argument("--iterations", type=int, default=10000, help="timed calls")
+    parser.add_argument("--device", default="CUDA:0", help="device to run on")
+    parser.add_argument("-o", "--output", help="file to write the JSON results to instead of stdout")
+    args = parser.parse_args()
+
+    model = make_model(args.outputs, args.width, args.int64_outputs)
+    rep = backend.prepare(model, device=args.device)
+    engine = rep.engine
+    inputs = [np.random.random(size=(1, args.width)).astype(np.float32)]
+
+    def run_context():
+        # The copies and inference of a run without any of the Python bookkeeping around them.
+        for input_array, binding in zip(inputs, engine.inputs):
+            binding.device_buffer.set_async(input_array, engine.stream)
+        engine.context.execute_async_v2(engine.binding_addrs, engine.stream.handle)
+        for binding in engine.outputs:
+            binding.device_buffer.get_async(engine.stream, binding.host_buffer)
+        engine.stream.synchronize()
+
+    results = {
+        "tensorrt_version": trt.__version__,
+        "outputs": args.outputs,
+        "width": args.width,
+        "int64_outputs": args.int64_outputs,
+        "iterations": args.iterations,
+    }
+    timings = {
+        "context": time_calls(run_context, args.warmup, args.iterations),
+        "engine_run": time_calls(lambda: engine.run(inputs), args.warmup, args.iterations),
+        "backend_run": time_calls(lambda: rep.run(inputs), args.warmup, args.iterations),
+    }
+    for name, times in timings.items():
+        results[name] = summarize(times)
+    # Host overhead of a call: its median time beyond that of the copies and inference alone.
+    floor = results["context"]["p50_us"]
+    for name in ("engine_run", "backend_run"):
+        results[name]["overhead_p50_us"] = results[name]["p50_us"] - floor
+
+    document = json.dumps(results, indent=2)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(document + "\n")
+    else:
+        print(document)
+
+
+if __name__ == "__main__":
+    main()
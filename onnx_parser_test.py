@@ -0,0 +1,223 @@
+# SPDX-License-Identifier: Apache-2.0
+
+# Tests of the optional import paths of the parser. Each test parses a small model with and without the parser flag
+# or pass under test, and compares the resulting networks and their outputs.
+
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+from __future__ import unicode_literals
+
+import unittest
+
+import numpy as np
+from onnx import helper, numpy_helper, TensorProto
+import tensorrt as trt
+
+import onnx_tensorrt.backend as backend
+
+# Values of nvonnxparser::OnnxParserFlag.
+kPARALLEL_INITIALIZER_IMPORT = 1 << 1
+kDEDUPLICATE_WEIGHTS = 1 << 2
+kFUSE_PATTERNS = 1 << 4
+kFOLD_CONSTANT_NODES = 1 << 8
+
+TRT_LOGGER = trt.Logger(trt.Logger.WARNING)
+
+
+def make_model(nodes, inputs, outputs, initializers=()):
+    graph = helper.make_graph(nodes, 'test', inputs, outputs, initializer=list(initializers))
+    return helper.make_model(graph, opset_imports=[helper.make_opsetid('', 13)])
+
+
+def parse(model, flags=0):
+    """
+    Parses model into a new network.
+    :return: the builder, the network and the parser, which owns the weights of the network
+    """
+    builder = trt.Builder(TRT_LOGGER)
+    network = builder.create_network(1 << int(trt.NetworkDefinitionCreationFlag.EXPLICIT_BATCH))
+    parser = trt.OnnxParser(network, TRT_LOGGER)
+    parser.flags = flags
+    if not parser.parse(model.SerializeToString()):
+        raise RuntimeError(parser.get_error(0).desc())
+    return builder, network, parser
+
+
+def layer_types(network):
+    return [network.get_layer(i).type for i in range(network.num_layers)]
+
+
+def tensor_names(network):
+    return [network.get_layer(i).get_output(j).name for i in range(network.num_layers)
+            for j in range(network.get_layer(i).num_outputs)]
+
+
+def refit_weights_names(model, flags=0):
+    """
+    Returns the sorted names of the refittable weights of the engine built from model.
+    """
+    builder, network, parser = parse(model, flags)
+    config = builder.create_builder_config()
+    config.set_flag(trt.BuilderFlag.REFIT)
+    plan = builder.build_serialized_network(network, config)
+    engine = trt.Runtime(TRT_LOGGER).deserialize_cuda_engine(plan)
+    return sorted(trt.Refitter(engine, TRT_LOGGER).get_all_weights())
+
+
+def run(model, inputs, flags=0):
+    return backend.prepare(model, device='CUDA:0', parser_flags=flags).run(inputs)
+
+
+class ParallelInitializerImportTest(unittest.TestCase):
+    def model(self):
+        # INT64 initializers are converted into temporary weights, and the FLOAT initializer named tmp_weight collides
+        # with the name of the first of them, so the generated names depend on the order of the conversions.
+        rng = np.random.RandomState(0)
+        initializers = [numpy_helper.from_array(np.array([1, -1], dtype=np.int64), 'shape'),
+                        numpy_helper.from_array(rng.standard_normal((2, 3, 3, 3)).astype(np.float32), 'W'),
+                        numpy_helper.from_array(rng.standard_normal((2, 1, 1)).astype(np.float32), 'tmp_weight'),
+                        numpy_helper.from_array(rng.standard_normal(2).astype(np.float32), 'B'),
+                        numpy_helper.from_array(np.array([0, 5, 31], dtype=np.int64), 'indices')]
+        nodes = [helper.make_node('Conv', ['X', 'W', 'B'], ['C'], pads=[1, 1, 1, 1]),
+                 helper.make_node('Add', ['C', 'tmp_weight'], ['D']),
+                 helper.make_node('Reshape', ['D', 'shape'], ['R']),
+                 helper.make_node('Gather', ['R', 'indices'], ['Y'], axis=1)]
+        return make_model(nodes, [helper.make_tensor_value_info('X', TensorProto.FLOAT, [1, 3, 4, 4])],
+                          [helper.make_tensor_value_info('Y', TensorProto.FLOAT, [1, 3])], initializers)
+
+    def test_network_matches_sequential_import(self):
+        model = self.model()
+        sequential = parse(model)[1]
+        for _ in range(3):
+            parallel = parse(model, kPARALLEL_INITIALIZER_IMPORT)[1]
+            self.assertEqual(layer_types(parallel), layer_types(sequential))
+            self.assertEqual(tensor_names(parallel), tensor_names(sequential))
+
+    def test_refit_names_match_sequential_import(self):
+        model = self.model()
+        names = refit_weights_names(model)
+        self.assertEqual(refit_weights_names(model, kPARALLEL_INITIALIZER_IMPORT), names)
+        self.assertEqual(refit_weights_names(model, kPARALLEL_INITIALIZER_IMPORT), names)
+
+    def test_outputs_match(self):
+        model = self.model()
+        x = np.random.RandomState(1).standard_normal((1, 3, 4, 4)).astype(np.float32)
+        np.testing.assert_array_equal(run(model, [x], kPARALLEL_INITIALIZER_IMPORT)[0], run(model, [x])[0])
+
+
+class DeduplicateWeightsTest(unittest.TestCase):
+    def model(self):
+        # Two convolutions with byte-identical kernels and biases stored in separate initializers.
+        rng = np.random.RandomState(0)
+        kernel = rng.standard_normal((3, 3, 3, 3)).astype(np.float32)
+        bias = rng.standard_normal(3).astype(np.float32)
+        initializers = [numpy_helper.from_array(kernel, 'W1'), numpy_helper.from_array(bias, 'B1'),
+                        numpy_helper.from_array(kernel.copy(), 'W2'), numpy_helper.from_array(bias.copy(), 'B2')]
+        nodes = [helper.make_node('Conv', ['X', 'W1', 'B1'], ['Y1'], pads=[1, 1, 1, 1]),
+                 helper.make_node('Conv', ['Y1', 'W2', 'B2'], ['Y'], pads=[1, 1, 1, 1])]
+        return make_model(nodes, [helper.make_tensor_value_info('X', TensorProto.FLOAT, [1, 3, 8, 8])],
+                          [helper.make_tensor_value_info('Y', TensorProto.FLOAT, [1, 3, 8, 8])], initializers)
+
+    def test_parses_with_identical_conv_weights(self):
+        model = self.model()
+        _, network, _ = parse(model, kDEDUPLICATE_WEIGHTS)
+        self.assertEqual(layer_types(network), layer_types(parse(model)[1]))
+
+    def test_refit_names_keep_the_first_initializer(self):
+        model = self.model()
+        names = refit_weights_names(model, kDEDUPLICATE_WEIGHTS)
+        self.assertIn('W1', names)
+        self.assertIn('B1', names)
+        self.assertNotIn('W2', names)
+        self.assertNotIn('B2', names)
+        self.assertEqual(names, refit_weights_names(model, kDEDUPLICATE_WEIGHTS))
+        self.assertTrue({'W1', 'B1', 'W2', 'B2'} <= set(refit_weights_names(model)))
+
+    def test_outputs_match(self):
+        model = self.model()
+        x = np.random.RandomState(1).standard_normal((1, 3, 8, 8)).astype(np.float32)
+        np.testing.assert_allclose(run(model, [x], kDEDUPLICATE_WEIGHTS)[0], run(model, [x])[0],
+                                   rtol=1e-5, atol=1e-5)
+
+
+class FoldConstantNodesTest(unittest.TestCase):
+    def shape_chain_model(self):
+        # Reshape X to the shape computed by Mul(Concat(rows, cols), ones).
+        initializers = [numpy_helper.from_array(np.array([6], dtype=np.int64), 'rows'),
+                        numpy_helper.from_array(np.array([4], dtype=np.int64), 'cols'),
+                        numpy_helper.from_array(np.array([1, 1], dtype=np.int64), 'ones')]
+        nodes = [helper.make_node('Concat', ['rows', 'cols'], ['dims'], axis=0),
+                 helper.make_node('Mul', ['dims', 'ones'], ['scaled']),
+                 helper.make_node('Identity', ['scaled'], ['shape']),
+                 helper.make_node('Reshape', ['X', 'shape'], ['Y'])]
+        return make_model(nodes, [helper.make_tensor_value_info('X', TensorProto.FLOAT, [2, 3, 4])],
+                          [helper.make_tensor_value_info('Y', TensorProto.FLOAT, [6, 4])], initializers)
+
+    def float_identity_model(self):
+        weights = np.arange(4, dtype=np.float32)
+        nodes = [helper.make_node('Identity', ['W'], ['V']),
+                 helper.make_node('Add', ['X', 'V'], ['Y'])]
+        return make_model(nodes, [helper.make_tensor_value_info('X', TensorProto.FLOAT, [4])],
+                          [helper.make_tensor_value_info('Y', TensorProto.FLOAT, [4])],
+                          [numpy_helper.from_array(weights, 'W')])
+
+    def test_shape_chain_is_folded(self):
+        model = self.shape_chain_model()
+        folded = layer_types(parse(model, kFOLD_CONSTANT_NODES)[1])
+        self.assertNotIn(trt.LayerType.CONCATENATION, folded)
+        self.assertNotIn(trt.LayerType.ELEMENTWISE, folded)
+        unfolded = layer_types(parse(model)[1])
+        self.assertIn(trt.LayerType.CONCATENATION, unfolded)
+        self.assertLess(len(folded), len(unfolded))
+
+    def test_shape_chain_outputs_match(self):
+        model = self.shape_chain_model()
+        x = np.random.RandomState(0).standard_normal((2, 3, 4)).astype(np.float32)
+        np.testing.assert_array_equal(run(model, [x], kFOLD_CONSTANT_NODES)[0], run(model, [x])[0])
+
+    def test_float_weights_are_not_folded(self):
+        model = self.float_identity_model()
+        self.assertEqual(layer_types(parse(model, kFOLD_CONSTANT_NODES)[1]), layer_types(parse(model)[1]))
+        self.assertIn('W', refit_weights_names(model, kFOLD_CONSTANT_NODES))
+
+
+class FusePatternsTest(unittest.TestCase):
+    def layer_norm_model(self, shift):
+        """
+        Decomposed layer normalization of X over its last axis, scaled by gamma and followed by an Add of shift.
+        """
+        rng = np.random.RandomState(0)
+        initializers = [numpy_helper.from_array(np.array(2.0, dtype=np.float32), 'two'),
+                        numpy_helper.from_array(np.array(1e-5, dtype=np.float32), 'eps'),
+                        numpy_helper.from_array(rng.standard_normal(8).astype(np.float32), 'gamma'),
+                        numpy_helper.from_array(rng.standard_normal(8).astype(np.float32), 'beta')]
+        nodes = [helper.make_node('ReduceMean', ['X'], ['mean'], axes=[-1]),
+                 helper.make_node('Sub', ['X', 'mean'], ['centered']),
+                 helper.make_node('Pow', ['centered', 'two'], ['squared']),
+                 helper.make_node('ReduceMean', ['squared'], ['variance'], axes=[-1]),
+                 helper.make_node('Add', ['variance', 'eps'], ['variance_eps']),
+                 helper.make_node('Sqrt', ['variance_eps'], ['std_dev']),
+                 helper.make_node('Div', ['centered', 'std_dev'], ['normalized']),
+                 helper.make_node('Mul', ['normalized', 'gamma'], ['scaled']),
+                 helper.make_node('Add', ['scaled', shift], ['Y'])]
+        return make_model(nodes, [helper.make_tensor_value_info('X', TensorProto.FLOAT, [2, 4, 8])],
+                          [helper.make_tensor_value_info('Y', TensorProto.FLOAT, [2, 4, 8])], initializers)
+
+    def check(self, model, expected_elementwise):
+        fused = layer_types(parse(model, kFUSE_PATTERNS)[1])
+        self.assertIn(trt.LayerType.NORMALIZATION, fused)
+        self.assertEqual(fused.count(trt.LayerType.ELEMENTWISE), expected_elementwise)
+        self.assertNotIn(trt.LayerType.NORMALIZATION, layer_types(parse(model)[1]))
+        x = np.random.RandomState(1).standard_normal((2, 4, 8)).astype(np.float32)
+        np.testing.assert_allclose(run(model, [x], kFUSE_PATTERNS)[0], run(model, [x])[0], rtol=1e-4, atol=1e-4)
+
+    def test_bias_is_fused(self):
+        self.check(self.layer_norm_model('beta'), 0)
+
+    def test_residual_is_not_fused_as_bias(self):
+        self.check(self.layer_norm_model('X'), 1)
+
+
+if __name__ == '__main__':
+    unittest.main()
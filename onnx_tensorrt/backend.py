@@ -1,7 +1,7 @@
 # SPDX-License-Identifier: Apache-2.0
 
 from __future__ import print_function
-from .tensorrt_engine import Engine
+from .tensorrt_engine import Engine, is_device_array
 import tensorrt as trt
 from onnx.backend.base import Backend, BackendRep, Device, DeviceType, namedtupledict
 import onnx
@@ -9,9 +9,17 @@ from onnx import helper as onnx_helper
 from onnx import numpy_helper
 import numpy as np
 import six
+import hashlib
+import json
+import os
+import tempfile
+try:
+    import fcntl
+except ImportError: # Windows, where the timing cache is shared without locking
+    fcntl = None
 
 # HACK Should look for a better way/place to do this
-from ctypes import cdll, c_char_p
+from ctypes import byref, cdll, c_char_p, c_int
 libcudart = cdll.LoadLibrary('libcudart.so')
 libcudart.cudaGetErrorString.restype = c_char_p
 def cudaSetDevice(device_idx):
@@ -22,6 +30,19 @@ def cudaSetDevice(device_idx):
             error_string = error_string.decode("utf-8")
         raise RuntimeError("cudaSetDevice: " + error_string)
 
+def cudaGetComputeCapability(device_idx):
+    # cudaDevAttrComputeCapabilityMajor = 75, cudaDevAttrComputeCapabilityMinor = 76
+    major = c_int()
+    minor = c_int()
+    for attr, value in ((75, major), (76, minor)):
+        ret = libcudart.cudaDeviceGetAttribute(byref(value), attr, device_idx)
+        if ret != 0:
+            error_string = libcudart.cudaGetErrorString(ret)
+            if isinstance(error_string, bytes):
+                error_string = error_string.decode("utf-8")
+            raise RuntimeError("cudaDeviceGetAttribute: " + error_string)
+    return major.value, minor.value
+
 def count_trailing_ones(vals):
     count = 0
     for val in reversed(vals):
@@ -30,23 +51,68 @@ def count_trailing_ones(vals):
         count += 1
     return count
 
+def power_of_two_bucket(dim):
+    """
+    Returns the (min, opt, max) range of the power-of-two bucket holding a dynamic dimension,
+    e.g. 5, 6, 7 and 8 all map to the bucket (5, 8, 8).
+    """
+    if dim <= 1:
+        return (dim, dim, dim)
+    upper = 1
+    while upper < dim:
+        upper <<= 1
+    return (upper // 2 + 1, upper, upper)
+
 TRT_LOGGER = trt.Logger(trt.Logger.WARNING)
 
 class TensorRTBackendRep(BackendRep):
     def __init__(self, model, device,
-            max_workspace_size=None, serialize_engine=False, verbose=False, **kwargs):
+            max_workspace_size=None, serialize_engine=False, verbose=False,
+            engine_cache_dir=None, shape_bucket=power_of_two_bucket, cuda_graph=False, timing_cache_path=None,
+            parser_flags=0, **kwargs):
+        """
+        :param engine_cache_dir: If set, built engines are serialized into this directory, keyed by a hash of the
+                                 model, the TensorRT version, the device compute capability, the workspace size and
+                                 the optimization profiles. A later prepare() of the same model on the same kind of
+                                 device deserializes the cached plan and skips the parser and builder.
+        :type engine_cache_dir: str
+        :param shape_bucket: Maps each dynamic dimension of an input to the (min, opt, max) range an engine is built
+                             for. Inputs whose shapes fall into the same buckets reuse one engine. If None, an
+                             engine is built for every distinct input shape.
+        :type shape_bucket: callable
+        :param cuda_graph: Replay runs with previously seen input shapes from captured CUDA graphs, which removes
+                           most of the launch overhead of small models.
+        :type cuda_graph: bool
+        :param timing_cache_path: If set, the builder looks up tactic timings in the TensorRT timing cache at this
+                                  path instead of profiling them again, and the timings of every build are merged back
+                                  into it. Access is serialized with a lock file, so concurrent builders on one host
+                                  can share the cache.
+        :type timing_cache_path: str
+        :param parser_flags: Bit mask of nvonnxparser::OnnxParserFlag values the model is parsed with, e.g.
+                             1 << 2 for kDEDUPLICATE_WEIGHTS.
+        :type parser_flags: int
+        """
         if not isinstance(device, Device):
             device = Device(device)
         self._set_device(device)
         self._logger = TRT_LOGGER
         self.builder = trt.Builder(self._logger)
         self.config = self.builder.create_builder_config()
-        self.network = self.builder.create_network(flags=1 << (int)(trt.NetworkDefinitionCreationFlag.EXPLICIT_BATCH))
-        self.parser = trt.OnnxParser(self.network, self._logger)
+        self.network = None
+        self.parser = None
+        self.runtime = None
         self.shape_tensor_inputs = []
         self.serialize_engine = serialize_engine
         self.verbose = verbose
         self.dynamic = False
+        self.engine_cache_dir = engine_cache_dir
+        self.shape_bucket = shape_bucket
+        self.cuda_graph = cuda_graph
+        self.timing_cache_path = timing_cache_path
+        self.parser_flags = parser_flags
+        self._timing_cache = None
+        self._engines = {} # Engines of dynamic networks, keyed by their optimization profile
+        self._output_plans = {} # Output post-processing of run(), keyed by engine
 
         if self.verbose:
             print(f'\nRunning {model.graph.name}...')
@@ -61,6 +127,43 @@ class TensorRTBackendRep(BackendRep):
             msg = "Failed to initialize TensorRT's plugin library."
             raise RuntimeError(msg)
 
+        if max_workspace_size is None:
+            max_workspace_size = 1 << 28
+
+        self.config.max_workspace_size = max_workspace_size
+        self._set_timing_cache(self.config)
+
+        self._model_hash = None
+        if self.engine_cache_dir is not None:
+            if not isinstance(model_str, bytes):
+                model_str = model_str.encode("utf-8")
+            self._model_hash = hashlib.sha256(model_str).hexdigest()
+
+        # An engine cached without optimization profiles can only come from a model with static inputs,
+        # so a hit means the network does not have to be parsed at all.
+        trt_engine = self._load_cached_engine([])
+        if trt_engine is not None:
+            self.engine = Engine(trt_engine, cuda_graph=self.cuda_graph)
+        else:
+            self._parse(model_str)
+
+        self._output_shapes = {}
+        self._output_dtype = {}
+        for output in model.graph.output:
+            dims = output.type.tensor_type.shape.dim
+            output_shape = tuple([dim.dim_value for dim in dims])
+            self._output_shapes[output.name] = output_shape
+            self._output_dtype[output.name] = output.type.tensor_type.elem_type
+
+    def _parse(self, model_str):
+        """
+        Parses the model into a new network and builds the engine unless the network has dynamic inputs.
+        """
+        self.network = self.builder.create_network(flags=1 << (int)(trt.NetworkDefinitionCreationFlag.EXPLICIT_BATCH))
+        self.parser = trt.OnnxParser(self.network, self._logger)
+        if self.parser_flags:
+            self.parser.flags = self.parser_flags
+
         if not self.parser.parse(model_str):
             error = self.parser.get_error(0)
             msg = "While parsing node number %i:\n" % error.node()
@@ -68,10 +171,6 @@ class TensorRTBackendRep(BackendRep):
                     (error.file(), error.line(), error.func(),
                      error.code(), error.desc()))
             raise RuntimeError(msg)
-        if max_workspace_size is None:
-            max_workspace_size = 1 << 28
-
-        self.config.max_workspace_size = max_workspace_size
 
         num_inputs = self.network.num_inputs
         for idx in range(num_inputs):
@@ -91,13 +190,6 @@ class TensorRTBackendRep(BackendRep):
                 print("Found dynamic inputs! Deferring engine build to run stage")
         else:
             self._build_engine()
-        self._output_shapes = {}
-        self._output_dtype = {}
-        for output in model.graph.output:
-            dims = output.type.tensor_type.shape.dim
-            output_shape = tuple([dim.dim_value for dim in dims])
-            self._output_shapes[output.name] = output_shape
-            self._output_dtype[output.name] = output.type.tensor_type.elem_type
 
     def _build_engine(self, inputs=None):
         """
@@ -107,32 +199,189 @@ class TensorRTBackendRep(BackendRep):
         :type inputs: List of np.ndarray
         """
 
+        # Each profile entry is (input name, is shape tensor, min, opt, max).
+        profile_shapes = []
         if inputs:
-            opt_profile = self.builder.create_optimization_profile()
             # Set optimization profiles for the input bindings that need them
             for i in range(self.network.num_inputs):
                 inp_tensor = self.network.get_input(i)
                 name = inp_tensor.name
-                # Set profiles for shape tensors
+                # Set profiles for shape tensors. Their values determine the output shapes, so they are not bucketed.
                 if inp_tensor.is_shape_tensor:
                     if inputs[i].ndim > 0:
                         val_list = inputs[i].tolist()
-                        opt_profile.set_shape_input(name, val_list, val_list, val_list)
                     else:
-                        opt_profile.set_shape_input(name, [inputs[i]], [inputs[i]], [inputs[i]])
+                        val_list = [inputs[i].item()]
+                    profile_shapes.append((name, True, val_list, val_list, val_list))
                 # Set profiles for dynamic execution tensors
                 elif -1 in inp_tensor.shape:
-                    opt_profile.set_shape(name, inputs[i].shape, inputs[i].shape, inputs[i].shape)
+                    min_shape, opt_shape, max_shape = [], [], []
+                    for network_dim, dim in zip(inp_tensor.shape, inputs[i].shape):
+                        if network_dim == -1 and self.shape_bucket is not None:
+                            dim_min, dim_opt, dim_max = self.shape_bucket(dim)
+                        else:
+                            dim_min, dim_opt, dim_max = dim, dim, dim
+                        min_shape.append(dim_min)
+                        opt_shape.append(dim_opt)
+                        max_shape.append(dim_max)
+                    profile_shapes.append((name, False, min_shape, opt_shape, max_shape))
+
+            profile_key = json.dumps(profile_shapes)
+            if profile_key in self._engines:
+                self.engine = self._engines[profile_key]
+                return
 
-            self.config.add_optimization_profile(opt_profile)
+        trt_engine = self._load_cached_engine([profile_shapes] if inputs else [])
+        if trt_engine is None:
+            config = self.config
+            if inputs:
+                # Every engine gets its own config, so it has exactly one optimization profile.
+                config = self.builder.create_builder_config()
+                config.max_workspace_size = self.config.max_workspace_size
+                self._set_timing_cache(config)
+                opt_profile = self.builder.create_optimization_profile()
+                for name, is_shape_tensor, min_shape, opt_shape, max_shape in profile_shapes:
+                    if is_shape_tensor:
+                        opt_profile.set_shape_input(name, min_shape, opt_shape, max_shape)
+                    else:
+                        opt_profile.set_shape(name, min_shape, opt_shape, max_shape)
+
+                config.add_optimization_profile(opt_profile)
+
+            trt_engine = self.builder.build_engine(self.network, config)
+
+            if trt_engine is None:
+                raise RuntimeError("Failed to build TensorRT engine from network")
+            self._store_timing_cache()
+            self._store_cached_engine([profile_shapes] if inputs else [], trt_engine)
+            if self.serialize_engine:
+                trt_engine = self._serialize_deserialize(trt_engine)
+        self.engine = Engine(trt_engine, cuda_graph=self.cuda_graph)
+        if inputs:
+            self._engines[profile_key] = self.engine
 
-        trt_engine = self.builder.build_engine(self.network, self.config)
+    def _engine_cache_path(self, profiles):
+        """
+        Returns the path of the cached plan for the given optimization profiles.
+        :param profiles: optimization profiles, each a list of (name, is shape tensor, min, opt, max) entries
+        """
+        major, minor = cudaGetComputeCapability(self.device.device_id)
+        key = json.dumps({
+            "model": self._model_hash,
+            "tensorrt": trt.__version__,
+            "sm": "%i%i" % (major, minor),
+            "max_workspace_size": self.config.max_workspace_size,
+            "parser_flags": self.parser_flags,
+            "profiles": profiles,
+        }, sort_keys=True)
+        return os.path.join(self.engine_cache_dir, hashlib.sha256(key.encode("utf-8")).hexdigest() + ".engine")
 
+    def _load_cached_engine(self, profiles):
+        """
+        Deserializes the cached engine for the given optimization profiles.
+        :return: the engine, or None if caching is disabled or there is no usable cached engine
+        """
+        if self.engine_cache_dir is None:
+            return None
+        path = self._engine_cache_path(profiles)
+        if not os.path.isfile(path):
+            return None
+        with open(path, "rb") as f:
+            serialized_engine = f.read()
+        if self.runtime is None:
+            self.runtime = trt.Runtime(TRT_LOGGER)
+        trt_engine = self.runtime.deserialize_cuda_engine(serialized_engine)
         if trt_engine is None:
-            raise RuntimeError("Failed to build TensorRT engine from network")
-        if self.serialize_engine:
-            trt_engine = self._serialize_deserialize(trt_engine)
-        self.engine = Engine(trt_engine)
+            # Stale or corrupt plans are rebuilt and overwritten.
+            print("Failed to deserialize cached engine %s, rebuilding it" % path)
+        elif self.verbose:
+            print("Loaded cached engine %s" % path)
+        return trt_engine
+
+    def _store_cached_engine(self, profiles, trt_engine):
+        """
+        Writes the serialized engine to the cache. The plan is written to a temporary file first,
+        so concurrent processes never read a partially written engine.
+        """
+        if self.engine_cache_dir is None:
+            return
+        os.makedirs(self.engine_cache_dir, exist_ok=True)
+        path = self._engine_cache_path(profiles)
+        fd, tmp_path = tempfile.mkstemp(dir=self.engine_cache_dir, suffix=".tmp")
+        try:
+            with os.fdopen(fd, "wb") as f:
+                f.write(trt_engine.serialize())
+            os.replace(tmp_path, path)
+        except:
+            os.remove(tmp_path)
+            raise
+        if self.verbose:
+            print("Saved engine to cache %s" % path)
+
+    def _timing_cache_lock(self):
+        """
+        Opens and locks the lock file of the timing cache. Closing the returned file releases the lock.
+        """
+        directory = os.path.dirname(os.path.abspath(self.timing_cache_path))
+        os.makedirs(directory, exist_ok=True)
+        lock = open(self.timing_cache_path + ".lock", "a")
+        if fcntl is not None:
+            fcntl.flock(lock, fcntl.LOCK_EX)
+        return lock
+
+    def _read_timing_cache(self):
+        """
+        Returns the serialized timing cache on disk, or an empty bytes object if there is none yet.
+        Must be called with the lock held.
+        """
+        if not os.path.isfile(self.timing_cache_path):
+            return b""
+        with open(self.timing_cache_path, "rb") as f:
+            return f.read()
+
+    def _set_timing_cache(self, config):
+        """
+        Attaches the timing cache to a builder config. The cache is loaded from disk the first time and then
+        shared by the configs of all engines, so builds see each other's timings.
+        """
+        if self.timing_cache_path is None:
+            return
+        if self._timing_cache is None:
+            with self._timing_cache_lock():
+                serialized_cache = self._read_timing_cache()
+            self._timing_cache = config.create_timing_cache(serialized_cache)
+            if self.verbose and serialized_cache:
+                print("Loaded timing cache %s" % self.timing_cache_path)
+        if self._timing_cache is None or not config.set_timing_cache(self._timing_cache, ignore_mismatch=False):
+            # A cache written by another TensorRT version or device is replaced by the next store.
+            print("Ignoring incompatible timing cache %s" % self.timing_cache_path)
+            self._timing_cache = config.create_timing_cache(b"")
+            config.set_timing_cache(self._timing_cache, ignore_mismatch=False)
+
+    def _store_timing_cache(self):
+        """
+        Merges the timings on disk into the timing cache and writes the result back, so that the entries other
+        processes stored since it was loaded are kept.
+        """
+        if self._timing_cache is None:
+            return
+        with self._timing_cache_lock():
+            serialized_cache = self._read_timing_cache()
+            if serialized_cache:
+                disk_cache = self.config.create_timing_cache(serialized_cache)
+                if disk_cache is not None:
+                    self._timing_cache.combine(disk_cache, ignore_mismatch=False)
+            directory = os.path.dirname(os.path.abspath(self.timing_cache_path))
+            fd, tmp_path = tempfile.mkstemp(dir=directory, suffix=".tmp")
+            try:
+                with os.fdopen(fd, "wb") as f:
+                    f.write(self._timing_cache.serialize())
+                os.replace(tmp_path, self.timing_cache_path)
+            except:
+                os.remove(tmp_path)
+                raise
+        if self.verbose:
+            print("Saved timing cache %s" % self.timing_cache_path)
 
     def _set_device(self, device):
         self.device = device
@@ -140,53 +389,75 @@ class TensorRTBackendRep(BackendRep):
         cudaSetDevice(device.device_id)
 
     def _serialize_deserialize(self, trt_engine):
-        self.runtime = trt.Runtime(TRT_LOGGER)
+        if self.runtime is None:
+            self.runtime = trt.Runtime(TRT_LOGGER)
         serialized_engine = trt_engine.serialize()
-        del self.parser # Parser no longer needed for ownership of plugins
+        if not self.dynamic:
+            self.parser = None # Parser no longer needed for ownership of plugins
         trt_engine = self.runtime.deserialize_cuda_engine(
                 serialized_engine)
         return trt_engine
 
-    def run(self, inputs, **kwargs):
+    def run(self, inputs, device_outputs=False, **kwargs):
         """Execute the prepared engine and return the outputs as a named tuple.
-        inputs -- Input tensor(s) as a Numpy array or list of Numpy arrays.
+        inputs -- Input tensor(s) as a Numpy array or list of Numpy arrays. Device arrays exposing
+                  __cuda_array_interface__ (CuPy, Torch CUDA tensors, pycuda GPUArrays) are bound without a copy.
+        device_outputs -- Return the outputs as pycuda GPUArrays that stay on the device. They are views of the
+                          engine's buffers and are overwritten by the next run.
         """
-        if isinstance(inputs, np.ndarray):
+        if isinstance(inputs, np.ndarray) or is_device_array(inputs):
             inputs = [inputs]
 
         if self.dynamic:
             self._build_engine(inputs)
 
-        outputs = self.engine.run(inputs)
-        output_names = [output.name for output in self.engine.outputs]
+        outputs = self.engine.run(inputs, device_outputs=device_outputs)
+        outputs_type, casts, unknown_shapes = self._output_plan(self.engine)
 
-        for i, (name, array) in enumerate(zip(output_names, outputs)):
-            output_shape = self._output_shapes[name]
+        for i in unknown_shapes:
             # HACK WAR for unknown output shape in run_node
-            if output_shape == (-99,):
-                # WAR for TRT requiring at least 2 dims (NC)
-                min_dims = 2
-                if _tensorrt_version()[0] < 4:
-                    # WAR for TRT only supporting 4D (NCHW) tensors
-                    min_dims = 4
-                if array.ndim == min_dims:
-                    npadding_dims = count_trailing_ones(array.shape)
-                    if npadding_dims > 0:
-                        outputs[i] = array.reshape(
-                            array.shape[:-npadding_dims])
-            else:
-                # HACK WAR replace fixed batch dim with variable
-                if self._output_dtype[name] == onnx.TensorProto.INT64 and array.dtype == np.int32:
-                    casted_output = np.array(outputs[i], dtype=np.int64)
-                    if np.equal(outputs[i], casted_output).all():
-                        outputs[i] = np.array(outputs[i], dtype=np.int64)
-                if self._output_dtype[name] == onnx.TensorProto.DOUBLE and array.dtype == np.float32:
-                    casted_output = np.array(outputs[i], dtype=np.double)
-                    if np.equal(outputs[i], casted_output).all():
-                        outputs[i] = np.array(outputs[i], dtype=np.double)
-
-        outputs_tuple = namedtupledict('Outputs', output_names)(*outputs)
-        return namedtupledict('Outputs', output_names)(*outputs)
+            array = outputs[i]
+            # WAR for TRT requiring at least 2 dims (NC)
+            min_dims = 2
+            if _tensorrt_version()[0] < 4:
+                # WAR for TRT only supporting 4D (NCHW) tensors
+                min_dims = 4
+            if array.ndim == min_dims:
+                npadding_dims = count_trailing_ones(array.shape)
+                if npadding_dims > 0:
+                    outputs[i] = array.reshape(
+                        array.shape[:-npadding_dims])
+        if not device_outputs:
+            # The dtype WARs need the values on the host.
+            for i, dtype in casts:
+                outputs[i] = outputs[i].astype(dtype)
+
+        return outputs_type(*outputs)
+
+    def _output_plan(self, engine):
+        """
+        Returns how run() post-processes the outputs of an engine: the named tuple type of the results, the
+        (index, dtype) of the outputs widened back to their ONNX type, and the indices of the outputs of unknown
+        shape. Everything only depends on the engine and the ONNX output types, so it is computed once per engine.
+        """
+        plan = self._output_plans.get(engine)
+        if plan is not None:
+            return plan
+        # TensorRT has no INT64 or DOUBLE, such outputs come back narrowed to INT32 or FLOAT.
+        widened = {(onnx.TensorProto.INT64, np.int32): np.int64,
+                   (onnx.TensorProto.DOUBLE, np.float32): np.double}
+        casts = []
+        unknown_shapes = []
+        for i, output in enumerate(engine.outputs):
+            if self._output_shapes[output.name] == (-99,):
+                unknown_shapes.append(i)
+                continue
+            dtype = widened.get((self._output_dtype[output.name], output.dtype))
+            if dtype is not None:
+                casts.append((i, dtype))
+        plan = (namedtupledict('Outputs', engine.output_names), casts, unknown_shapes)
+        self._output_plans[engine] = plan
+        return plan
 
 def np2onnx_dtype(np_dtype):
     if np_dtype == np.dtype('float32'):
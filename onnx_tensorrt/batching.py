@@ -0,0 +1,203 @@
+# SPDX-License-Identifier: Apache-2.0
+
+from __future__ import print_function
+import bisect
+import collections
+import threading
+import time
+from concurrent.futures import Future
+
+import numpy as np
+import pycuda.autoinit
+from onnx.backend.base import namedtupledict
+
+# Upper edges of the latency histogram buckets in milliseconds. Latencies above the last edge are counted in an
+# extra overflow bucket.
+LATENCY_BUCKETS_MS = (0.25, 0.5, 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024)
+
+class _Request(object):
+    def __init__(self, inputs):
+        self.inputs = inputs
+        self.batch_size = inputs[0].shape[0]
+        # Requests can only share a batch if everything but the batch dimension matches.
+        self.key = tuple((a.shape[1:], a.dtype.str) for a in inputs)
+        self.future = Future()
+        self.submit_time = time.monotonic()
+
+class DynamicBatcher(object):
+    """
+    Micro-batches requests to a TensorRTBackendRep. Requests queue up for at most max_queue_delay_ms, are
+    concatenated along the batch axis, run as one inference and the outputs are split back to the callers.
+
+    The batched inputs go through TensorRTBackendRep.run(), so their shapes are mapped to its shape buckets and
+    a batch of any size up to max_batch_size reuses the engine built for its bucket. All inputs and outputs of the
+    model must have a dynamic leading batch dimension.
+    """
+    def __init__(self, backend_rep, max_batch_size=8, max_queue_delay_ms=2.0):
+        """
+        :param backend_rep: a TensorRTBackendRep of a model with dynamic input shapes. It must not be run from
+                            other threads while the batcher is open.
+        :param max_batch_size: largest sum of the batch sizes of the requests run together. A single request
+                               larger than this runs on its own.
+        :param max_queue_delay_ms: longest time the oldest queued request waits for others to join its batch
+        """
+        if not backend_rep.dynamic:
+            raise ValueError("Dynamic batching needs a model with a dynamic batch dimension.")
+        for i in range(backend_rep.network.num_inputs):
+            inp_tensor = backend_rep.network.get_input(i)
+            if inp_tensor.is_shape_tensor or len(inp_tensor.shape) == 0 or inp_tensor.shape[0] != -1:
+                raise ValueError("Input %s does not have a dynamic batch dimension." % inp_tensor.name)
+        if max_batch_size < 1:
+            raise ValueError("max_batch_size must be at least 1, got %i." % max_batch_size)
+
+        self.backend_rep = backend_rep
+        self.max_batch_size = max_batch_size
+        self.max_queue_delay = max_queue_delay_ms / 1000.0
+
+        self._pending = collections.deque()
+        self._cond = threading.Condition()
+        self._closed = False
+        self._stats_lock = threading.Lock()
+        self._batch_size_histogram = collections.Counter()
+        self._latency_histogram = [0] * (len(LATENCY_BUCKETS_MS) + 1)
+
+        self._worker = threading.Thread(target=self._serve, name="DynamicBatcher", daemon=True)
+        self._worker.start()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def submit(self, inputs):
+        """
+        Queues a request.
+        :param inputs: input array or list of input arrays, in the order of the model inputs, all with the same
+                       batch size in their leading dimension
+        :return: a concurrent.futures.Future of the named tuple of outputs
+        """
+        if isinstance(inputs, np.ndarray):
+            inputs = [inputs]
+        inputs = [np.asarray(array) for array in inputs]
+        if any(array.ndim == 0 for array in inputs):
+            raise ValueError("Batched inputs must have a leading batch dimension.")
+        if len(set(array.shape[0] for array in inputs)) != 1:
+            raise ValueError("All inputs of a request must have the same batch size, got %s." %
+                             [array.shape[0] for array in inputs])
+        request = _Request(inputs)
+        with self._cond:
+            if self._closed:
+                raise RuntimeError("Cannot submit to a closed DynamicBatcher.")
+            self._pending.append(request)
+            self._cond.notify()
+        return request.future
+
+    def run(self, inputs):
+        """
+        Queues a request and waits for its outputs, as TensorRTBackendRep.run() does.
+        """
+        return self.submit(inputs).result()
+
+    def close(self):
+        """
+        Runs the requests still queued and stops the worker thread.
+        """
+        with self._cond:
+            self._closed = True
+            self._cond.notify()
+        self._worker.join()
+
+    def stats(self):
+        """
+        :return: dict with the "batch_size" histogram, mapping batch sizes to the number of batches of that size,
+                 and the "latency_ms" histogram of requests from submit to completion, as a list of
+                 (bucket upper edge, count) pairs in which the last edge is infinity
+        """
+        with self._stats_lock:
+            edges = list(LATENCY_BUCKETS_MS) + [float("inf")]
+            return {
+                "batch_size": dict(self._batch_size_histogram),
+                "latency_ms": list(zip(edges, self._latency_histogram)),
+            }
+
+    def _take_batch(self):
+        """
+        Waits for the oldest request's delay to expire or for a full batch, then removes the requests of that
+        batch from the queue. Must be called with self._cond held.
+        :return: list of requests, empty once the batcher is closed and drained
+        """
+        while not self._pending and not self._closed:
+            self._cond.wait()
+        if not self._pending:
+            return []
+
+        first = self._pending[0]
+        deadline = first.submit_time + self.max_queue_delay
+        while not self._closed:
+            queued = sum(r.batch_size for r in self._pending if r.key == first.key)
+            remaining = deadline - time.monotonic()
+            if queued >= self.max_batch_size or remaining <= 0:
+                break
+            self._cond.wait(remaining)
+
+        batch = [self._pending.popleft()]
+        total = first.batch_size
+        kept = collections.deque()
+        while self._pending:
+            request = self._pending.popleft()
+            if request.key == first.key and total + request.batch_size <= self.max_batch_size:
+                batch.append(request)
+                total += request.batch_size
+            else:
+                kept.append(request)
+        self._pending = kept
+        return batch
+
+    def _serve(self):
+        # pycuda contexts are bound to threads, the engine's context has to be made current here as well.
+        pycuda.autoinit.context.push()
+        try:
+            while True:
+                with self._cond:
+                    batch = self._take_batch()
+                if not batch:
+                    return
+                self._run_batch(batch)
+        finally:
+            pycuda.autoinit.context.pop()
+
+    def _run_batch(self, batch):
+        try:
+            if len(batch) == 1:
+                inputs = batch[0].inputs
+            else:
+                inputs = [np.concatenate(arrays, axis=0) for arrays in zip(*[r.inputs for r in batch])]
+            outputs = self.backend_rep.run(inputs)
+            output_names = outputs._fields
+            total = sum(r.batch_size for r in batch)
+            for name, array in zip(output_names, outputs):
+                if array.ndim == 0 or array.shape[0] != total:
+                    raise ValueError("Output %s of shape %s cannot be split into batches of %s." %
+                                     (name, array.shape, [r.batch_size for r in batch]))
+            # Outputs are views of the engine's buffers, each request gets a copy of its slice.
+            offset = 0
+            results = []
+            for request in batch:
+                end = offset + request.batch_size
+                results.append(namedtupledict('Outputs', output_names)(
+                    *[np.array(array[offset:end]) for array in outputs]))
+                offset = end
+        except Exception as e:
+            for request in batch:
+                request.future.set_exception(e)
+            return
+
+        done = time.monotonic()
+        with self._stats_lock:
+            self._batch_size_histogram[total] += 1
+            for request in batch:
+                latency_ms = (done - request.submit_time) * 1000.0
+                self._latency_histogram[bisect.bisect_left(LATENCY_BUCKETS_MS, latency_ms)] += 1
+        for request, result in zip(batch, results):
+            request.future.set_result(result)
@@ -1,5 +1,6 @@
 # SPDX-License-Identifier: Apache-2.0
 
+import collections
 import tensorrt as trt
 import pycuda.driver
 import pycuda.gpuarray
@@ -7,8 +8,19 @@ import pycuda.autoinit
 import numpy as np
 from six import string_types
 
+# Upper bound on the CUDA graphs an Engine keeps, evicting the oldest first
+MAX_CACHED_GRAPHS = 16
+
+def buffer_view(buf, shape):
+    """
+    Returns a view of the leading elements of a host or device buffer with the given shape.
+    """
+    if shape == buf.shape:
+        return buf
+    return buf.ravel()[:int(np.prod(shape))].reshape(shape)
+
 class Binding(object):
-    def __init__(self, engine, idx_or_name):
+    def __init__(self, engine, idx_or_name, max_shape=None):
         if isinstance(idx_or_name, string_types):
             self.name = idx_or_name
             self.index  = engine.get_binding_index(self.name)
@@ -33,6 +45,12 @@ class Binding(object):
         self.dtype = dtype_map[dtype]
         shape = engine.get_binding_shape(self.index)
 
+        # Buffers of dynamic bindings are allocated for the largest shape of the optimization profile
+        # and each run uses a view of them.
+        self.is_dynamic = -1 in tuple(shape)
+        self.is_shape_input = self.is_input and engine.is_shape_binding(self.index)
+        if self.is_dynamic:
+            shape = max_shape
         self.shape = tuple(shape)
         # Must allocate a buffer of size 1 for empty inputs / outputs
         if 0 in self.shape:
@@ -54,10 +72,15 @@ class Binding(object):
         if self._device_buf is None:
             self._device_buf = pycuda.gpuarray.empty(self.shape, self.dtype)
         return self._device_buf
-    def get_async(self, stream):
-        src = self.device_buffer
-        dst = self.host_buffer
-        src.get_async(stream, dst)
+    def device_view(self, shape):
+        return buffer_view(self.device_buffer, shape)
+    def host_view(self, shape):
+        return buffer_view(self.host_buffer, shape)
+    def get_async(self, stream, shape=None):
+        if shape is None:
+            shape = self.shape
+        dst = self.host_view(shape)
+        self.device_view(shape).get_async(stream, dst)
         return dst
 
 def squeeze_hw(x):
@@ -67,16 +90,56 @@ def squeeze_hw(x):
         x = x.reshape(x.shape[:-1])
     return x
 
-def check_input_validity(input_idx, input_array, input_binding):
-    # Check shape
+def is_device_array(x):
+    """
+    Returns whether x is a GPU array that can be bound without a copy, i.e. it exposes
+    __cuda_array_interface__ (pycuda GPUArray, CuPy, Numba, Torch CUDA tensors).
+    """
+    return hasattr(x, '__cuda_array_interface__')
+
+def check_input_shape(input_idx, onnx_shape, input_binding):
     trt_shape = tuple(input_binding.shape)
-    onnx_shape    = tuple(input_array.shape)
+    onnx_shape = tuple(onnx_shape)
 
-    if onnx_shape != trt_shape:
+    if input_binding.is_dynamic:
+        # The optimization profile bounds are checked when the shape is set on the execution context.
+        if len(onnx_shape) != len(trt_shape):
+            raise ValueError("Wrong rank for input %i. Expected %i, got %i." %
+                            (input_idx, len(trt_shape), len(onnx_shape)))
+    elif onnx_shape != trt_shape:
         if not (trt_shape == (1,) and onnx_shape == ()) :
             raise ValueError("Wrong shape for input %i. Expected %s, got %s." %
                             (input_idx, trt_shape, onnx_shape))
 
+def check_device_input_validity(input_idx, input_array, input_binding):
+    """
+    Checks a device input against its binding.
+    :return: the device pointer and shape of the input
+    """
+    interface = input_array.__cuda_array_interface__
+    shape = tuple(interface['shape'])
+    check_input_shape(input_idx, shape, input_binding)
+
+    dtype = np.dtype(interface['typestr'])
+    if dtype != input_binding.dtype:
+        # Unlike host inputs, INT64 device inputs are not narrowed here, as that would need a device copy.
+        raise TypeError("Wrong dtype for device input %i. Expected %s, got %s." %
+                        (input_idx, input_binding.dtype, dtype))
+
+    strides = interface.get('strides')
+    if strides is not None:
+        expected_strides = []
+        stride = dtype.itemsize
+        for dim in reversed(shape):
+            expected_strides.insert(0, stride)
+            stride *= dim
+        if tuple(strides) != tuple(expected_strides) and int(np.prod(shape)) > 1:
+            raise ValueError("Device input %i must be C-contiguous." % input_idx)
+    return interface['data'][0], shape
+
+def check_input_validity(input_idx, input_array, input_binding):
+    check_input_shape(input_idx, input_array.shape, input_binding)
+
     # Check dtype
     if input_array.dtype != input_binding.dtype:
         #TRT does not support INT64, need to convert to INT32
@@ -93,29 +156,132 @@ def check_input_validity(input_idx, input_array, input_binding):
     return input_array
 
 
+class _PipelineSlot(object):
+    """
+    One set of buffers and events of Engine.run_pipelined(). Each run in flight uses its own slot, so its
+    uploads and downloads can overlap with the inference of the runs before and after it.
+    """
+    def __init__(self, bindings):
+        self.host_buffers = {b.index: pycuda.driver.pagelocked_empty(b.shape, b.dtype) for b in bindings}
+        self.device_buffers = {b.index: pycuda.gpuarray.empty(b.shape, b.dtype) for b in bindings}
+        self.binding_addrs = [self.device_buffers[b.index].ptr for b in sorted(bindings, key=lambda b: b.index)]
+        self.uploaded = pycuda.driver.Event()
+        self.computed = pycuda.driver.Event()
+        self.downloaded = pycuda.driver.Event()
+        self.output_shapes = None # Output shapes of the run in flight, None if the slot is idle
+
 class Engine(object):
-    def __init__(self, trt_engine):
+    def __init__(self, trt_engine, cuda_graph=False):
+        """
+        :param cuda_graph: Capture the copies and inference of a run into a CUDA graph the first time a set of input
+                           shapes is seen, and replay the graph for later runs with the same shapes. Inputs are then
+                           staged through page-locked buffers. Replays and captures are counted in graph_hits and
+                           graph_misses.
+        """
         self.engine = trt_engine
         nbinding = self.engine.num_bindings
+        self.context = self.engine.create_execution_context()
+
+        # Size the buffers of dynamic engines, which have a single optimization profile, for its largest shapes.
+        for i in range(nbinding):
+            if not self.engine.binding_is_input(i):
+                continue
+            if self.engine.is_shape_binding(i):
+                self.context.set_shape_input(i, self.engine.get_profile_shape_input(0, i)[2])
+            elif -1 in tuple(self.engine.get_binding_shape(i)):
+                self.context.set_binding_shape(i, self.engine.get_profile_shape(0, i)[2])
 
-        bindings = [Binding(self.engine, i)
+        bindings = [Binding(self.engine, i, tuple(self.context.get_binding_shape(i)))
                     for i in range(nbinding)]
         self.binding_addrs = [b.device_buffer.ptr for b in bindings]
         self.inputs  = [b for b in bindings if     b.is_input]
         self.outputs = [b for b in bindings if not b.is_input]
+        self.dynamic = any(b.is_dynamic or b.is_shape_input for b in bindings)
 
         for binding in self.inputs + self.outputs:
             _ = binding.device_buffer # Force buffer allocation
         for binding in self.outputs:
             _ = binding.host_buffer   # Force buffer allocation
-        self.context = self.engine.create_execution_context()
         self.stream = pycuda.driver.Stream()
 
+        # IO plan of run(), fixed once per engine. Host inputs that match a static binding exactly skip validation,
+        # and static engines reuse their output shapes and result views.
+        self.output_names = tuple(b.name for b in self.outputs)
+        self._input_plan = tuple((b, np.dtype(b.dtype), None if b.is_dynamic or b.is_shape_input else b.shape)
+                                 for b in self.inputs)
+        self._static_output_shapes = None
+        self._host_results = None
+        if not self.dynamic:
+            self._static_output_shapes = [b.shape for b in self.outputs]
+            self._host_results = [np.empty(shape=b.empty_shape, dtype=b.dtype) if b.empty else b.host_buffer
+                                  for b in self.outputs]
+
+        self._pipeline_slots = []
+        self._upload_stream = None
+        self._download_stream = None
+
+        self.cuda_graph = cuda_graph
+        self._graphs = {} # Instantiated graphs by input signature, None if the run could not be captured
+        self.graph_hits = 0
+        self.graph_misses = 0
+        if self.cuda_graph:
+            for binding in self.inputs:
+                _ = binding.host_buffer # Staging buffers the graphs upload from
+            # Recorded once the uploads of a run have read the staging buffers, so the next run can refill them.
+            self._inputs_uploaded = pycuda.driver.Event()
+
     def __del__(self):
         if self.engine is not None:
             del self.engine
 
-    def run(self, inputs):
+    def _enqueue(self, input_arrays, output_shapes, binding_addrs, device_outputs, uploaded_event=None):
+        """
+        Enqueues the uploads, inference and downloads of a run on self.stream. This is the sequence captured
+        into CUDA graphs, so it must not synchronize.
+        :param input_arrays: host arrays to upload, None for inputs bound directly from device memory
+        :param uploaded_event: event to record after the uploads, not used while capturing
+        """
+        for input_array, input_binding in zip(input_arrays, self.inputs):
+            if input_array is None:
+                continue
+            input_binding_array = input_binding.device_buffer
+            if input_binding.is_dynamic:
+                input_binding_array = input_binding.device_view(input_array.shape)
+            input_binding_array.set_async(input_array, self.stream)
+        if uploaded_event is not None:
+            uploaded_event.record(self.stream)
+
+        self.context.execute_async_v2(
+            binding_addrs, self.stream.handle)
+
+        if device_outputs:
+            return
+        for output_binding, shape in zip(self.outputs, output_shapes):
+            if not output_binding.empty and 0 not in shape:
+                output_binding.get_async(self.stream, shape)
+
+    def _capture(self, *enqueue_args):
+        """
+        Captures a run into a CUDA graph.
+        :return: the instantiated graph, or None if this engine or pycuda does not support capture
+        """
+        try:
+            self.stream.begin_capture()
+            try:
+                self._enqueue(*enqueue_args)
+            finally:
+                graph = self.stream.end_capture()
+            return graph.instance()
+        except (AttributeError, pycuda.driver.Error) as e:
+            print("Cannot capture a CUDA graph for this engine, running it without graphs: %s" % e)
+            return None
+
+    def _prepare_inputs(self, inputs):
+        """
+        Validates the inputs of a run and sets their shapes on the execution context.
+        :return: the host input arrays (None for device inputs), the input shapes, the binding addresses with
+                 device inputs bound in place, and the output shapes of the run
+        """
         # len(inputs) > len(self.inputs) with Shape operator, input is never used
         # len(inputs) == len(self.inputs) for other operators
         if len(inputs) < len(self.inputs):
@@ -124,24 +290,202 @@ class Engine(object):
         if isinstance(inputs, dict):
             inputs = [inputs[b.name] for b in self.inputs]
 
+        input_arrays = []
+        input_shapes = []
+        binding_addrs = self.binding_addrs
+        for i, (input_array, (input_binding, dtype, static_shape)) in enumerate(zip(inputs, self._input_plan)):
+            if (static_shape is not None and type(input_array) is np.ndarray and input_array.dtype == dtype
+                    and input_array.shape == static_shape):
+                # Nothing to check or to set on the context for an exact match of a static binding.
+                input_arrays.append(input_array)
+                input_shapes.append(static_shape)
+                continue
+            if is_device_array(input_array):
+                if input_binding.is_shape_input:
+                    raise TypeError("Shape tensor input %i must be a host array, "
+                                    "its values are needed to set up the run." % i)
+                ptr, shape = check_device_input_validity(i, input_array, input_binding)
+                if not input_binding.empty and 0 not in shape:
+                    if binding_addrs is self.binding_addrs:
+                        binding_addrs = list(binding_addrs)
+                    binding_addrs[input_binding.index] = ptr
+                input_array = None
+            else:
+                input_array = check_input_validity(i, input_array, input_binding)
+                shape = input_array.shape
+            if input_binding.is_shape_input:
+                self.context.set_shape_input(input_binding.index, np.atleast_1d(input_array).tolist())
+            elif input_binding.is_dynamic:
+                if not self.context.set_binding_shape(input_binding.index, shape):
+                    raise ValueError("Shape %s of input %i is outside of the engine's optimization profile." %
+                                     (shape, i))
+            input_arrays.append(input_array)
+            input_shapes.append(shape)
 
-        for i, (input_array, input_binding) in enumerate(zip(inputs, self.inputs)):
-            input_array = check_input_validity(i, input_array, input_binding)
-            input_binding_array = input_binding.device_buffer
-            input_binding_array.set_async(input_array, self.stream)
+        if self.dynamic:
+            output_shapes = [tuple(self.context.get_binding_shape(output.index))
+                             for output in self.outputs]
+        else:
+            output_shapes = self._static_output_shapes
+        return input_arrays, input_shapes, binding_addrs, output_shapes
 
-        self.context.execute_async_v2(
-            self.binding_addrs, self.stream.handle)
+    def run(self, inputs, device_outputs=False):
+        """
+        Runs the engine and waits for the results.
+        :param inputs: list or dict of input arrays. Arrays exposing __cuda_array_interface__ are bound directly,
+                       without a copy; all other inputs are treated as host arrays.
+        :param device_outputs: return the outputs as pycuda GPUArrays instead of downloading them
+        :return: list of output arrays
+        """
+        results, _ = self.run_async(inputs, device_outputs)
+        self.stream.synchronize()
+        return results
+
+    def run_async(self, inputs, device_outputs=False):
+        """
+        Enqueues a run on self.stream without waiting for it.
+        Device inputs must stay alive and unmodified, and the results must not be read, until the returned event
+        has completed. Results, host or device, are views of the engine's buffers, which the next run overwrites.
+        With cuda_graph, host inputs are copied to staging buffers before returning, after waiting for the previous
+        run to finish uploading from them.
+        :return: list of output arrays and a pycuda Event recorded after the run
+        """
+        input_arrays, input_shapes, binding_addrs, output_shapes = self._prepare_inputs(inputs)
+
+        if self.cuda_graph:
+            # Graphs upload from fixed addresses, so host inputs go through the staging buffers. Those of the
+            # previous run may still be being uploaded.
+            self._inputs_uploaded.synchronize()
+            staged_arrays = []
+            for input_array, input_binding in zip(input_arrays, self.inputs):
+                if input_array is None:
+                    staged_arrays.append(None)
+                    continue
+                staged_array = input_binding.host_buffer
+                if input_binding.is_dynamic:
+                    staged_array = input_binding.host_view(input_array.shape)
+                np.copyto(staged_array, input_array.reshape(staged_array.shape))
+                staged_arrays.append(staged_array)
+            # Values of shape tensor inputs determine the work of the engine, not just the data. Device inputs
+            # are baked into the graph by address.
+            signature = tuple(input_array.tobytes() if input_binding.is_shape_input else shape
+                              for input_array, shape, input_binding in zip(input_arrays, input_shapes, self.inputs))
+            signature += (tuple(binding_addrs), device_outputs)
+            enqueue_args = (staged_arrays, output_shapes, binding_addrs, device_outputs)
+            if signature not in self._graphs:
+                if len(self._graphs) >= MAX_CACHED_GRAPHS:
+                    # Callers cycling through many device buffers would otherwise grow the cache without bound.
+                    self._graphs.pop(next(iter(self._graphs)))
+                # The regular run also lets TensorRT finish any deferred setup for these shapes before capture.
+                self._enqueue(*enqueue_args, uploaded_event=self._inputs_uploaded)
+                self._graphs[signature] = self._capture(*enqueue_args)
+                self.graph_misses += 1
+            elif self._graphs[signature] is None:
+                self._enqueue(*enqueue_args, uploaded_event=self._inputs_uploaded)
+            else:
+                self._graphs[signature].launch(self.stream)
+                # The uploads are part of the graph, so only its end orders them before the next staging.
+                self._inputs_uploaded.record(self.stream)
+                self.graph_hits += 1
+        else:
+            self._enqueue(input_arrays, output_shapes, binding_addrs, device_outputs)
+
+        if self._host_results is not None and not device_outputs:
+            results = list(self._host_results)
+        else:
+            results = self._collect_results(output_shapes, device_outputs)
 
-        results = [output.get_async(self.stream)
-                   for output in self.outputs]
+        event = pycuda.driver.Event()
+        event.record(self.stream)
+        return results, event
 
-        # For any empty bindings, update the result shape to the expected empty shape
-        for i, (output_array, output_binding) in enumerate(zip(results, self.outputs)):
+    def _collect_results(self, output_shapes, device_outputs):
+        """
+        Returns views of the output buffers with the shapes of a run, or new arrays for empty outputs.
+        """
+        results = []
+        for output_binding, shape in zip(self.outputs, output_shapes):
+            # For any empty bindings, return an array of the expected empty shape
             if output_binding.empty:
-                results[i] = np.empty(shape=output_binding.empty_shape, dtype=output_binding.dtype)
+                shape = output_binding.empty_shape
+            if device_outputs:
+                if output_binding.empty or 0 in shape:
+                    results.append(pycuda.gpuarray.empty(shape, output_binding.dtype))
+                else:
+                    results.append(output_binding.device_view(shape))
+            elif output_binding.empty or 0 in shape:
+                results.append(np.empty(shape=shape, dtype=output_binding.dtype))
+            else:
+                results.append(output_binding.host_view(shape))
+        return results
 
-        self.stream.synchronize()
+    def run_pipelined(self, inputs_iterable, depth=2):
+        """
+        Runs a stream of inputs with the uploads and downloads of neighbouring runs overlapping inference.
+        While run k executes, the inputs of run k+1 are uploaded and the outputs of run k-1 downloaded, each on
+        its own stream, ordered by events. Up to depth runs are in flight, each with its own buffers.
+        :param inputs_iterable: iterable of lists or dicts of host input arrays, consumed up to depth - 1 runs
+                                ahead of the yielded outputs
+        :param depth: number of runs in flight, 2 for double and 3 for triple buffering
+        :return: generator of lists of output arrays, in the order of the inputs
+        """
+        if depth < 1:
+            raise ValueError("Pipeline depth must be at least 1, got %i." % depth)
+        bindings = self.inputs + self.outputs
+        while len(self._pipeline_slots) < depth:
+            self._pipeline_slots.append(_PipelineSlot(bindings))
+        if self._upload_stream is None:
+            self._upload_stream = pycuda.driver.Stream()
+            self._download_stream = pycuda.driver.Stream()
+        slots = self._pipeline_slots[:depth]
+
+        in_flight = collections.deque()
+        for run_index, inputs in enumerate(inputs_iterable):
+            slot = slots[run_index % depth]
+            if slot.output_shapes is not None:
+                # The slot is still in use by the oldest run in flight, hand its outputs out first.
+                yield self._collect_pipelined(in_flight.popleft())
+
+            input_arrays, input_shapes, _, output_shapes = self._prepare_inputs(inputs)
+            for i, (input_array, input_binding) in enumerate(zip(input_arrays, self.inputs)):
+                if input_array is None:
+                    raise TypeError("Pipelined runs take host inputs, input %i is a device array." % i)
+                shape = input_array.shape if input_binding.is_dynamic else input_binding.shape
+                staged = buffer_view(slot.host_buffers[input_binding.index], shape)
+                np.copyto(staged, input_array.reshape(staged.shape))
+                buffer_view(slot.device_buffers[input_binding.index], shape).set_async(staged, self._upload_stream)
+            slot.uploaded.record(self._upload_stream)
+
+            self.stream.wait_for_event(slot.uploaded)
+            self.context.execute_async_v2(slot.binding_addrs, self.stream.handle)
+            slot.computed.record(self.stream)
+
+            self._download_stream.wait_for_event(slot.computed)
+            for output_binding, shape in zip(self.outputs, output_shapes):
+                if not output_binding.empty and 0 not in shape:
+                    buffer_view(slot.device_buffers[output_binding.index], shape).get_async(
+                        self._download_stream, buffer_view(slot.host_buffers[output_binding.index], shape))
+            slot.downloaded.record(self._download_stream)
+            slot.output_shapes = output_shapes
+            in_flight.append(slot)
+
+        while in_flight:
+            yield self._collect_pipelined(in_flight.popleft())
+
+    def _collect_pipelined(self, slot):
+        """
+        Waits for the downloads of a pipelined run and returns copies of its outputs, so the slot can be reused.
+        """
+        slot.downloaded.synchronize()
+        results = []
+        for output_binding, shape in zip(self.outputs, slot.output_shapes):
+            if output_binding.empty:
+                results.append(np.empty(shape=output_binding.empty_shape, dtype=output_binding.dtype))
+            elif 0 in shape:
+                results.append(np.empty(shape=shape, dtype=output_binding.dtype))
+            else:
+                results.append(np.array(buffer_view(slot.host_buffers[output_binding.index], shape)))
+        slot.output_shapes = None
         return results
 
     def run_no_dma(self, batch_size):
@@ -5,12 +5,26 @@
 #include "NvOnnxParser.h"
 #include "onnx/onnxifi.h"
 #include <NvInfer.h>
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <cstdio>
 #include <ctime>
 #include <cuda_runtime.h>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <memory>
 #include <mutex>
+#include <sstream>
+#include <sys/file.h>
 #include <thrust/device_vector.h>
+#include <unistd.h>
 #include <unordered_map>
+#include <vector>
 
 #define BACKEND_NAME "TensorRT"
 #define BACKEND_VENDOR "Nvidia"
@@ -19,6 +33,15 @@
 #define BACKEND_IR_VERSION "3"
 #define BACKEND_OPSET_VERSION "ai.onnx:7"
 
+// Property of onnxInitBackend whose value is a pointer to the null-terminated path of a TensorRT timing cache, which
+// is loaded before and merged back into after every engine build of the backend. Overrides the environment variable
+// ONNX_TRT_TIMING_CACHE.
+#define ONNXIFI_BACKEND_PROPERTY_TRT_TIMING_CACHE_PATH UINT64_C(0x8000000000000001)
+// Property of onnxInitBackend whose value is a bit mask of CUDA device IDs. The graphs of the backend are built once
+// on the device of the backend and replicated onto the devices of the mask, and runs are spread across the replicas.
+// Overrides the environment variable ONNX_TRT_REPLICA_DEVICES, a comma-separated list of device IDs or "all".
+#define ONNXIFI_BACKEND_PROPERTY_TRT_REPLICA_DEVICE_MASK UINT64_C(0x8000000000000002)
+
 namespace
 {
 
@@ -55,6 +78,10 @@ public:
         , _ostream(&ostream)
     {
     }
+    Severity verbosity() const
+    {
+        return _verbosity;
+    }
     void log(Severity severity, const char* msg) override
     {
         if (severity <= _verbosity)
@@ -71,21 +98,39 @@ public:
     }
 };
 
-onnxStatus CheckShape(const nvinfer1::Dims& dims, const onnxTensorDescriptorV1& desc, bool allow_same_size)
+// Convert the shape of a descriptor to TensorRT dimensions. Fails for ranks TensorRT does not support.
+bool GetTensorDims(const onnxTensorDescriptorV1& desc, nvinfer1::Dims* dims)
 {
-    bool matched = false;
-    if (desc.dimensions == static_cast<uint32_t>(dims.nbDims) + 1)
+    if (desc.dimensions > static_cast<uint32_t>(nvinfer1::Dims::MAX_DIMS))
     {
-        matched = true;
+        return false;
+    }
+    dims->nbDims = static_cast<int32_t>(desc.dimensions);
+    for (uint32_t i = 0; i < desc.dimensions; ++i)
+    {
+        dims->d[i] = static_cast<int32_t>(desc.shape[i]);
+    }
+    return true;
+}
+
+// Check a tensor shape against the dimensions of a binding, in which -1 marks a dynamic extent that matches any
+// size. If allow_same_size, shapes with the same number of elements also match, which binds outputs with an
+// implicit reshape.
+onnxStatus CheckShape(const nvinfer1::Dims& dims, const nvinfer1::Dims& shape, bool allow_same_size, const char* name)
+{
+    if (shape.nbDims == dims.nbDims)
+    {
+        bool matched = true;
         for (int i = 0; i < dims.nbDims; ++i)
         {
-            if (desc.shape[i + 1] != static_cast<uint64_t>(dims.d[i]))
-            {
-                return ONNXIFI_STATUS_MISMATCHING_SHAPE;
-            }
+            matched = matched && (dims.d[i] == -1 || dims.d[i] == shape.d[i]);
+        }
+        if (matched)
+        {
+            return ONNXIFI_STATUS_SUCCESS;
         }
     }
-    else if (allow_same_size && desc.dimensions > 1)
+    if (allow_same_size)
     {
         size_t dim_size = 1;
         for (int i = 0; i < dims.nbDims; ++i)
@@ -93,19 +138,34 @@ onnxStatus CheckShape(const nvinfer1::Dims& dims, const onnxTensorDescriptorV1&
             dim_size *= dims.d[i];
         }
         size_t desc_size = 1;
-        // Skip the first dim which is batch size
-        for (uint32_t i = 1; i < desc.dimensions; ++i)
+        for (int i = 0; i < shape.nbDims; ++i)
         {
-            desc_size *= desc.shape[i];
+            desc_size *= shape.d[i];
         }
-        matched = (dim_size == desc_size) ? true : false;
-        if (!matched)
+        if (dim_size == desc_size)
         {
-            std::cerr << "mismatched output " << desc.name << ": " << desc_size << " vs " << dim_size << std::endl;
+            return ONNXIFI_STATUS_SUCCESS;
         }
+        std::cerr << "mismatched output " << name << ": " << desc_size << " vs " << dim_size << std::endl;
     }
 
-    return matched ? ONNXIFI_STATUS_SUCCESS : ONNXIFI_STATUS_MISMATCHING_SHAPE;
+    return ONNXIFI_STATUS_MISMATCHING_SHAPE;
+}
+
+// Check that buffers described with an ONNXIFI data type can be bound to a TensorRT tensor of a given type.
+bool IsCompatibleDataType(nvinfer1::DataType trt_type, onnxEnum onnxifi_type)
+{
+    switch (trt_type)
+    {
+    case nvinfer1::DataType::kFLOAT: return onnxifi_type == ONNXIFI_DATATYPE_FLOAT32;
+    case nvinfer1::DataType::kHALF: return onnxifi_type == ONNXIFI_DATATYPE_FLOAT16;
+    case nvinfer1::DataType::kINT8: return onnxifi_type == ONNXIFI_DATATYPE_INT8;
+    case nvinfer1::DataType::kINT32: return onnxifi_type == ONNXIFI_DATATYPE_INT32;
+    // ONNXIFI has no boolean type, booleans are passed as one byte each.
+    case nvinfer1::DataType::kBOOL:
+    case nvinfer1::DataType::kUINT8: return onnxifi_type == ONNXIFI_DATATYPE_UINT8;
+    default: return false;
+    }
 }
 
 size_t GetTensorFootprint(const onnxTensorDescriptorV1& input)
@@ -247,22 +307,244 @@ private:
     int saved_device_{-1};
     bool need_restore_{false};
 };
+// Exclusive lock of a timing cache on disk, held through a lock file next to it so that builders in other processes
+// never read a cache while it is being replaced. The lock is released when the file is closed.
+class TimingCacheLock
+{
+public:
+    explicit TimingCacheLock(std::string const& path)
+        : fd_(::open((path + ".lock").c_str(), O_RDWR | O_CREAT, 0644))
+    {
+        if (fd_ < 0 || ::flock(fd_, LOCK_EX) != 0)
+        {
+            std::cerr << "Cannot lock timing cache " << path << ", accessing it without a lock" << std::endl;
+        }
+    }
+
+    ~TimingCacheLock()
+    {
+        if (fd_ >= 0)
+        {
+            ::close(fd_);
+        }
+    }
+
+private:
+    int fd_{-1};
+};
+
+// Contents of the timing cache at path, empty if there is none yet. Must be called with the lock held.
+std::vector<char> ReadTimingCache(std::string const& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return {};
+    }
+    std::vector<char> blob(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    if (!file.read(blob.data(), blob.size()))
+    {
+        return {};
+    }
+    return blob;
+}
+
+// Replace the timing cache at path. The cache is written to a temporary file first, so that a crash never leaves a
+// truncated cache behind. Must be called with the lock held.
+bool WriteTimingCache(std::string const& path, nvinfer1::IHostMemory const& blob)
+{
+    std::string const tmp_path = path + ".tmp." + std::to_string(::getpid());
+    {
+        std::ofstream file(tmp_path, std::ios::binary);
+        if (!file.write(static_cast<char const*>(blob.data()), blob.size()))
+        {
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+    return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+// Pool of device buffers and pinned host staging buffers for one device. Footprints are rounded up to size classes,
+// so IO whose shapes change slightly still reuses buffers, and the free buffers of each kind are kept in least
+// recently released order. Once the free buffers of a kind hold more than max_cached_bytes, the oldest are returned
+// to CUDA.
+class BufferPool
+{
+public:
+    BufferPool(int device_id, size_t max_cached_bytes)
+        : device_id_(device_id)
+        , max_cached_bytes_(max_cached_bytes)
+    {
+    }
+
+    ~BufferPool()
+    {
+        CudaDeviceGuard guard(device_id_);
+        for (auto const& buffer : free_device_.buffers)
+        {
+            cudaFree(buffer.second);
+        }
+        for (auto const& buffer : free_host_.buffers)
+        {
+            cudaFreeHost(buffer.second);
+        }
+    }
+
+    void* AcquireDevice(size_t footprint)
+    {
+        size_t const size = SizeClass(footprint);
+        if (void* buffer = Take(free_device_, size))
+        {
+            return buffer;
+        }
+        void* buffer{nullptr};
+        return cudaMalloc(&buffer, size) == cudaSuccess ? buffer : nullptr;
+    }
+
+    void* AcquireHost(size_t footprint)
+    {
+        size_t const size = SizeClass(footprint);
+        if (void* buffer = Take(free_host_, size))
+        {
+            return buffer;
+        }
+        void* buffer{nullptr};
+        return cudaHostAlloc(&buffer, size, cudaHostAllocDefault) == cudaSuccess ? buffer : nullptr;
+    }
+
+    // Buffers must not be in use by any pending work when they are released.
+    void ReleaseDevice(void* buffer, size_t footprint)
+    {
+        std::vector<void*> const evicted = Put(free_device_, SizeClass(footprint), buffer);
+        if (!evicted.empty())
+        {
+            CudaDeviceGuard guard(device_id_);
+            for (void* old : evicted)
+            {
+                cudaFree(old);
+            }
+        }
+    }
+
+    void ReleaseHost(void* buffer, size_t footprint)
+    {
+        std::vector<void*> const evicted = Put(free_host_, SizeClass(footprint), buffer);
+        if (!evicted.empty())
+        {
+            CudaDeviceGuard guard(device_id_);
+            for (void* old : evicted)
+            {
+                cudaFreeHost(old);
+            }
+        }
+    }
+
+private:
+    // Free buffers of one kind, most recently released first, with an index by size class.
+    struct FreeList
+    {
+        std::list<std::pair<size_t, void*>> buffers;
+        std::unordered_multimap<size_t, std::list<std::pair<size_t, void*>>::iterator> by_size;
+        size_t bytes{0};
+    };
+
+    // Round footprint up to a multiple of a quarter of its power of two, and to at least 256 bytes, so that buffers
+    // of 1 KiB and more are at most 25% larger than requested.
+    static size_t SizeClass(size_t footprint)
+    {
+        size_t power{256};
+        while (power < footprint / 2)
+        {
+            power *= 2;
+        }
+        size_t const step = std::max<size_t>(power / 4, 256);
+        return (std::max<size_t>(footprint, 1) + step - 1) / step * step;
+    }
+
+    void* Take(FreeList& free_list, size_t size)
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        auto it = free_list.by_size.find(size);
+        if (it == free_list.by_size.end())
+        {
+            return nullptr;
+        }
+        void* buffer = it->second->second;
+        free_list.buffers.erase(it->second);
+        free_list.by_size.erase(it);
+        free_list.bytes -= size;
+        return buffer;
+    }
+
+    // Add buffer to free_list and return the buffers evicted to bring it back under the limit, to be freed by the
+    // caller without holding the lock.
+    std::vector<void*> Put(FreeList& free_list, size_t size, void* buffer)
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        free_list.buffers.emplace_front(size, buffer);
+        free_list.by_size.emplace(size, free_list.buffers.begin());
+        free_list.bytes += size;
+        std::vector<void*> evicted;
+        while (free_list.bytes > max_cached_bytes_)
+        {
+            auto const oldest = std::prev(free_list.buffers.end());
+            auto const range = free_list.by_size.equal_range(oldest->first);
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                if (it->second == oldest)
+                {
+                    free_list.by_size.erase(it);
+                    break;
+                }
+            }
+            free_list.bytes -= oldest->first;
+            evicted.push_back(oldest->second);
+            free_list.buffers.erase(oldest);
+        }
+        return evicted;
+    }
+
+    int device_id_{0};
+    size_t max_cached_bytes_{0};
+    std::mutex mutex_;
+    FreeList free_device_;
+    FreeList free_host_;
+};
+
 class OnnxTensorRTBackendRep
 {
 public:
-    OnnxTensorRTBackendRep(const OnnxTensorRTBackendID& backend_id)
+    OnnxTensorRTBackendRep(
+        const OnnxTensorRTBackendID& backend_id, char const* timing_cache_path, uint64_t replica_device_mask)
         : device_id_(backend_id.device_id)
     {
         trt_builder_ = infer_object(nvinfer1::createInferBuilder(trt_logger_));
-        trt_builder_->setMaxBatchSize(max_batch_size_);
-        trt_builder_->setMaxWorkspaceSize(max_workspace_size_);
-        trt_network_ = infer_object(trt_builder_->createNetwork());
+        trt_network_ = infer_object(trt_builder_->createNetworkV2(
+            1U << static_cast<uint32_t>(nvinfer1::NetworkDefinitionCreationFlag::kEXPLICIT_BATCH)));
         parser_ = infer_object(nvonnxparser::createParser(*trt_network_, trt_logger_));
+        parser_->setLoggerSeverity(trt_logger_.verbosity());
+        trt_runtime_ = infer_object(nvinfer1::createInferRuntime(trt_logger_));
         CudaDeviceGuard guard(device_id_);
         if (cudaStreamCreate(&stream_) != cudaSuccess)
         {
             throw std::runtime_error("Cannot create cudaStream");
         }
+        char const* pool_mb = std::getenv("ONNX_TRT_BUFFER_POOL_MB");
+        buffer_pool_bytes_ = (pool_mb ? static_cast<size_t>(std::strtoull(pool_mb, nullptr, 10)) : kDEFAULT_BUFFER_POOL_MB)
+            << 20;
+        buffer_pool_ = std::make_shared<BufferPool>(device_id_, buffer_pool_bytes_);
+        char const* cuda_graphs = std::getenv("ONNX_TRT_CUDA_GRAPHS");
+        use_cuda_graphs_ = cuda_graphs && std::string(cuda_graphs) == "1";
+        char const* stats = std::getenv("ONNX_TRT_STATS");
+        print_stats_ = stats && std::string(stats) == "1";
+        if (!timing_cache_path)
+        {
+            timing_cache_path = std::getenv("ONNX_TRT_TIMING_CACHE");
+        }
+        timing_cache_path_ = timing_cache_path ? timing_cache_path : "";
+        InitReplicaDevices(replica_device_mask);
     }
 
     ~OnnxTensorRTBackendRep()
@@ -278,6 +560,16 @@ public:
     {
         return stream_;
     }
+    std::shared_ptr<BufferPool> const& buffer_pool() const
+    {
+        return buffer_pool_;
+    }
+
+    // Limit of the free device buffers, and separately of the free host buffers, kept by each buffer pool.
+    size_t buffer_pool_bytes() const
+    {
+        return buffer_pool_bytes_;
+    }
 
     onnxStatus ImportModel(void const* serialized_onnx_model, size_t serialized_onnx_model_size, uint32_t weight_count,
         onnxTensorDescriptorV1 const* weight_descriptors)
@@ -309,9 +601,70 @@ public:
         return ONNXIFI_STATUS_SUCCESS;
     }
 
-    nvinfer1::ICudaEngine* buildCudaEngine()
+    // Build the serialized engine with a single optimization profile. Dynamic dimensions range from 1 to
+    // max_batch_size for the first (batch) dimension and from 1 to max_dynamic_dim for all others.
+    std::shared_ptr<nvinfer1::IHostMemory> buildSerializedEngine()
+    {
+        auto config = infer_object(trt_builder_->createBuilderConfig());
+        config->setMemoryPoolLimit(nvinfer1::MemoryPoolType::kWORKSPACE, max_workspace_size_);
+        AttachTimingCache(*config);
+
+        auto* profile = trt_builder_->createOptimizationProfile();
+        bool dynamic = false;
+        for (int32_t i = 0; i < trt_network_->getNbInputs(); ++i)
+        {
+            auto* input = trt_network_->getInput(i);
+            nvinfer1::Dims dims = input->getDimensions();
+            nvinfer1::Dims min_dims = dims;
+            nvinfer1::Dims max_dims = dims;
+            bool input_dynamic = false;
+            for (int32_t d = 0; d < dims.nbDims; ++d)
+            {
+                if (dims.d[d] == -1)
+                {
+                    min_dims.d[d] = 1;
+                    max_dims.d[d] = static_cast<int32_t>(d == 0 ? max_batch_size_ : max_dynamic_dim_);
+                    input_dynamic = true;
+                }
+            }
+            if (!input_dynamic)
+            {
+                continue;
+            }
+            if (input->isShapeTensor())
+            {
+                throw std::runtime_error(std::string("Shape tensor input is not supported: ") + input->getName());
+            }
+            profile->setDimensions(input->getName(), nvinfer1::OptProfileSelector::kMIN, min_dims);
+            profile->setDimensions(input->getName(), nvinfer1::OptProfileSelector::kOPT, max_dims);
+            profile->setDimensions(input->getName(), nvinfer1::OptProfileSelector::kMAX, max_dims);
+            dynamic = true;
+        }
+        if (dynamic)
+        {
+            config->addOptimizationProfile(profile);
+        }
+
+        auto plan = infer_object(trt_builder_->buildSerializedNetwork(*trt_network_, *config));
+        StoreTimingCache(*config);
+        return plan;
+    }
+
+    // Engines must not outlive the runtime that deserialized them.
+    std::shared_ptr<nvinfer1::IRuntime> const& runtime() const
     {
-        return trt_builder_->buildCudaEngine(*trt_network_);
+        return trt_runtime_;
+    }
+
+    nvinfer1::ILogger& logger()
+    {
+        return trt_logger_;
+    }
+
+    // Devices the engines of the graphs are deserialized onto. The device of the backend comes first.
+    std::vector<int> const& replica_devices() const
+    {
+        return replica_devices_;
     }
 
     size_t max_batch_size() const
@@ -319,15 +672,151 @@ public:
         return max_batch_size_;
     }
 
+    size_t max_concurrent_runs() const
+    {
+        return max_concurrent_runs_;
+    }
+
+    bool use_cuda_graphs() const
+    {
+        return use_cuda_graphs_;
+    }
+
+    bool print_stats() const
+    {
+        return print_stats_;
+    }
+
 private:
+    // Select the devices to replicate graphs onto, from replica_device_mask or else from ONNX_TRT_REPLICA_DEVICES.
+    // Devices of another compute capability than the device of the backend cannot run its engines and are skipped.
+    void InitReplicaDevices(uint64_t replica_device_mask)
+    {
+        int nb_devices{0};
+        cudaGetDeviceCount(&nb_devices);
+        char const* replica_devices = std::getenv("ONNX_TRT_REPLICA_DEVICES");
+        if (!replica_device_mask && replica_devices)
+        {
+            std::string const devices(replica_devices);
+            if (devices == "all")
+            {
+                replica_device_mask = ~UINT64_C(0);
+            }
+            else
+            {
+                std::stringstream list(devices);
+                std::string device;
+                while (std::getline(list, device, ','))
+                {
+                    int const id = std::atoi(device.c_str());
+                    replica_device_mask |= (0 <= id && id < 64) ? UINT64_C(1) << id : 0;
+                }
+            }
+        }
+
+        replica_devices_.push_back(device_id_);
+        cudaDeviceProp home_properties;
+        if (!replica_device_mask || cudaGetDeviceProperties(&home_properties, device_id_) != cudaSuccess)
+        {
+            return;
+        }
+        for (int id = 0; id < std::min(nb_devices, 64); ++id)
+        {
+            if (id == device_id_ || !(replica_device_mask & (UINT64_C(1) << id)))
+            {
+                continue;
+            }
+            cudaDeviceProp properties;
+            if (cudaGetDeviceProperties(&properties, id) != cudaSuccess || properties.major != home_properties.major
+                || properties.minor != home_properties.minor)
+            {
+                std::string const message = "Not replicating onto CUDA device " + std::to_string(id)
+                    + ", its compute capability differs from device " + std::to_string(device_id_);
+                trt_logger_.log(nvinfer1::ILogger::Severity::kINFO, message.c_str());
+                continue;
+            }
+            replica_devices_.push_back(id);
+        }
+    }
+
+    // Attach the timing cache to config. It is loaded from disk by the first build and then shared by the builds of
+    // all graphs of the backend.
+    void AttachTimingCache(nvinfer1::IBuilderConfig& config)
+    {
+        if (timing_cache_path_.empty())
+        {
+            return;
+        }
+        if (!timing_cache_)
+        {
+            std::vector<char> blob;
+            {
+                TimingCacheLock lock(timing_cache_path_);
+                blob = ReadTimingCache(timing_cache_path_);
+            }
+            timing_cache_.reset(config.createTimingCache(blob.data(), blob.size()), InferDeleter());
+        }
+        if (!timing_cache_ || !config.setTimingCache(*timing_cache_, false))
+        {
+            // A cache written by another TensorRT version or device is replaced by the next store.
+            std::cerr << "Ignoring incompatible timing cache " << timing_cache_path_ << std::endl;
+            timing_cache_ = infer_object(config.createTimingCache(nullptr, 0));
+            config.setTimingCache(*timing_cache_, false);
+        }
+    }
+
+    // Merge the timings on disk into the timing cache and write the result back, which keeps the entries stored by
+    // other processes since the cache was loaded.
+    void StoreTimingCache(nvinfer1::IBuilderConfig& config)
+    {
+        if (!timing_cache_)
+        {
+            return;
+        }
+        TimingCacheLock lock(timing_cache_path_);
+        std::vector<char> const blob = ReadTimingCache(timing_cache_path_);
+        if (!blob.empty())
+        {
+            std::shared_ptr<nvinfer1::ITimingCache> disk_cache(
+                config.createTimingCache(blob.data(), blob.size()), InferDeleter());
+            if (disk_cache)
+            {
+                timing_cache_->combine(*disk_cache, false);
+            }
+        }
+        auto serialized = infer_object(timing_cache_->serialize());
+        if (!WriteTimingCache(timing_cache_path_, *serialized))
+        {
+            std::cerr << "Cannot write timing cache " << timing_cache_path_ << std::endl;
+        }
+    }
+
     TRT_Logger trt_logger_;
     cudaStream_t stream_;
     std::shared_ptr<nvinfer1::IBuilder> trt_builder_{nullptr};
     std::shared_ptr<nvinfer1::INetworkDefinition> trt_network_{nullptr};
     std::shared_ptr<nvonnxparser::IParser> parser_{nullptr};
+    std::shared_ptr<nvinfer1::IRuntime> trt_runtime_{nullptr};
+    // Default of ONNX_TRT_BUFFER_POOL_MB.
+    static constexpr size_t kDEFAULT_BUFFER_POOL_MB{256};
+    // Device and pinned staging buffers, shared by the graphs built from this backend.
+    std::shared_ptr<BufferPool> buffer_pool_{nullptr};
+    size_t buffer_pool_bytes_{0};
     // TODO: configerable max batch size
     int device_id_{0};
     size_t max_batch_size_{128};
+    size_t max_dynamic_dim_{1024};
+    // Number of execution contexts and streams per graph, i.e. of onnxRunGraph calls that can be in flight at once.
+    size_t max_concurrent_runs_{4};
+    // Capture the copies and inference of each run into CUDA graphs and replay them for runs with the same IO.
+    // Opt-in through ONNX_TRT_CUDA_GRAPHS=1, since graphs cannot capture every engine.
+    bool use_cuda_graphs_{false};
+    // Print the run statistics of each graph when it is released. Opt-in through ONNX_TRT_STATS=1.
+    bool print_stats_{false};
+    // Timing cache shared with other builders on the host through the file at timing_cache_path_, if set.
+    std::string timing_cache_path_;
+    std::shared_ptr<nvinfer1::ITimingCache> timing_cache_{nullptr};
+    std::vector<int> replica_devices_;
     size_t max_workspace_size_{1024UL * 1024UL * 1024UL * 2UL};
 };
 
@@ -335,95 +824,313 @@ class GraphRep
 {
 public:
     GraphRep(OnnxTensorRTBackendRep* backendrep)
-        : device_id_(backendrep->device_id())
-        , max_batch_size_(backendrep->max_batch_size())
-        , stream_(backendrep->stream())
+        : use_cuda_graphs_(backendrep->use_cuda_graphs())
+        , print_stats_(backendrep->print_stats())
     {
-        if (cudaSetDevice(device_id_) != cudaSuccess)
+        if (cudaSetDevice(backendrep->device_id()) != cudaSuccess)
         {
             throw std::runtime_error("Cannot set CUDA device");
         }
-        trt_engine_ = infer_object(backendrep->buildCudaEngine());
-        max_batch_size_ = backendrep->max_batch_size();
+        // The engine is built once and deserialized onto every replica device.
+        auto const plan = backendrep->buildSerializedEngine();
+        for (int device_id : backendrep->replica_devices())
+        {
+            std::unique_ptr<Replica> replica(new Replica);
+            replica->device_id = device_id;
+            CudaDeviceGuard guard(device_id);
+            if (device_id == backendrep->device_id())
+            {
+                replica->buffer_pool = backendrep->buffer_pool();
+                replica->runtime = backendrep->runtime();
+            }
+            else
+            {
+                replica->buffer_pool = std::make_shared<BufferPool>(device_id, backendrep->buffer_pool_bytes());
+                replica->runtime = infer_object(nvinfer1::createInferRuntime(backendrep->logger()));
+            }
+            replica->engine = infer_object(replica->runtime->deserializeCudaEngine(plan->data(), plan->size()));
+            for (size_t i = 0; i < backendrep->max_concurrent_runs(); ++i)
+            {
+                replica->slots.emplace_back(new ExecutionSlot);
+                replica->slots.back()->replica = replica.get();
+            }
+            replicas_.push_back(std::move(replica));
+        }
+        trt_engine_ = replicas_.front()->engine;
     }
 
     ~GraphRep()
     {
-        ClearDeviceBuffers();
+        for (auto& replica : replicas_)
+        {
+            CudaDeviceGuard guard(replica->device_id);
+            for (auto& slot : replica->slots)
+            {
+                ClearSlotBuffers(*slot, 0);
+                slot->executor.reset();
+                if (slot->stream)
+                {
+                    cudaEventDestroy(slot->inputs_uploaded);
+                    cudaStreamDestroy(slot->stream);
+                }
+            }
+            if (print_stats_ && replicas_.size() > 1)
+            {
+                std::cerr << "Runs on CUDA device " << replica->device_id << ": " << replica->runs.load()
+                          << std::endl;
+            }
+        }
+        if (print_stats_ && use_cuda_graphs_)
+        {
+            std::cerr << "CUDA graph replays: " << graph_hits_.load() << ", captures: " << graph_misses_.load()
+                      << std::endl;
+        }
     }
 
     onnxStatus InitIO(uint32_t inputsCount, const onnxTensorDescriptorV1* inputDescriptors, uint32_t outputsCount,
         const onnxTensorDescriptorV1* outputDescriptors);
 
-    onnxStatus Run();
+    // Enqueue a run on a free execution slot of the replica with the fewest runs in flight and return an event for
+    // its completion in outputFence.
+    onnxStatus Run(onnxMemoryFenceV1* outputFence);
 
-    cudaStream_t stream() const
+private:
+    struct Replica;
+
+    // A CPU tensor bound through a pooled device buffer and a pinned host staging buffer.
+    struct StagedTensor
     {
-        return stream_;
+        void* user_buffer{nullptr};
+        void* device_buffer{nullptr};
+        void* host_buffer{nullptr};
+        size_t footprint{0};
+    };
+
+    // Number of IO signatures a slot keeps buffers and CUDA graphs for.
+    static constexpr size_t kMAX_CACHED_IOS{8};
+
+    // An engine IO tensor and the descriptor given to InitIO for it.
+    struct BoundTensor
+    {
+        std::string name;
+        bool is_output{false};
+        bool is_cpu{false};
+        void* user_buffer{nullptr};
+        size_t footprint{0};
+        nvinfer1::Dims shape{}; // Shape of the descriptor.
+    };
+
+    // Buffers of a slot for one IO signature, and the CUDA graph captured for it.
+    struct SlotIO
+    {
+        std::vector<StagedTensor> staged_inputs;
+        std::vector<StagedTensor> staged_outputs;
+        cudaGraphExec_t graph{nullptr};
+        bool capture_failed{false};
+    };
+
+    // An execution context with its own stream and CPU tensor buffers, so concurrent runs of a graph do not
+    // serialize on one stream. CUDA resources are created when a slot is first used.
+    struct ExecutionSlot
+    {
+        bool busy{false}; // Guarded by the slots_mutex of the replica.
+        std::shared_ptr<nvinfer1::IExecutionContext> executor{nullptr};
+        cudaStream_t stream{nullptr};
+        // Recorded after the input uploads, before the staging buffers may be overwritten by the next run.
+        cudaEvent_t inputs_uploaded{nullptr};
+        // Buffers of recently bound IO signatures. Keeping them lets captured graphs, which refer to the buffers,
+        // be replayed after the IO is set again with the same shapes.
+        std::unordered_map<std::string, std::unique_ptr<SlotIO>> ios;
+        SlotIO* io{nullptr}; // Buffers of the current IO.
+        uint64_t io_generation{0}; // Value of io_generation_ that the tensor addresses were set for.
+        Replica* replica{nullptr}; // Replica the slot runs on.
+    };
+
+    // The engine deserialized onto one device, with the execution slots and staging buffers of that device.
+    struct Replica
+    {
+        int device_id{0};
+        std::shared_ptr<BufferPool> buffer_pool{nullptr};
+        std::shared_ptr<nvinfer1::IRuntime> runtime{nullptr};
+        std::shared_ptr<nvinfer1::ICudaEngine> engine{nullptr};
+        std::vector<std::unique_ptr<ExecutionSlot>> slots;
+        // Guards the busy flags of the slots. slot_released is notified whenever a slot becomes free.
+        std::mutex slots_mutex;
+        std::condition_variable slot_released;
+        // Runs enqueued on the replica that have not completed yet, the measure of its outstanding work.
+        std::atomic<size_t> in_flight{0};
+        std::atomic<uint64_t> runs{0};
+    };
+
+    // Key of the current IO: the shape and footprint of every tensor, and the address of tensors bound directly.
+    std::string IOSignature() const;
+
+    onnxStatus CheckAndBindTensor(char const* name, const onnxTensorDescriptorV1& tensor, bool is_output);
+
+    // Pick the replica with the fewest runs in flight. Ties go to the replica listed first. Runs with CUDA buffer IO
+    // always go to the replica on the device of the backend, which owns the buffers.
+    Replica& SelectReplica();
+
+    // Take a free slot of replica, waiting for one to be released if all are busy.
+    ExecutionSlot& AcquireSlot(Replica& replica);
+
+    void ReleaseSlot(ExecutionSlot& slot)
+    {
+        {
+            std::lock_guard<std::mutex> lock(slot.replica->slots_mutex);
+            slot.busy = false;
+        }
+        slot.replica->slot_released.notify_one();
     }
 
-private:
-    void ClearDeviceBuffers();
+    onnxStatus PrepareSlot(ExecutionSlot& slot);
+
+    // Release the buffers of all but max_kept IO signatures of a slot, other than the current one.
+    void ClearSlotBuffers(ExecutionSlot& slot, size_t max_kept);
+
+    void ReleaseSlotIO(BufferPool& buffer_pool, SlotIO& io);
+
+    onnxStatus Enqueue(ExecutionSlot& slot);
 
-    onnxStatus CheckAndBindTensor(const nvinfer1::Dims& dims, const onnxTensorDescriptorV1& tensor, bool is_output);
+    // Enqueue the uploads, inference and downloads of a run. This is the part captured into CUDA graphs.
+    onnxStatus EnqueueDeviceWork(ExecutionSlot& slot);
 
+    void CaptureGraph(ExecutionSlot& slot);
+
+    // Host function enqueued after the output downloads, so the output fence only fires once the caller's buffers
+    // have been written.
+    static void CUDART_CB CopyStagedOutputs(void* io);
+
+    // Host function enqueued after a run, which takes it off the outstanding work of its replica.
+    static void CUDART_CB FinishRun(void* replica);
+
+    std::vector<std::unique_ptr<Replica>> replicas_;
+    // Engine of the first replica, for the engine properties common to all replicas.
     std::shared_ptr<nvinfer1::ICudaEngine> trt_engine_{nullptr};
-    std::shared_ptr<nvinfer1::IExecutionContext> trt_executor_{nullptr};
-    std::vector<void*> bindings_;
-    std::unordered_map<std::string, const onnxTensorDescriptorV1*> input_map_;
-    std::unordered_map<std::string, const onnxTensorDescriptorV1*> output_map_;
-    std::unordered_map<std::string, void*> device_buffers_;
-    int device_id_{0};
-    size_t max_batch_size_{0};
-    size_t batch_size_{0};
-    cudaStream_t stream_;
+    std::vector<BoundTensor> io_plan_;
+    // Whether the current IO has CUDA buffers, which the other replicas' devices cannot access.
+    bool has_device_io_{false};
+    uint64_t io_generation_{0};
+    bool use_cuda_graphs_{false};
+    bool print_stats_{false};
+    std::atomic<uint64_t> graph_hits_{0};
+    std::atomic<uint64_t> graph_misses_{0};
 };
 
-void GraphRep::ClearDeviceBuffers()
+void GraphRep::ReleaseSlotIO(BufferPool& buffer_pool, SlotIO& io)
+{
+    if (io.graph)
+    {
+        cudaGraphExecDestroy(io.graph);
+        io.graph = nullptr;
+    }
+    for (auto const* staged : {&io.staged_inputs, &io.staged_outputs})
+    {
+        for (auto const& tensor : *staged)
+        {
+            buffer_pool.ReleaseDevice(tensor.device_buffer, tensor.footprint);
+            buffer_pool.ReleaseHost(tensor.host_buffer, tensor.footprint);
+        }
+    }
+    io.staged_inputs.clear();
+    io.staged_outputs.clear();
+}
+
+void GraphRep::ClearSlotBuffers(ExecutionSlot& slot, size_t max_kept)
+{
+    if (!slot.stream)
+    {
+        return;
+    }
+    // Pending runs may still use the buffers.
+    cudaStreamSynchronize(slot.stream);
+    for (auto it = slot.ios.begin(); it != slot.ios.end() && slot.ios.size() > max_kept;)
+    {
+        if (it->second.get() == slot.io && max_kept > 0)
+        {
+            ++it;
+            continue;
+        }
+        ReleaseSlotIO(*slot.replica->buffer_pool, *it->second);
+        it = slot.ios.erase(it);
+    }
+    if (max_kept == 0)
+    {
+        slot.io = nullptr;
+    }
+}
+
+void CUDART_CB GraphRep::CopyStagedOutputs(void* io)
+{
+    for (auto const& tensor : static_cast<SlotIO*>(io)->staged_outputs)
+    {
+        std::memcpy(tensor.user_buffer, tensor.host_buffer, tensor.footprint);
+    }
+}
+
+void CUDART_CB GraphRep::FinishRun(void* replica)
+{
+    static_cast<Replica*>(replica)->in_flight.fetch_sub(1, std::memory_order_relaxed);
+}
+
+std::string GraphRep::IOSignature() const
 {
-    for (auto kv : device_buffers_)
+    std::ostringstream signature;
+    for (auto const& bound : io_plan_)
     {
-        cudaFree(kv.second);
+        signature << bound.name << (bound.is_cpu ? ":cpu:" : ":cuda:");
+        if (!bound.is_cpu)
+        {
+            signature << bound.user_buffer << ":";
+        }
+        signature << bound.footprint;
+        for (int32_t i = 0; i < bound.shape.nbDims; ++i)
+        {
+            signature << "," << bound.shape.d[i];
+        }
+        signature << ";";
     }
-    device_buffers_.clear();
+    return signature.str();
 }
 
-onnxStatus GraphRep::CheckAndBindTensor(
-    const nvinfer1::Dims& dims, const onnxTensorDescriptorV1& tensor, bool is_output)
+onnxStatus GraphRep::CheckAndBindTensor(char const* name, const onnxTensorDescriptorV1& tensor, bool is_output)
 {
     // Check memory type
     if (tensor.memoryType != ONNXIFI_MEMORY_TYPE_CPU && tensor.memoryType != ONNXIFI_MEMORY_TYPE_CUDA_BUFFER)
     {
         return ONNXIFI_STATUS_INVALID_DATATYPE;
     }
-    // Check tensor shape
-    auto ret = CheckShape(dims, tensor, is_output);
-    if (ret != ONNXIFI_STATUS_SUCCESS)
+    // Check data type consistency
+    if (!IsCompatibleDataType(trt_engine_->getTensorDataType(name), tensor.dataType))
     {
-        return ret;
+        return ONNXIFI_STATUS_MISMATCHING_DATATYPE;
     }
 
-    // For CPU tensor, we need to create a device memory and the bind. For CUDA
-    // tensor, we can bind directly
-    if (tensor.memoryType == ONNXIFI_MEMORY_TYPE_CPU)
+    BoundTensor bound;
+    bound.name = name;
+    bound.is_output = is_output;
+    bound.is_cpu = tensor.memoryType == ONNXIFI_MEMORY_TYPE_CPU;
+    bound.user_buffer = (void*) (tensor.buffer);
+    bound.footprint = GetTensorFootprint(tensor);
+    if (!GetTensorDims(tensor, &bound.shape))
     {
-        void* cuda_buffer;
-        size_t footprint = GetTensorFootprint(tensor);
-        if (!footprint)
-        {
-            return ONNXIFI_STATUS_INVALID_SHAPE;
-        }
-        if (cudaMalloc(&cuda_buffer, footprint) != cudaSuccess)
+        return ONNXIFI_STATUS_INVALID_SHAPE;
+    }
+    // Output shapes depend on the input shapes, they are checked once those are set in PrepareSlot.
+    if (!is_output)
+    {
+        auto ret = CheckShape(trt_engine_->getTensorShape(name), bound.shape, false, name);
+        if (ret != ONNXIFI_STATUS_SUCCESS)
         {
-            return ONNXIFI_STATUS_NO_DEVICE_MEMORY;
+            return ret;
         }
-        device_buffers_.emplace(tensor.name, cuda_buffer);
-        bindings_.push_back(cuda_buffer);
     }
-    else
+    // For CPU tensor, each slot creates a device memory and binds it. For CUDA tensor, we can bind directly
+    if (bound.is_cpu && !bound.footprint)
     {
-        bindings_.push_back((void*) (tensor.buffer));
+        return ONNXIFI_STATUS_INVALID_SHAPE;
     }
+    io_plan_.push_back(std::move(bound));
 
     return ONNXIFI_STATUS_SUCCESS;
 }
@@ -431,9 +1138,12 @@ onnxStatus GraphRep::CheckAndBindTensor(
 onnxStatus GraphRep::InitIO(uint32_t inputsCount, const onnxTensorDescriptorV1* inputDescriptors, uint32_t outputsCount,
     const onnxTensorDescriptorV1* outputDescriptors)
 {
-    CudaDeviceGuard guard(device_id_);
-    ClearDeviceBuffers();
-    // Setup the input/output bindings and decide batch size
+    // Slots bind the new IO when they are next used.
+    ++io_generation_;
+    io_plan_.clear();
+    std::unordered_map<std::string, const onnxTensorDescriptorV1*> input_map;
+    std::unordered_map<std::string, const onnxTensorDescriptorV1*> output_map;
+    // Setup the input/output bindings
     for (unsigned i = 0; i < inputsCount; ++i)
     {
         if (inputDescriptors[i].tag != ONNXIFI_TAG_TENSOR_DESCRIPTOR_V1)
@@ -444,131 +1154,323 @@ onnxStatus GraphRep::InitIO(uint32_t inputsCount, const onnxTensorDescriptorV1*
         {
             return ONNXIFI_STATUS_INVALID_NAME;
         }
-        // We only support NCHW
-        if (inputDescriptors[i].dimensions != 4)
+        std::cerr << "Adding input " << i << ": " << inputDescriptors[i].name
+                  << ", type: " << inputDescriptors[i].memoryType << std::endl;
+        input_map.emplace(std::string(inputDescriptors[i].name), inputDescriptors + i);
+    }
+
+    for (unsigned i = 0; i < outputsCount; ++i)
+    {
+        if (outputDescriptors[i].tag != ONNXIFI_TAG_TENSOR_DESCRIPTOR_V1)
         {
-            return ONNXIFI_STATUS_INVALID_SHAPE;
+            return ONNXIFI_STATUS_UNSUPPORTED_TAG;
         }
-        if (i == 0)
+        if (!outputDescriptors[i].name)
         {
-            batch_size_ = inputDescriptors[i].shape[0];
+            return ONNXIFI_STATUS_INVALID_NAME;
         }
-        else
+        output_map.emplace(std::string(outputDescriptors[i].name), outputDescriptors + i);
+    }
+
+    int32_t nbIOTensors = trt_engine_->getNbIOTensors();
+    for (int32_t t = 0; t < nbIOTensors; ++t)
+    {
+        char const* name = trt_engine_->getIOTensorName(t);
+        bool const is_output = trt_engine_->getTensorIOMode(name) == nvinfer1::TensorIOMode::kOUTPUT;
+        auto const& map = is_output ? output_map : input_map;
+        const auto it = map.find(name);
+        if (it == map.end())
         {
-            if (batch_size_ != inputDescriptors[i].shape[0])
-            {
-                return ONNXIFI_STATUS_INVALID_SHAPE;
-            }
+            return ONNXIFI_STATUS_UNIDENTIFIED_NAME;
+        }
+        auto ret = CheckAndBindTensor(name, *it->second, is_output);
+        if (ret != ONNXIFI_STATUS_SUCCESS)
+        {
+            return ret;
         }
-        std::cerr << "Adding input " << i << ": " << inputDescriptors[i].name
-                  << ", type: " << inputDescriptors[i].memoryType << std::endl;
-        input_map_.emplace(std::string(inputDescriptors[i].name), inputDescriptors + i);
     }
 
-    // We don't support the case when batch size is larger than max batch size
-    // yet, but this is not a hard constraint.
-    if (batch_size_ > max_batch_size_)
+    has_device_io_ = std::any_of(
+        io_plan_.begin(), io_plan_.end(), [](BoundTensor const& bound) { return !bound.is_cpu; });
+
+    // Bind one slot of every replica that can run the IO right away, so errors that depend on the input shapes are
+    // reported here rather than by the first run. No run can be in flight while the IO is being set.
+    for (auto& replica : replicas_)
     {
-        return ONNXIFI_STATUS_NO_DEVICE_RESOURCES;
+        if (has_device_io_ && replica != replicas_.front())
+        {
+            continue;
+        }
+        CudaDeviceGuard guard(replica->device_id);
+        ExecutionSlot& slot = AcquireSlot(*replica);
+        auto ret = PrepareSlot(slot);
+        ReleaseSlot(slot);
+        if (ret != ONNXIFI_STATUS_SUCCESS)
+        {
+            return ret;
+        }
     }
+    return ONNXIFI_STATUS_SUCCESS;
+}
 
-    for (unsigned i = 0; i < outputsCount; ++i)
+GraphRep::Replica& GraphRep::SelectReplica()
+{
+    Replica* selected = replicas_.front().get();
+    if (has_device_io_)
     {
-        if (outputDescriptors[i].tag != ONNXIFI_TAG_TENSOR_DESCRIPTOR_V1)
+        return *selected;
+    }
+    for (auto& replica : replicas_)
+    {
+        if (replica->in_flight.load(std::memory_order_relaxed) < selected->in_flight.load(std::memory_order_relaxed))
         {
-            return ONNXIFI_STATUS_UNSUPPORTED_TAG;
+            selected = replica.get();
         }
-        if (!outputDescriptors[i].name)
+    }
+    return *selected;
+}
+
+GraphRep::ExecutionSlot& GraphRep::AcquireSlot(Replica& replica)
+{
+    std::unique_lock<std::mutex> lock(replica.slots_mutex);
+    ExecutionSlot* acquired{nullptr};
+    replica.slot_released.wait(lock, [&replica, &acquired] {
+        auto const free_slot = std::find_if(replica.slots.begin(), replica.slots.end(),
+            [](std::unique_ptr<ExecutionSlot> const& slot) { return !slot->busy; });
+        acquired = free_slot == replica.slots.end() ? nullptr : free_slot->get();
+        return acquired != nullptr;
+    });
+    acquired->busy = true;
+    return *acquired;
+}
+
+onnxStatus GraphRep::PrepareSlot(ExecutionSlot& slot)
+{
+    if (!slot.stream)
+    {
+        if (cudaStreamCreateWithFlags(&slot.stream, cudaStreamNonBlocking) != cudaSuccess)
         {
-            return ONNXIFI_STATUS_INVALID_NAME;
+            slot.stream = nullptr;
+            return ONNXIFI_STATUS_NO_DEVICE_RESOURCES;
+        }
+        if (cudaEventCreateWithFlags(&slot.inputs_uploaded, cudaEventDisableTiming) != cudaSuccess)
+        {
+            cudaStreamDestroy(slot.stream);
+            slot.stream = nullptr;
+            return ONNXIFI_STATUS_NO_DEVICE_RESOURCES;
         }
-        output_map_.emplace(std::string(outputDescriptors[i].name), outputDescriptors + i);
+        slot.executor = infer_object(slot.replica->engine->createExecutionContext());
+    }
+    if (slot.io_generation == io_generation_)
+    {
+        return ONNXIFI_STATUS_SUCCESS;
     }
 
-    int nbindings = trt_engine_->getNbBindings();
-    for (int b = 0; b < nbindings; ++b)
+    // Reuse the buffers of an earlier IO with the same signature, together with any graph captured for them.
+    // Without CUDA graphs only the buffers of the current IO are kept.
+    std::string const signature = IOSignature();
+    auto it = slot.ios.find(signature);
+    if (it == slot.ios.end())
     {
-        nvinfer1::Dims dims = trt_engine_->getBindingDimensions(b);
-        // Check data type consistency
-        auto binding_datatype = trt_engine_->getBindingDataType(b);
-        if (binding_datatype != nvinfer1::DataType::kFLOAT)
+        ClearSlotBuffers(slot, use_cuda_graphs_ ? kMAX_CACHED_IOS - 1 : 0);
+        it = slot.ios.emplace(signature, std::unique_ptr<SlotIO>(new SlotIO)).first;
+    }
+    else
+    {
+        // Pending runs may still read the user buffers of the previous IO.
+        cudaStreamSynchronize(slot.stream);
+    }
+    SlotIO& io = *it->second;
+    slot.io = &io;
+    BufferPool& buffer_pool = *slot.replica->buffer_pool;
+    bool const allocate = io.staged_inputs.empty() && io.staged_outputs.empty();
+    size_t nb_staged_inputs = 0;
+    size_t nb_staged_outputs = 0;
+    for (auto const& bound : io_plan_)
+    {
+        if (!bound.is_output && !slot.executor->setInputShape(bound.name.c_str(), bound.shape))
         {
-            return ONNXIFI_STATUS_MISMATCHING_DATATYPE;
+            return ONNXIFI_STATUS_MISMATCHING_SHAPE;
         }
-
-        if (trt_engine_->bindingIsInput(b))
+        void* address = bound.user_buffer;
+        if (bound.is_cpu)
         {
-            std::cerr << "Input: " << trt_engine_->getBindingName(b) << ", Dim: " << dims.d[0] << ", " << dims.d[1]
-                      << ", " << dims.d[2] << std::endl;
-            const auto it = input_map_.find(trt_engine_->getBindingName(b));
-            if (it == input_map_.end())
-            {
-                return ONNXIFI_STATUS_UNIDENTIFIED_NAME;
-            }
-            if (auto ret = CheckAndBindTensor(dims, *it->second, false) != ONNXIFI_STATUS_SUCCESS)
+            auto& staged_tensors = bound.is_output ? io.staged_outputs : io.staged_inputs;
+            if (allocate)
             {
-                return ret;
+                StagedTensor staged;
+                staged.footprint = bound.footprint;
+                staged.device_buffer = buffer_pool.AcquireDevice(staged.footprint);
+                if (!staged.device_buffer)
+                {
+                    return ONNXIFI_STATUS_NO_DEVICE_MEMORY;
+                }
+                staged.host_buffer = buffer_pool.AcquireHost(staged.footprint);
+                if (!staged.host_buffer)
+                {
+                    buffer_pool.ReleaseDevice(staged.device_buffer, staged.footprint);
+                    return ONNXIFI_STATUS_NO_SYSTEM_MEMORY;
+                }
+                staged_tensors.push_back(staged);
             }
+            auto& staged = staged_tensors.at(bound.is_output ? nb_staged_outputs++ : nb_staged_inputs++);
+            staged.user_buffer = bound.user_buffer;
+            address = staged.device_buffer;
         }
-        else
+        if (!slot.executor->setTensorAddress(bound.name.c_str(), address))
         {
-            // output: for output, we enforce 4D dim although it can be in 2D, we do
-            // an implicit reshape in `CheckAndBindTensor`
-            const auto it = output_map_.find(trt_engine_->getBindingName(b));
-            if (it == output_map_.end())
-            {
-                return ONNXIFI_STATUS_UNIDENTIFIED_NAME;
-            }
-            if (auto ret = CheckAndBindTensor(dims, *it->second, true) != ONNXIFI_STATUS_SUCCESS)
+            return ONNXIFI_STATUS_INTERNAL_ERROR;
+        }
+    }
+    // All input shapes are known now, so the output descriptors can be checked.
+    for (auto const& bound : io_plan_)
+    {
+        if (bound.is_output)
+        {
+            auto ret = CheckShape(slot.executor->getTensorShape(bound.name.c_str()), bound.shape, true,
+                bound.name.c_str());
+            if (ret != ONNXIFI_STATUS_SUCCESS)
             {
                 return ret;
             }
         }
     }
-
-    trt_executor_ = infer_object(trt_engine_->createExecutionContext());
+    slot.io_generation = io_generation_;
     return ONNXIFI_STATUS_SUCCESS;
 }
 
-onnxStatus GraphRep::Run()
+onnxStatus GraphRep::EnqueueDeviceWork(ExecutionSlot& slot)
 {
-    CudaDeviceGuard guard(device_id_);
-    // Copy input if necessary
-    // TODO: cache tensor footprint
-    for (auto kv : device_buffers_)
+    for (auto const& tensor : slot.io->staged_inputs)
     {
-        auto it = input_map_.find(kv.first);
-        if (it != input_map_.end())
-        {
-            cudaMemcpyAsync(kv.second, (void*) (it->second->buffer), GetTensorFootprint(*it->second),
-                cudaMemcpyHostToDevice, stream_);
-        }
-        else if (output_map_.find(kv.first) == output_map_.end())
+        if (cudaMemcpyAsync(tensor.device_buffer, tensor.host_buffer, tensor.footprint, cudaMemcpyHostToDevice,
+                slot.stream)
+            != cudaSuccess)
         {
-            return ONNXIFI_STATUS_UNIDENTIFIED_NAME;
+            return ONNXIFI_STATUS_INTERNAL_ERROR;
         }
     }
 
     // Run TensorRT
-    trt_executor_->enqueue(batch_size_, bindings_.data(), stream_, nullptr);
+    if (!slot.executor->enqueueV3(slot.stream))
+    {
+        return ONNXIFI_STATUS_INTERNAL_ERROR;
+    }
 
     // Copy output if necessary
-    for (auto kv : device_buffers_)
+    for (auto const& tensor : slot.io->staged_outputs)
     {
-        auto it = output_map_.find(kv.first);
-        if (it != output_map_.end())
+        if (cudaMemcpyAsync(tensor.host_buffer, tensor.device_buffer, tensor.footprint, cudaMemcpyDeviceToHost,
+                slot.stream)
+            != cudaSuccess)
         {
-            cudaMemcpyAsync((void*) (it->second->buffer), kv.second, GetTensorFootprint(*it->second),
-                cudaMemcpyDeviceToHost, stream_);
+            return ONNXIFI_STATUS_INTERNAL_ERROR;
         }
-        else if (input_map_.find(kv.first) == input_map_.end())
+    }
+    return ONNXIFI_STATUS_SUCCESS;
+}
+
+void GraphRep::CaptureGraph(ExecutionSlot& slot)
+{
+    // The graph is captured after a regular run of the same IO, which lets TensorRT finish any deferred setup
+    // for the shapes outside of the capture.
+    SlotIO& io = *slot.io;
+    if (cudaStreamBeginCapture(slot.stream, cudaStreamCaptureModeThreadLocal) != cudaSuccess)
+    {
+        io.capture_failed = true;
+        return;
+    }
+    auto const ret = EnqueueDeviceWork(slot);
+    cudaGraph_t graph{nullptr};
+    bool const captured = cudaStreamEndCapture(slot.stream, &graph) == cudaSuccess && ret == ONNXIFI_STATUS_SUCCESS;
+    if (!captured || cudaGraphInstantiate(&io.graph, graph, nullptr, nullptr, 0) != cudaSuccess)
+    {
+        std::cerr << "Cannot capture a CUDA graph for this engine, running it without graphs." << std::endl;
+        io.graph = nullptr;
+        io.capture_failed = true;
+        // Clear any error left by the failed capture.
+        cudaGetLastError();
+    }
+    if (graph)
+    {
+        cudaGraphDestroy(graph);
+    }
+}
+
+onnxStatus GraphRep::Enqueue(ExecutionSlot& slot)
+{
+    SlotIO& io = *slot.io;
+    // Copy input if necessary. The staging buffers may still be read by the uploads of the previous run.
+    if (!io.staged_inputs.empty() && cudaEventSynchronize(slot.inputs_uploaded) != cudaSuccess)
+    {
+        return ONNXIFI_STATUS_INTERNAL_ERROR;
+    }
+    for (auto const& tensor : io.staged_inputs)
+    {
+        std::memcpy(tensor.host_buffer, tensor.user_buffer, tensor.footprint);
+    }
+
+    if (io.graph)
+    {
+        ++graph_hits_;
+        if (cudaGraphLaunch(io.graph, slot.stream) != cudaSuccess)
         {
-            return ONNXIFI_STATUS_UNIDENTIFIED_NAME;
+            return ONNXIFI_STATUS_INTERNAL_ERROR;
+        }
+    }
+    else
+    {
+        auto ret = EnqueueDeviceWork(slot);
+        if (ret != ONNXIFI_STATUS_SUCCESS)
+        {
+            return ret;
+        }
+        if (use_cuda_graphs_ && !io.capture_failed)
+        {
+            ++graph_misses_;
+            CaptureGraph(slot);
         }
     }
+
+    if (!io.staged_inputs.empty() && cudaEventRecord(slot.inputs_uploaded, slot.stream) != cudaSuccess)
+    {
+        return ONNXIFI_STATUS_INTERNAL_ERROR;
+    }
+    if (!io.staged_outputs.empty() && cudaLaunchHostFunc(slot.stream, &GraphRep::CopyStagedOutputs, &io) != cudaSuccess)
+    {
+        return ONNXIFI_STATUS_INTERNAL_ERROR;
+    }
     return ONNXIFI_STATUS_SUCCESS;
 }
 
+onnxStatus GraphRep::Run(onnxMemoryFenceV1* outputFence)
+{
+    Replica& replica = SelectReplica();
+    CudaDeviceGuard guard(replica.device_id);
+    ExecutionSlot& slot = AcquireSlot(replica);
+    auto ret = PrepareSlot(slot);
+    if (ret != ONNXIFI_STATUS_SUCCESS)
+    {
+        ReleaseSlot(slot);
+        return ret;
+    }
+    replica.in_flight.fetch_add(1, std::memory_order_relaxed);
+    ++replica.runs;
+    ret = Enqueue(slot);
+    if (cudaLaunchHostFunc(slot.stream, &GraphRep::FinishRun, &replica) != cudaSuccess)
+    {
+        FinishRun(&replica);
+    }
+
+    // The event completes with the work of this slot only, independently of runs on other slots.
+    std::unique_ptr<OnnxTensorRTEvent> output_event(new OnnxTensorRTEvent(slot.stream));
+    output_event->Signal();
+    ReleaseSlot(slot);
+    outputFence->event = reinterpret_cast<onnxEvent>(output_event.release());
+    outputFence->type = ONNXIFI_SYNCHRONIZATION_EVENT;
+    return ret;
+}
+
 template <class F>
 onnxStatus OnnxifiTryCatch(F&& tryBlock)
 {
@@ -895,8 +1797,10 @@ ONNXIFI_PUBLIC ONNXIFI_CHECK_RESULT onnxStatus ONNXIFI_ABI onnxGetBackendCompati
 
         TRT_Logger trt_logger;
         std::shared_ptr<nvinfer1::IBuilder> trt_builder = infer_object(nvinfer1::createInferBuilder(trt_logger));
-        std::shared_ptr<nvinfer1::INetworkDefinition> trt_network = infer_object(trt_builder->createNetwork());
+        std::shared_ptr<nvinfer1::INetworkDefinition> trt_network = infer_object(trt_builder->createNetworkV2(
+            1U << static_cast<uint32_t>(nvinfer1::NetworkDefinitionCreationFlag::kEXPLICIT_BATCH)));
         auto parser = infer_object(nvonnxparser::createParser(*trt_network, trt_logger));
+        parser->setLoggerSeverity(trt_logger.verbosity());
         if (parser->supportsModel(onnxModel, onnxModelSize))
         {
             return ONNXIFI_STATUS_SUCCESS;
@@ -909,7 +1813,9 @@ ONNXIFI_PUBLIC ONNXIFI_CHECK_RESULT onnxStatus ONNXIFI_ABI onnxGetBackendCompati
 }
 
 // NB: Passing arguments to backend is tricky. And we need more documentation
-// for it I didn't put any arguments here for now.
+// for it. The only properties read from auxPropertiesList for now are
+// ONNXIFI_BACKEND_PROPERTY_TRT_TIMING_CACHE_PATH and
+// ONNXIFI_BACKEND_PROPERTY_TRT_REPLICA_DEVICE_MASK, all others are ignored.
 // TODO: submit arguments for
 // - setMaxBatchSize (size_t)
 // - setMaxWorkspaceSize (size_t)
@@ -925,7 +1831,20 @@ ONNXIFI_PUBLIC ONNXIFI_CHECK_RESULT onnxStatus ONNXIFI_ABI onnxInitBackend(
         {
             return ONNXIFI_STATUS_INVALID_ID;
         }
-        *backend = (onnxBackend)(new OnnxTensorRTBackendRep(*backend_id));
+        char const* timing_cache_path = nullptr;
+        uint64_t replica_device_mask = 0;
+        for (auto* property = auxPropertiesList; property && *property != ONNXIFI_BACKEND_PROPERTY_NONE; property += 2)
+        {
+            if (property[0] == ONNXIFI_BACKEND_PROPERTY_TRT_TIMING_CACHE_PATH)
+            {
+                timing_cache_path = reinterpret_cast<char const*>(static_cast<uintptr_t>(property[1]));
+            }
+            else if (property[0] == ONNXIFI_BACKEND_PROPERTY_TRT_REPLICA_DEVICE_MASK)
+            {
+                replica_device_mask = property[1];
+            }
+        }
+        *backend = (onnxBackend)(new OnnxTensorRTBackendRep(*backend_id, timing_cache_path, replica_device_mask));
         return ONNXIFI_STATUS_SUCCESS;
     });
     if (ret != ONNXIFI_STATUS_SUCCESS)
@@ -1114,12 +2033,7 @@ ONNXIFI_PUBLIC ONNXIFI_CHECK_RESULT onnxStatus ONNXIFI_ABI onnxRunGraph(
             return ONNXIFI_STATUS_INVALID_GRAPH;
         }
 
-        ret = graph_rep->Run();
-        auto output_event = new OnnxTensorRTEvent(graph_rep->stream());
-        outputFence->event = reinterpret_cast<onnxEvent>(output_event);
-        outputFence->type = ONNXIFI_SYNCHRONIZATION_EVENT;
-        output_event->Signal();
-        return ret;
+        return graph_rep->Run(outputFence);
     });
 }
 
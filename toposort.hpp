@@ -4,93 +4,123 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
-#include <iostream>
-using std::cout;
-using std::cerr;
-using std::endl;
-
 namespace
 {
 
-enum NodeState
+enum NodeState : uint8_t
 {
     NODE_UNVISITED,
     NODE_ACTIVE,
     NODE_VISITED
 };
 
+} // anonymous namespace
+
+//! Sort nodes so that every node comes after the producers of its inputs. The order is the post order of a depth-first
+//! search that starts from the nodes in their original order and visits inputs in order, so graphs that are already
+//! sorted keep their order. Inputs no node produces, e.g. graph inputs and initializers, are skipped.
+//!
+//! The search is iterative, so its depth is not limited by the stack, and the edges are resolved once into a flat
+//! adjacency array indexed by node, with names looked up as views into the nodes rather than copies.
+//!
+//! \param error If not null, receives a description of why the sort failed.
+//! \return false if an output name is produced more than once or the graph contains a cycle.
 template <class Container>
-bool get_post_order(size_t node_idx, Container const& nodes, std::unordered_map<std::string, size_t> const& node_map,
-    std::vector<NodeState>* node_states, std::vector<size_t>* order)
+bool toposort(Container const& nodes, std::vector<size_t>* order, std::string* error = nullptr)
 {
-    NodeState& node_state = node_states->at(node_idx);
-    if (node_state == NODE_ACTIVE)
-    {
-        // Cycle detected!
-        cerr << "ERROR: Graph contains a cycle" << endl;
-        return false;
-    }
-    else if (node_state == NODE_VISITED)
+    size_t const nbNodes = nodes.size();
+    size_t nbOutputs{0};
+    size_t nbInputs{0};
+    for (size_t i = 0; i < nbNodes; ++i)
     {
-        return true;
-    }
-    else
-    {
-        node_state = NODE_ACTIVE;
         // TODO: This .Get().input() is highly specific to protobuf, should
         //       generalise it somehow.
-        for (auto const& input : nodes.Get(node_idx).input())
+        nbOutputs += nodes.Get(i).output().size();
+        nbInputs += nodes.Get(i).input().size();
+    }
+
+    std::unordered_map<std::string_view, size_t> producers;
+    producers.reserve(nbOutputs);
+    for (size_t i = 0; i < nbNodes; ++i)
+    {
+        for (auto const& output : nodes.Get(i).output())
         {
-            if (!node_map.count(input))
-            {
-                // Input node not found in graph!
-                // cerr << "ERROR: Input node not found in graph: "
-                //     << input << endl;
-                // return false;
-                continue; // Skip missing input edges
-            }
-            size_t input_node_idx = node_map.at(input);
-            if (!get_post_order(input_node_idx, nodes, node_map, node_states, order))
+            if (!producers.emplace(output, i).second)
             {
+                if (error)
+                {
+                    *error = "Output name is not unique: " + output;
+                }
                 return false;
             }
         }
-        node_state = NODE_VISITED;
-        order->push_back(node_idx);
     }
-    return true;
-}
-
-} // anonymous namespace
 
-template <class Container>
-bool toposort(Container const& nodes, std::vector<size_t>* order)
-{
-    std::unordered_map<std::string, size_t> node_map;
-    for (size_t i = 0; i < (size_t) nodes.size(); ++i)
+    // Producers of the inputs of node i are edges[edgeBegin[i]] to edges[edgeBegin[i + 1] - 1].
+    std::vector<size_t> edgeBegin;
+    edgeBegin.reserve(nbNodes + 1);
+    std::vector<size_t> edges;
+    edges.reserve(nbInputs);
+    for (size_t i = 0; i < nbNodes; ++i)
     {
-        // TODO: This .Get().input() is highly specific to protobuf, should
-        //       generalise it somehow.
-        for (auto const& output : nodes.Get(i).output())
+        edgeBegin.push_back(edges.size());
+        for (auto const& input : nodes.Get(i).input())
         {
-            if (!node_map.emplace(output, i).second)
+            auto const producer = producers.find(input);
+            if (producer != producers.end())
             {
-                // Output name appears more than once in graph!
-                cerr << "ERROR: Output name is not unique: " << output << endl;
-                return false;
+                edges.push_back(producer->second);
             }
         }
     }
-    order->reserve(nodes.size());
-    std::vector<NodeState> node_states(nodes.size(), NODE_UNVISITED);
-    for (size_t i = 0; i < (size_t) nodes.size(); ++i)
+    edgeBegin.push_back(edges.size());
+
+    order->clear();
+    order->reserve(nbNodes);
+    std::vector<NodeState> nodeStates(nbNodes, NODE_UNVISITED);
+    // Each entry is a node being visited and the position of its next edge to follow.
+    std::vector<std::pair<size_t, size_t>> stack;
+    for (size_t root = 0; root < nbNodes; ++root)
     {
-        if (!get_post_order(i, nodes, node_map, &node_states, order))
+        if (nodeStates[root] != NODE_UNVISITED)
+        {
+            continue;
+        }
+        nodeStates[root] = NODE_ACTIVE;
+        stack.emplace_back(root, edgeBegin[root]);
+        while (!stack.empty())
         {
-            return false;
+            auto& top = stack.back();
+            size_t const node = top.first;
+            if (top.second == edgeBegin[node + 1])
+            {
+                nodeStates[node] = NODE_VISITED;
+                order->push_back(node);
+                stack.pop_back();
+                continue;
+            }
+            size_t const producer = edges[top.second++];
+            if (nodeStates[producer] == NODE_ACTIVE)
+            {
+                if (error)
+                {
+                    *error = "Graph contains a cycle";
+                }
+                return false;
+            }
+            if (nodeStates[producer] == NODE_UNVISITED)
+            {
+                nodeStates[producer] = NODE_ACTIVE;
+                stack.emplace_back(producer, edgeBegin[producer]);
+            }
         }
     }
     return true;